@@ -12,21 +12,15 @@
 #ifndef AXIDMAAPP_H_
 #define AXIDMAAPP_H_
 
+#include <stdint.h>         // Fixed-width integer types
+
 #include "axidma_ioctl.h"   // Video frame structure
 
 /*----------------------------------------------------------------------------
  * Internal Definitions update by xin.han
  *----------------------------------------------------------------------------*/
 #define XPAR_BRAM_0_BASEADDR   0x42000000
-#define DMA_0_BASEADDR   0x40400000
-#define DMA_1_BASEADDR   0x40410000
-#define DMA_2_BASEADDR   0x40420000
-#define DMA_3_BASEADDR   0x40430000
 unsigned char *map_base0;//BRAM
-unsigned char *map_base1;//DMA0
-unsigned char *map_base2;//DMA1
-unsigned char *map_base3;//DMA2
-unsigned char *map_base4;//DMA3
 /**
  * The struct representing an AXI DMA device.
  *
@@ -43,6 +37,19 @@ struct axidma_dev;
  **/
 typedef struct axidma_dev* axidma_dev_t;
 
+/**
+ * The struct representing a receive ring running on a DMA channel.
+ *
+ * This is an opaque type to the end user, so it can only be used as a pointer
+ * or handle.
+ **/
+struct axidma_rx_stream;
+
+/**
+ * Type definition for a receive ring started by #axidma_start_rx_ring.
+ **/
+typedef struct axidma_rx_stream* axidma_rx_ring_t;
+
 /**
  * A structure that represents an integer array.
  *
@@ -65,13 +72,28 @@ typedef void (*axidma_cb_t)(int channel_id, void *data);
 /**
  * Initializes an AXI DMA device, returning a handle to the device.
  *
- * There is only one AXI DMA device, since it represents all of the available
- * channels. Thus, this function should only be invoked once, unless a call has
- * been made to #axidma_destroy. Otherwise, this function will abort.
+ * Each AXI DMA device in the device tree has its own device file, with its own
+ * channels and buffers. Several devices can be open at once, and each one is
+ * sent its own real-time signal, starting from SIGRTMIN, for completed
+ * asynchronous transfers.
  *
+ * @param[in] path The path to the device file, or NULL for AXIDMA_DEV_PATH,
+ *                 the first device.
  * @return A handle to the AXI DMA device on success, NULL on failure.
  **/
-struct axidma_dev *axidma_init();
+struct axidma_dev *axidma_init(const char *path);
+
+/**
+ * Initializes the AXI DMA device with the given index, returning a handle to
+ * the device.
+ *
+ * This is the same as #axidma_init, with the device file for the index, which
+ * is given by AXIDMA_DEV_PATH_FMT.
+ *
+ * @param[in] index The index of the device, which is 0 for the first one.
+ * @return A handle to the AXI DMA device on success, NULL on failure.
+ **/
+struct axidma_dev *axidma_init_index(int index);
 
 /**
  * Tears down and destroys an AXI DMA device, deallocating its resources.
@@ -124,19 +146,94 @@ const array_t *axidma_get_vdma_tx(axidma_dev_t dev);
  **/
 const array_t *axidma_get_vdma_rx(axidma_dev_t dev);
 
+/**
+ * Gets the stream that the channel carries on a multi-channel engine.
+ *
+ * Each stream of an AXI MCDMA engine is a separate channel, with its own id,
+ * which receives or transmits the AXI4-Stream data with one TDEST. Channels of
+ * single stream engines always carry stream 0.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] channel DMA channel to get the stream of.
+ * @return The TDEST of the channel's stream.
+ **/
+int axidma_get_stream_id(axidma_dev_t dev, int channel);
+
+/**
+ * Gets how the driver handles the data-ready events of a receive channel.
+ *
+ * If the channel has a data-ready interrupt in the device tree, the driver
+ * holds each receive until the fabric raises it, so there is no need to poll
+ * for the event before receiving. If the device tree also names the register
+ * that acknowledges each packet, the driver pulses it, and userspace must not.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] channel DMA channel to get the flags of.
+ * @return A combination of #AXIDMA_CHAN_READY_IRQ and #AXIDMA_CHAN_READY_ACK,
+ *         or 0 if userspace handles the channel's data-ready events.
+ **/
+int axidma_get_ready_flags(axidma_dev_t dev, int channel);
+
+// The memory types that can be requested from #axidma_malloc
+#define AXIDMA_MEM_COHERENT         0   // Uncached, coherent with the device
+#define AXIDMA_MEM_CACHED           1   // Cacheable, synchronized explicitly
+#define AXIDMA_MEM_WRITECOMBINE     2   // Write-combined, for transmit buffers
+
 /**
  * Allocates DMA buffer suitable for an AXI DMA/VDMA device of \p size bytes.
  *
  * This function allocates a DMA buffer that can be shared between the
- * processor and FPGA and is suitable for high bandwidth transfers. This means
- * that it is coherent between the FPGA and processor, and is contiguous in
- * physical memory.
+ * processor and FPGA and is suitable for high bandwidth transfers. The buffer
+ * is contiguous in physical memory, and \p flags selects how the processor
+ * accesses it:
+ *  - AXIDMA_MEM_COHERENT - The buffer is uncached, so it is always coherent
+ *                          with the FPGA, but slow for the processor to read.
+ *  - AXIDMA_MEM_CACHED - The buffer is cached, so it is fast for the processor
+ *                        to access, but must be synchronized with
+ *                        #axidma_sync_for_cpu and #axidma_sync_for_device.
+ *                        Its size is limited to the largest block of pages
+ *                        the kernel can allocate (typically 4 MiB).
+ *  - AXIDMA_MEM_WRITECOMBINE - The buffer is uncached, but the processor's
+ *                              writes to it are combined. This suits buffers
+ *                              that are filled with memcpy and transmitted.
+ *
+ * If the device tree node of the device has a 'memory-region' property, the
+ * uncached and write-combined buffers are carved out of that reserved memory,
+ * which is fast and cannot fail from fragmentation of the system's memory.
  *
  * @param[in] dev An #axidma_dev_t returned by #axidma_init.
  * @param[in] size The size of the buffer in bytes.
+ * @param[in] flags The memory type of the buffer, one of AXIDMA_MEM_*.
  * @return The address of buffer on success, NULL on failure.
  **/
-void *axidma_malloc(axidma_dev_t dev, size_t size);
+void *axidma_malloc(axidma_dev_t dev, size_t size, int flags);
+
+/**
+ * Makes the data received into a cached DMA buffer visible to the processor.
+ *
+ * This must be called on the received range of a buffer allocated with
+ * AXIDMA_MEM_CACHED, after the receive transfer completes and before the
+ * processor reads the data. It has no effect on other buffers.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] addr The start of the range, within a buffer from #axidma_malloc.
+ * @param[in] len The number of bytes in the range.
+ * @return 0 upon success, a negative number on failure.
+ **/
+int axidma_sync_for_cpu(axidma_dev_t dev, void *addr, size_t len);
+
+/**
+ * Makes the data written by the processor visible to the FPGA.
+ *
+ * This must be called on the written range of a buffer allocated with
+ * AXIDMA_MEM_CACHED, before a transfer from or into it is started.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] addr The start of the range, within a buffer from #axidma_malloc.
+ * @param[in] len The number of bytes in the range.
+ * @return 0 upon success, a negative number on failure.
+ **/
+int axidma_sync_for_device(axidma_dev_t dev, void *addr, size_t len);
 
 /**
  * Frees a DMA buffer previously allocated by #axidma_malloc.
@@ -159,7 +256,8 @@ void axidma_free(axidma_dev_t dev, void *addr, size_t size);
  * driver. For example, you might want to perform DMA transfers on a frame
  * buffer allocated by a display rendering manager (DRM) driver. Registering
  * the DMA buffer allows for the AXI DMA device to access it and perform
- * transfers.
+ * transfers. The buffer may be scattered in physical memory, in which case
+ * transfers on it use one descriptor for each contiguous chunk.
  *
  * @param[in] dev An #axidma_dev_t returned by #axidma_init.
  * @param[in] dmabuf_fd File descriptor corresponding to the buffer. This
@@ -186,6 +284,54 @@ int axidma_register_buffer(axidma_dev_t dev, int dmabuf_fd, void *user_addr,
  **/
 void axidma_unregister_buffer(axidma_dev_t dev, void *user_addr);
 
+/**
+ * Exports a buffer allocated with #axidma_malloc as a dma-buf.
+ *
+ * The returned file descriptor can be sent to another process over a Unix
+ * domain socket, and mapped there with mmap(), so that the data in the buffer
+ * is shared without copying it. The buffer stays allocated until it is freed
+ * with #axidma_free, and every copy of the file descriptor is closed. Buffers
+ * of type AXIDMA_MEM_CACHED must be synchronized by the other process with the
+ * DMA_BUF_IOCTL_SYNC ioctl on the file descriptor.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] user_addr Address of the buffer returned by #axidma_malloc.
+ * @return A dma-buf file descriptor for the whole buffer, which the caller
+ *         must close, or a negative number on failure.
+ **/
+int axidma_export_buffer(axidma_dev_t dev, void *user_addr);
+
+/**
+ * Pins ordinary memory, so that it can be used directly in DMA transfers.
+ *
+ * This allows memory that was not allocated by #axidma_malloc, such as a
+ * buffer from malloc(), to be the source or destination of a DMA transfer
+ * without first copying it into a DMA buffer. The memory stays pinned until
+ * #axidma_unpin_buffer is called, or the device is closed.
+ *
+ * Pinned memory is cached, so it must be synchronized with
+ * #axidma_sync_for_device before it is transmitted, and with
+ * #axidma_sync_for_cpu after data is received into it. It can only be used on
+ * DMA channels, not VDMA channels.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] user_addr The start of the memory to pin.
+ * @param[in] size The number of bytes to pin.
+ * @return 0 upon success, a negative number on failure.
+ **/
+int axidma_pin_buffer(axidma_dev_t dev, void *user_addr, size_t size);
+
+/**
+ * Unpins memory that was previously pinned by #axidma_pin_buffer.
+ *
+ * No transfers on the memory may be in progress. If \p user_addr has not been
+ * pinned with a call to #axidma_pin_buffer, then this function will abort.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] user_addr The address the memory was pinned with.
+ **/
+void axidma_unpin_buffer(axidma_dev_t dev, void *user_addr);
+
 /**
  * Registers a user callback function to be invoked upon completion of an
  * asynchronous transfer for the specified DMA channel.
@@ -222,7 +368,10 @@ void axidma_set_callback(axidma_dev_t dev, int channel, axidma_cb_t callback,
  * @param[in] len Number of bytes that will be transfered.
  * @param[in] wait Indicates if the transfer should be synchronous or
  *                 asynchronous. If true, this function will block.
- * @return 0 upon success, a negative number on failure.
+ * @return For synchronous transfers, the number of bytes actually transferred,
+ *         which for a receive may be less than \p len if the sender ended the
+ *         packet early. For asynchronous transfers, 0. A negative number on
+ *         failure.
  **/
 int axidma_oneway_transfer(axidma_dev_t dev, int channel, void *buf, size_t len,
         bool wait);
@@ -255,13 +404,373 @@ int axidma_oneway_transfer(axidma_dev_t dev, int channel, void *buf, size_t len,
  *                     channel. Should be set to NULL for non-VDMA transfers.
  * @param[in] wait Indicates if the transfer should be synchronous or
  *                 asynchronous. If true, this function will block.
- * @return 0 upon success, a negative number on failure.
+ * @return For synchronous transfers, the number of bytes actually received.
+ *         For asynchronous transfers, 0. A negative number on failure.
  **/
 int axidma_twoway_transfer(axidma_dev_t dev, int tx_channel, void *tx_buf,
         size_t tx_len, struct axidma_video_frame *tx_frame, int rx_channel,
         void *rx_buf, size_t rx_len, struct axidma_video_frame *rx_frame,
         bool wait);
 
+/**
+ * Maps a completion ring for asynchronous transfers, holding \p num_entries
+ * completions.
+ *
+ * Once the ring is mapped, the driver records every asynchronous transfer that
+ * completes in the ring, instead of delivering a signal for it. Completions are
+ * then collected in bulk with #axidma_reap_completions, without any signals or
+ * system calls. The ring is rounded up to fill a whole number of pages, so it
+ * may hold more than \p num_entries completions.
+ *
+ * This function will abort if a completion ring is already mapped.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] num_entries The minimum number of completions the ring can hold.
+ * @return 0 upon success, a negative number on failure.
+ **/
+int axidma_setup_completion_ring(axidma_dev_t dev, int num_entries);
+
+/**
+ * Collects up to \p max_completions finished asynchronous transfers from the
+ * completion ring.
+ *
+ * Completions are returned in the order that the transfers finished. For
+ * receives, the completion also holds the APP words of the packet, if its
+ * flags have AXIDMA_COMPLETION_APP_VALID set. This function never blocks, and
+ * returns 0 if there are no new completions. This function will abort if the
+ * completion ring has not been mapped with #axidma_setup_completion_ring.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[out] completions An array that receives the completions.
+ * @param[in] max_completions The number of entries in \p completions.
+ * @return The number of completions written to \p completions.
+ **/
+int axidma_reap_completions(axidma_dev_t dev,
+        struct axidma_completion *completions, int max_completions);
+
+/**
+ * Returns the file descriptor of the AXI DMA device, for use with poll().
+ *
+ * The descriptor is readable (POLLIN) whenever the completion ring mapped by
+ * #axidma_setup_completion_ring holds completions that have not been reaped,
+ * so it can be waited on in the same event loop as other file descriptors.
+ * The caller must not close the descriptor. This function can never fail.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @return The file descriptor of the AXI DMA device.
+ **/
+int axidma_get_poll_fd(axidma_dev_t dev);
+
+/**
+ * Binds an eventfd to the given DMA channel, which the driver signals whenever
+ * an asynchronous transfer on the channel completes.
+ *
+ * This replaces any eventfd previously bound to the channel, and the channel
+ * no longer invokes the callback registered with #axidma_set_callback. The
+ * eventfd is created by the caller with eventfd(2), and can be polled along
+ * with any other file descriptor.
+ *
+ * This function will abort if the channel is invalid.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] channel DMA channel to bind the eventfd to.
+ * @param[in] eventfd The eventfd to signal, or -1 to unbind the current one.
+ * @return 0 upon success, a negative number on failure.
+ **/
+int axidma_set_channel_eventfd(axidma_dev_t dev, int channel, int eventfd);
+
+/**
+ * Submits a batch of one-way DMA transfers with a single call to the driver.
+ *
+ * Each transaction in \p trans describes a transfer on a DMA channel, in the
+ * direction of that channel, and the transactions may span several channels.
+ * The driver prepares all of the transfers before starting each channel once,
+ * which avoids paying a system call for every transfer. If a transaction has
+ * its \p wait field set, this function blocks until that transfer completes.
+ *
+ * This function will abort if any of the channels do not exist, or if
+ * \p num_trans is not between 1 and AXIDMA_MAX_BATCH_TRANSACTIONS.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] trans An array of transactions to submit. Each buffer must have
+ *                  been previously allocated by #axidma_malloc or registered
+ *                  with #axidma_register_buffer.
+ * @param[in] num_trans The number of transactions in \p trans.
+ * @return 0 upon success, a negative number on failure. If only some of the
+ *         transactions could be submitted, the number of them is returned,
+ *         and the rest can be submitted again.
+ **/
+int axidma_submit_batch(axidma_dev_t dev, struct axidma_transaction *trans,
+        int num_trans);
+
+/**
+ * Submits a one-way DMA transfer, and returns a handle to it without waiting.
+ *
+ * The direction of the transfer is that of \p channel. The returned handle
+ * can be waited on with #axidma_wait, tested with #axidma_poll, or cancelled
+ * with #axidma_cancel. The transfer holds a slot in the channel's queue until
+ * its handle is reaped by #axidma_wait or #axidma_poll returning anything
+ * other than -ETIMEDOUT or -EAGAIN, so every handle must be reaped.
+ *
+ * This function will abort if the channel is invalid.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] channel DMA channel the transfer will take place on.
+ * @param[in] buf The buffer to send from or receive into. This must have been
+ *                allocated by #axidma_malloc or registered with
+ *                #axidma_register_buffer.
+ * @param[in] len The number of bytes to transfer.
+ * @param[in] user_tag A tag reported with the transfer in the completion ring.
+ * @param[out] handle The handle for the transfer.
+ * @return 0 upon success, a negative number on failure. errno is set to
+ *         EOPNOTSUPP if \p channel receives on a data-ready interrupt.
+ **/
+int axidma_submit(axidma_dev_t dev, int channel, void *buf, size_t len,
+        uint64_t user_tag, struct axidma_handle *handle);
+
+/**
+ * Submits a one-way DMA transfer with the given APP words, and returns a
+ * handle to it without waiting.
+ *
+ * This is the same as #axidma_submit, except that for a transmit, the APP
+ * words are placed in the packet's descriptors, and the engine presents them
+ * to the logic fabric on its control stream. They are ignored for receives,
+ * whose APP words are reported with #axidma_submit_rx_app instead.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] channel DMA channel the transfer will take place on.
+ * @param[in] buf The buffer to send from or receive into. This must have been
+ *                allocated by #axidma_malloc or registered with
+ *                #axidma_register_buffer.
+ * @param[in] len The number of bytes to transfer.
+ * @param[in] user_tag A tag reported with the transfer in the completion ring.
+ * @param[in] app The AXIDMA_NUM_APP_WORDS words to send, or NULL for zeros.
+ * @param[out] handle The handle for the transfer.
+ * @return 0 upon success, a negative number on failure.
+ **/
+int axidma_submit_app(axidma_dev_t dev, int channel, void *buf, size_t len,
+        uint64_t user_tag, const uint32_t *app, struct axidma_handle *handle);
+
+/**
+ * Submits a receive, and has the APP words of the packet reported with it.
+ *
+ * This is the same as #axidma_submit, except that the completion ring entry
+ * for the transfer holds the APP words that the engine wrote into the packet's
+ * descriptor, with AXIDMA_COMPLETION_APP_VALID set in its flags. The kernel's
+ * DMA driver only exposes these words from Linux 5.6. Without them, the call
+ * fails rather than report zeros.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] channel DMA receive channel the transfer will take place on.
+ * @param[in] buf The buffer to receive into. This must have been allocated by
+ *                #axidma_malloc or registered with #axidma_register_buffer.
+ * @param[in] len The number of bytes to receive.
+ * @param[in] user_tag A tag reported with the transfer in the completion ring.
+ * @param[out] handle The handle for the transfer.
+ * @return 0 upon success, a negative number on failure. errno is set to
+ *         EOPNOTSUPP if the APP words cannot be reported.
+ **/
+int axidma_submit_rx_app(axidma_dev_t dev, int channel, void *buf, size_t len,
+        uint64_t user_tag, struct axidma_handle *handle);
+
+/**
+ * Waits for a transfer submitted with #axidma_submit to finish.
+ *
+ * If the transfer finishes, successfully or not, its handle is reaped and can
+ * no longer be used. If the timeout expires first, the transfer is left in
+ * flight, and the handle can be waited on again or cancelled.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] handle The handle returned by #axidma_submit.
+ * @param[in] timeout_ns The maximum time to wait, in nanoseconds. A timeout of
+ *                       0 does not block, and AXIDMA_WAIT_FOREVER never times
+ *                       out.
+ * @return The number of bytes transferred if the transfer completed,
+ *         -ETIMEDOUT if the timeout expired, otherwise the negative error code
+ *         of the failure (e.g. -ECANCELED).
+ **/
+int axidma_wait(axidma_dev_t dev, struct axidma_handle *handle,
+        uint64_t timeout_ns);
+
+/**
+ * Checks if a transfer submitted with #axidma_submit has finished, without
+ * blocking.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] handle The handle returned by #axidma_submit.
+ * @return -EAGAIN if the transfer is still in flight, otherwise as for
+ *         #axidma_wait.
+ **/
+int axidma_poll(axidma_dev_t dev, struct axidma_handle *handle);
+
+/**
+ * Cancels a transfer submitted with #axidma_submit that is still in flight.
+ *
+ * The DMA engine cannot abort a single transfer, so this stops the channel,
+ * and every transfer still in flight on it finishes with -ECANCELED. The
+ * handle must still be reaped with #axidma_wait or #axidma_poll.
+ *
+ * The channel is only stopped if it is claimed with #axidma_claim_channel, or
+ * if no other process has a transfer in flight on it, so a channel that is
+ * shared should be claimed before its transfers are cancelled.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] handle The handle returned by #axidma_submit.
+ * @return 0 upon success, a negative number on failure. errno is set to
+ *         EBUSY if other transfers on the unclaimed channel would be stopped.
+ **/
+int axidma_cancel(axidma_dev_t dev, struct axidma_handle *handle);
+
+/**
+ * Prepares a DMA transfer that will be started repeatedly on the same buffer.
+ *
+ * The channel and buffer are checked, and the driver builds the transfer, only
+ * once, so each #axidma_start is cheaper than an #axidma_oneway_transfer. The
+ * direction of the transfer is that of \p channel, which must not be a VDMA
+ * channel. The transfer must be freed with #axidma_unprepare, or it is freed
+ * when the device is closed.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] channel DMA channel the transfer will take place on.
+ * @param[in] buf The buffer to send from or receive into. This must have been
+ *                allocated by #axidma_malloc or registered with
+ *                #axidma_register_buffer.
+ * @param[in] len The number of bytes to transfer.
+ * @param[in] wait Indicates if each start of the transfer should block until
+ *                 the transfer completes.
+ * @param[in] user_tag A tag reported with the transfer in the completion ring.
+ * @return The id of the prepared transfer upon success, a negative number on
+ *         failure.
+ **/
+int axidma_prepare(axidma_dev_t dev, int channel, void *buf, size_t len,
+        bool wait, uint64_t user_tag);
+
+/**
+ * Starts a transfer prepared with #axidma_prepare.
+ *
+ * The transfer completes the same as one started by #axidma_oneway_transfer.
+ * It can be started again before the previous start has completed, as long as
+ * the channel's queue has room.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] id The id returned by #axidma_prepare.
+ * @return For synchronous transfers, the number of bytes actually transferred.
+ *         For asynchronous transfers, 0. A negative number on failure.
+ **/
+int axidma_start(axidma_dev_t dev, int id);
+
+/**
+ * Frees a transfer prepared with #axidma_prepare.
+ *
+ * Starts of the transfer that are still in flight are not affected.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] id The id returned by #axidma_prepare.
+ **/
+void axidma_unprepare(axidma_dev_t dev, int id);
+
+/**
+ * Sets how long synchronous transfers on the channel spin before sleeping.
+ *
+ * For small transfers, the time to sleep and be woken up by the transfer's
+ * interrupt can be longer than the transfer itself. With a budget set, the
+ * waiting thread spins on the CPU for up to that long first, trading CPU time
+ * for lower latency. The initial budget is the driver's poll_budget_ns
+ * parameter.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] channel DMA channel to set the budget for.
+ * @param[in] budget_ns The maximum time to spin, in nanoseconds, or 0 to never
+ *                      spin.
+ * @return 0 upon success, a negative number on failure.
+ **/
+int axidma_set_poll_budget(axidma_dev_t dev, int channel, uint64_t budget_ns);
+
+/**
+ * Gets the spin budget of the channel, and how well spinning has worked on it.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] channel DMA channel to get the statistics for.
+ * @param[out] stats The budget, the number of transfers that finished while
+ *                   spinning (hits) or only after sleeping (misses), and the
+ *                   total time spent spinning.
+ * @return 0 upon success, a negative number on failure.
+ **/
+int axidma_get_poll_stats(axidma_dev_t dev, int channel,
+        struct axidma_busy_poll *stats);
+
+/**
+ * Sets the tunables of the channel.
+ *
+ * With an interrupt threshold of N, asynchronous transfers on a DMA channel
+ * are held back until N of them are queued, or until the interrupt delay runs
+ * out, and are then started together so that they raise only one interrupt.
+ * This only applies while the channel is idle, since a busy engine starts
+ * everything submitted to it as each transfer completes.
+ * The best way to change a tunable is to get the current ones with
+ * #axidma_get_channel_config, change the field, and set them back.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] config The tunables, with `channel_id` set to the channel. See
+ *                   AXIDMA_SET_CHANNEL_CONFIG for the range of each one.
+ * @return 0 upon success, a negative number on failure.
+ **/
+int axidma_set_channel_config(axidma_dev_t dev,
+        const struct axidma_channel_config *config);
+
+/**
+ * Gets the tunables of the channel.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] channel DMA channel to get the tunables for.
+ * @param[out] config The interrupt threshold and delay, the timeout for
+ *                    synchronous transfers, and the queue depth of the
+ *                    channel.
+ * @return 0 upon success, a negative number on failure.
+ **/
+int axidma_get_channel_config(axidma_dev_t dev, int channel,
+        struct axidma_channel_config *config);
+
+/**
+ * Gets the statistics of the channel.
+ *
+ * The counters are never reset, so rates are found by sampling them twice.
+ * The call copies out a snapshot, and is cheap enough to sample periodically.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] channel DMA channel to get the statistics for.
+ * @param[out] stats The transfer counters of the channel, and a histogram of
+ *                   the latency of its completed transfers. See
+ *                   AXIDMA_GET_STATS for the meaning of each field.
+ * @return 0 upon success, a negative number on failure.
+ **/
+int axidma_get_stats(axidma_dev_t dev, int channel,
+        struct axidma_channel_stats *stats);
+
+/**
+ * Claims the channel for the exclusive use of this handle.
+ *
+ * Channels are otherwise shared with every other process that has the device
+ * open. While the channel is claimed, transfers started on it by any other
+ * process fail. The claim lasts until #axidma_release_channel is called, or
+ * the device is closed.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] channel DMA channel to claim.
+ * @return 0 upon success, a negative number on failure, including when the
+ *         channel is claimed by another process.
+ **/
+int axidma_claim_channel(axidma_dev_t dev, int channel);
+
+/**
+ * Releases a channel claimed with #axidma_claim_channel.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] channel DMA channel to release.
+ * @return 0 upon success, a negative number on failure.
+ **/
+int axidma_release_channel(axidma_dev_t dev, int channel);
+
 /**
  * Starts a video DMA (VDMA) loop/continuous transfer on the given channel.
  *
@@ -303,6 +812,98 @@ int axidma_video_transfer(axidma_dev_t dev, int display_channel, size_t width,
  * @param[in] channel DMA channel to stop the transfer on.
  **/
 void axidma_stop_transfer(axidma_dev_t dev, int channel);
+
+/**
+ * Starts continuously receiving into a ring of \p num_slots slots on the given
+ * DMA receive channel.
+ *
+ * Every slot that the application does not hold is kept armed on the channel,
+ * so data that arrives between packets is never missed. Filled slots are
+ * collected in order with #axidma_rx_ring_next, and handed back with
+ * #axidma_rx_ring_release, neither of which needs a system call. If an eventfd
+ * is bound to the channel with #axidma_set_channel_eventfd, it is signaled
+ * whenever a slot is filled. No other transfers can be made on the channel
+ * until the ring is stopped with #axidma_stop_rx_ring.
+ *
+ * This function will abort if the channel is invalid.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] channel DMA receive channel to run the ring on.
+ * @param[in] buf The buffer that holds the slots back to back. This must have
+ *                been allocated by #axidma_malloc or pinned with
+ *                #axidma_pin_buffer, and hold \p num_slots * \p slot_size
+ *                bytes.
+ * @param[in] slot_size The number of bytes in each slot.
+ * @param[in] num_slots The number of slots in the ring.
+ * @return A handle to the receive ring on success, NULL on failure.
+ **/
+axidma_rx_ring_t axidma_start_rx_ring(axidma_dev_t dev, int channel, void *buf,
+        size_t slot_size, int num_slots);
+
+/**
+ * Gets the oldest filled slot of the receive ring that has not been released.
+ *
+ * This function never blocks, and calling it again without releasing the
+ * slot returns the same slot. If the buffer is cacheable, the received bytes
+ * must be synchronized with #axidma_sync_for_cpu before they are read.
+ *
+ * @param[in] ring The receive ring returned by #axidma_start_rx_ring.
+ * @param[out] length The number of bytes received into the slot.
+ * @return The start of the slot, or NULL if no slot has been filled. If the
+ *         ring has stopped on an error, NULL is returned and errno is set to
+ *         the error.
+ **/
+void *axidma_rx_ring_next(axidma_rx_ring_t ring, size_t *length);
+
+/**
+ * Hands the slot returned by #axidma_rx_ring_next back to the receive ring, so
+ * that it can be filled again.
+ *
+ * This only makes a system call when the ring has run out of slots and
+ * stalled. This function will abort if no slot is held.
+ *
+ * @param[in] ring The receive ring returned by #axidma_start_rx_ring.
+ **/
+void axidma_rx_ring_release(axidma_rx_ring_t ring);
+
+/**
+ * Stops a receive ring, and frees its resources.
+ *
+ * The buffer given to #axidma_start_rx_ring is not freed.
+ *
+ * @param[in] ring The receive ring returned by #axidma_start_rx_ring.
+ **/
+void axidma_stop_rx_ring(axidma_rx_ring_t ring);
+
+/**
+ * Forwards every packet received on \p rx_channel out on \p tx_channel, in
+ * the driver, without waking the application.
+ *
+ * The driver circulates \p num_slots slots of \p buf between the channels.
+ * Each received packet is sent from the slot it arrived in, and the slot is
+ * armed to receive again once it has been sent, so the data is never copied.
+ * No other transfers can be made on either channel until forwarding is
+ * stopped with #axidma_stop_transfer on either of them. The packets forwarded
+ * are counted in the statistics of both channels, from #axidma_get_stats.
+ *
+ * This function will abort if either channel is invalid.
+ *
+ * @param[in] dev An #axidma_dev_t returned by #axidma_init.
+ * @param[in] rx_channel DMA receive channel to forward packets from.
+ * @param[in] tx_channel DMA transmit channel to forward packets to.
+ * @param[in] buf The buffer that holds the slots back to back. This must have
+ *                been allocated by #axidma_malloc or pinned with
+ *                #axidma_pin_buffer, and hold \p num_slots * \p slot_size
+ *                bytes.
+ * @param[in] slot_size The number of bytes in each slot, which is the largest
+ *                      packet that can be forwarded.
+ * @param[in] num_slots The number of slots, at most AXIDMA_MAX_FORWARD_SLOTS.
+ * @param[in] max_length The most bytes of each packet to forward, or 0 to
+ *                       forward every packet whole.
+ * @return 0 upon success, a negative number on failure.
+ **/
+int axidma_start_forward(axidma_dev_t dev, int rx_channel, int tx_channel,
+        void *buf, size_t slot_size, int num_slots, size_t max_length);
 /**
  The following update by xin.han
  A convenient structure to carry information around about the transfer
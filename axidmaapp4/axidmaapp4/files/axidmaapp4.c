@@ -24,6 +24,7 @@
 #include <unistd.h>             // Close() system call
 #include <errno.h>              // Error codes
 #include <signal.h>             // Signal handling functions
+#include <stdint.h>             // Fixed-width integer types
 
 #include "axidmaapp.h"          // Local definitions
 #include "axidma_ioctl.h"       // The IOCTL interface to AXI DMA
@@ -38,13 +39,16 @@ typedef struct dma_channel {
     enum axidma_dir dir;        ///< Direction of the channel
     enum axidma_type type;      ///< Type of the channel
     int channel_id;             ///< Integer id of the channel.
+    int stream_id;              ///< TDEST of the channel's stream
+    int ready_flags;            ///< How the driver handles data-ready events
     axidma_cb_t callback;       ///< Callback function for channel completion
     void *user_data;            ///< User data to pass to the callback
 } dma_channel_t;
 
 // The structure that represents the AXI DMA device
 struct axidma_dev {
-    bool initialized;           ///< Indicates initialization for this struct.
+    int slot;                   ///< Index of the device in the open devices
+    int signal;                 ///< Real-time signal for completed transfers
     int fd;                     ///< File descriptor for the device
     array_t dma_tx_chans;       ///< Channel id's for the DMA transmit channels
     array_t dma_rx_chans;       ///< Channel id's for the DMA receive channels
@@ -52,10 +56,28 @@ struct axidma_dev {
     array_t vdma_rx_chans;      ///< Channel id's for the VDMA receive channels
     int num_channels;           ///< The total number of DMA channels
     dma_channel_t *channels;    ///< All of the VDMA/DMA channels in the system
+    struct axidma_completion_ring *ring;    ///< Completion ring, if mapped
+    size_t ring_size;           ///< The size of the completion ring mapping
 };
 
-// The DMA device structure, and a boolean checking if it's already open
-struct axidma_dev axidma_dev = {0};
+// The structure that represents a receive ring running on a channel
+struct axidma_rx_stream {
+    axidma_dev_t dev;           ///< The device the ring runs on
+    int channel_id;             ///< The channel the ring runs on
+    struct axidma_rx_ring *ring;    ///< The indices shared with the driver
+    size_t ring_size;           ///< The size of the indices mapping
+    char *buf;                  ///< The start of the first slot
+    size_t slot_size;           ///< The number of bytes in each slot
+    uint32_t num_slots;         ///< The number of slots in the ring
+};
+
+// The most AXI DMA devices that can be open at once
+#define AXIDMA_MAX_OPEN_DEVS    8
+
+/* The devices that are open, indexed by their slot. Each device is sent its
+ * own real-time signal, SIGRTMIN plus its slot, so that the signal handler can
+ * tell which device a completed channel belongs to. */
+static struct axidma_dev *axidma_devs[AXIDMA_MAX_OPEN_DEVS];
 
 /*----------------------------------------------------------------------------
  * Private Helper Functions
@@ -137,6 +159,8 @@ static int categorize_channels(axidma_dev_t dev,
         dma_chan->dir = chan->dir;
         dma_chan->type = chan->type;
         dma_chan->channel_id = chan->channel_id;
+        dma_chan->stream_id = chan->stream_id;
+        dma_chan->ready_flags = chan->ready_flags;
         dma_chan->callback = NULL;
         dma_chan->user_data = NULL;
     }
@@ -187,20 +211,42 @@ static int probe_channels(axidma_dev_t dev)
     return rc;
 }
 
+// Finds the DMA channel with the given id
+static dma_channel_t *find_channel(axidma_dev_t dev, int channel_id)
+{
+    int i;
+    dma_channel_t *dma_chan;
+
+    for (i = 0; i < dev->num_channels; i++)
+    {
+        dma_chan = &dev->channels[i];
+        if (dma_chan->channel_id == channel_id) {
+            return dma_chan;
+        }
+    }
+
+    return NULL;
+}
+
 static void axidma_callback(int signal, siginfo_t *siginfo, void *context)
 {
     int channel_id;
     dma_channel_t *chan;
+    struct axidma_dev *dev;
 
-    assert(0 <= siginfo->si_int && siginfo->si_int < axidma_dev.num_channels);
+    // Find the device that the signal was sent for
+    assert(0 <= signal - SIGRTMIN && signal - SIGRTMIN < AXIDMA_MAX_OPEN_DEVS);
+    dev = axidma_devs[signal - SIGRTMIN];
+    assert(dev != NULL);
 
     // Silence the compiler
-    (void)signal;
     (void)context;
 
-    // If the user defined a callback for a given channel, invoke it
+    /* If the user defined a callback for a given channel, invoke it. Channel
+     * ids are not indices, since the streams of an engine can start anywhere */
     channel_id = siginfo->si_int;
-    chan = &axidma_dev.channels[channel_id];
+    chan = find_channel(dev, channel_id);
+    assert(chan != NULL);
     if (chan->callback != NULL) {
         chan->callback(channel_id, chan->user_data);
     }
@@ -208,7 +254,7 @@ static void axidma_callback(int signal, siginfo_t *siginfo, void *context)
     return;
 }
 
-/* Sets up a signal handler for the lowest real-time signal to be delivered
+/* Sets up a signal handler for the device's real-time signal to be delivered
  * whenever any asynchronous DMA transaction compeletes. */
 // TODO: Should really check if real time signal is being used
 static int setup_dma_callback(axidma_dev_t dev)
@@ -220,14 +266,14 @@ static int setup_dma_callback(axidma_dev_t dev)
     sigact.sa_sigaction = axidma_callback;
     sigemptyset(&sigact.sa_mask);
     sigact.sa_flags = SA_RESTART | SA_SIGINFO;
-    rc = sigaction(SIGRTMIN, &sigact, NULL);
+    rc = sigaction(dev->signal, &sigact, NULL);
     if (rc < 0) {
         perror("Failed to register DMA callback");
         return rc;
     }
 
-    // Tell the driver to deliver us SIGRTMIN upon DMA completion
-    rc = ioctl(dev->fd, AXIDMA_SET_DMA_SIGNAL, SIGRTMIN);
+    // Tell the driver to deliver us the signal upon DMA completion
+    rc = ioctl(dev->fd, AXIDMA_SET_DMA_SIGNAL, dev->signal);
     if (rc < 0) {
         perror("Failed to set the DMA callback signal");
         return rc;
@@ -236,23 +282,6 @@ static int setup_dma_callback(axidma_dev_t dev)
     return 0;
 }
 
-// Finds the DMA channel with the given id
-static dma_channel_t *find_channel(axidma_dev_t dev, int channel_id)
-{
-    int i;
-    dma_channel_t *dma_chan;
-
-    for (i = 0; i < dev->num_channels; i++)
-    {
-        dma_chan = &dev->channels[i];
-        if (dma_chan->channel_id == channel_id) {
-            return dma_chan;
-        }
-    }
-
-    return NULL;
-}
-
 // Converts the AXI DMA direction to the corresponding ioctl for the transfer
 static unsigned long dir_to_ioctl(enum axidma_dir dir)
 {
@@ -268,42 +297,117 @@ static unsigned long dir_to_ioctl(enum axidma_dir dir)
     return 0;
 }
 
+// Submits a transfer with the given APP words and flags, without waiting
+static int submit_transfer(axidma_dev_t dev, int channel, void *buf,
+        size_t len, uint64_t user_tag, const uint32_t *app, uint32_t flags,
+        struct axidma_handle *handle)
+{
+    int rc;
+    struct axidma_submit submit;
+
+    assert(find_channel(dev, channel) != NULL);
+
+    // Setup the argument structure to the IOCTL
+    memset(&submit, 0, sizeof(submit));
+    submit.trans.wait = false;
+    submit.trans.channel_id = channel;
+    submit.trans.buf = buf;
+    submit.trans.buf_len = len;
+    submit.trans.user_tag = user_tag;
+    submit.trans.flags = flags;
+    if (app != NULL) {
+        memcpy(submit.trans.app, app, sizeof(submit.trans.app));
+    }
+
+    // Submit the transfer, and get its handle back
+    rc = ioctl(dev->fd, AXIDMA_DMA_SUBMIT, &submit);
+    if (rc < 0) {
+        perror("Failed to submit the DMA transfer");
+        return rc;
+    }
+
+    *handle = submit.handle;
+    return 0;
+}
+
 /*----------------------------------------------------------------------------
  * Public Interface
  *----------------------------------------------------------------------------*/
 
-/* Initializes the AXI DMA device, returning a new handle to the
- * axidma_device. */
-struct axidma_dev *axidma_init()
+/* Initializes the AXI DMA device at the given path, returning a new handle to
+ * the axidma_device. */
+struct axidma_dev *axidma_init(const char *path)
 {
-    assert(!axidma_dev.initialized);
+    int slot;
+    struct axidma_dev *dev;
 
-    // Open the AXI DMA device
-    axidma_dev.fd = open(AXIDMA_DEV_PATH, O_RDWR|O_EXCL);
-    if (axidma_dev.fd < 0) {
+    if (path == NULL) {
+        path = AXIDMA_DEV_PATH;
+    }
+
+    // Find a free slot for the device, which determines its signal
+    for (slot = 0; slot < AXIDMA_MAX_OPEN_DEVS; slot++)
+    {
+        if (axidma_devs[slot] == NULL) {
+            break;
+        }
+    }
+    if (slot == AXIDMA_MAX_OPEN_DEVS || SIGRTMIN + slot > SIGRTMAX) {
+        fprintf(stderr, "Unable to open `%s`, too many AXI DMA devices are "
+                "already open.\n", path);
+        return NULL;
+    }
+
+    dev = calloc(1, sizeof(*dev));
+    if (dev == NULL) {
+        perror("Unable to allocate the AXI DMA device structure");
+        return NULL;
+    }
+    dev->slot = slot;
+    dev->signal = SIGRTMIN + slot;
+
+    /* Open the AXI DMA device. Each open gets its own buffers and transfers,
+     * so other processes can share the device. */
+    dev->fd = open(path, O_RDWR);
+    if (dev->fd < 0) {
         perror("Error opening AXI DMA device");
         fprintf(stderr, "Expected the AXI DMA device at the path `%s`\n",
-                AXIDMA_DEV_PATH);
-        return NULL;
+                path);
+        goto free_dev;
     }
 
     // Query the AXIDMA device for all of its channels
-    if (probe_channels(&axidma_dev) < 0) {
-        close(axidma_dev.fd);
-        return NULL;
+    if (probe_channels(dev) < 0) {
+        goto close_dev;
     }
 
     // TODO: Should really check that signal is not already taken
     /* Setup a real-time signal to indicate when transactions have completed,
-     * and request the driver to send them to us. */
-    if (setup_dma_callback(&axidma_dev) < 0) {
-        close(axidma_dev.fd);
-        return NULL;
+     * and request the driver to send them to us. The device must be in its
+     * slot before the first signal can arrive. */
+    axidma_devs[slot] = dev;
+    if (setup_dma_callback(dev) < 0) {
+        axidma_devs[slot] = NULL;
+        goto close_dev;
     }
 
     // Return the AXI DMA device to the user
-    axidma_dev.initialized = true;
-    return &axidma_dev;
+    return dev;
+
+close_dev:
+    close(dev->fd);
+free_dev:
+    free(dev);
+    return NULL;
+}
+
+// Initializes the AXI DMA device with the given index
+struct axidma_dev *axidma_init_index(int index)
+{
+    char path[64];
+
+    snprintf(path, sizeof(path), AXIDMA_DEV_PATH_FMT, index);
+    return axidma_init(path);
 }
 
 // Tears down the given AXI DMA device structure
@@ -316,6 +420,13 @@ void axidma_destroy(axidma_dev_t dev)
     free(dev->dma_tx_chans.data);
     free(dev->channels);
 
+    // Unmap the completion ring, if it was mapped
+    if (dev->ring != NULL && munmap(dev->ring, dev->ring_size) < 0) {
+        perror("Failed to unmap the AXI DMA completion ring");
+        assert(false);
+    }
+    dev->ring = NULL;
+
     // Close the AXI DMA device
     if (close(dev->fd) < 0) {
         perror("Failed to close the AXI DMA device");
@@ -323,7 +434,8 @@ void axidma_destroy(axidma_dev_t dev)
     }
 
     // Free the device structure
-    axidma_dev.initialized = false;
+    axidma_devs[dev->slot] = NULL;
+    free(dev);
     return;
 }
 
@@ -351,15 +463,53 @@ const array_t *axidma_get_vdma_rx(axidma_dev_t dev)
     return &dev->vdma_rx_chans;
 }
 
+// Returns the TDEST of the stream that the channel carries
+int axidma_get_stream_id(axidma_dev_t dev, int channel)
+{
+    dma_channel_t *dma_chan;
+
+    dma_chan = find_channel(dev, channel);
+    assert(dma_chan != NULL);
+    return dma_chan->stream_id;
+}
+
+// Returns how the driver handles the channel's data-ready events
+int axidma_get_ready_flags(axidma_dev_t dev, int channel)
+{
+    dma_channel_t *dma_chan;
+
+    dma_chan = find_channel(dev, channel);
+    assert(dma_chan != NULL);
+    return dma_chan->ready_flags;
+}
+
 /* Allocates a region of memory suitable for use with the AXI DMA driver. Note
  * that this is a quite expensive operation, and should be done at initalization
- * time. */
-void *axidma_malloc(axidma_dev_t dev, size_t size)
+ * time, unless the device has a reserved memory region in the device tree. */
+void *axidma_malloc(axidma_dev_t dev, size_t size, int flags)
 {
     void *addr;
+    off_t offset;
+
+    // The page offset passed to mmap tells the driver the memory type
+    switch (flags) {
+        case AXIDMA_MEM_COHERENT:
+            offset = AXIDMA_MMAP_DMA_BUFFER;
+            break;
+        case AXIDMA_MEM_CACHED:
+            offset = AXIDMA_MMAP_CACHED_BUFFER;
+            break;
+        case AXIDMA_MEM_WRITECOMBINE:
+            offset = AXIDMA_MMAP_WRITECOMBINE_BUFFER;
+            break;
+        default:
+            fprintf(stderr, "Invalid memory type %d for DMA buffer.\n", flags);
+            return NULL;
+    }
+    offset *= sysconf(_SC_PAGESIZE);
 
     // Call the device's mmap method to allocate the memory region
-    addr = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, dev->fd, 0);
+    addr = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, dev->fd, offset);
     if (addr == MAP_FAILED) {
         return NULL;
     }
@@ -367,6 +517,36 @@ void *axidma_malloc(axidma_dev_t dev, size_t size)
     return addr;
 }
 
+int axidma_sync_for_cpu(axidma_dev_t dev, void *addr, size_t len)
+{
+    int rc;
+    struct axidma_sync_range range;
+
+    range.user_addr = addr;
+    range.size = len;
+    rc = ioctl(dev->fd, AXIDMA_SYNC_FOR_CPU, &range);
+    if (rc < 0) {
+        perror("Failed to sync the DMA buffer for the CPU");
+    }
+
+    return rc;
+}
+
+int axidma_sync_for_device(axidma_dev_t dev, void *addr, size_t len)
+{
+    int rc;
+    struct axidma_sync_range range;
+
+    range.user_addr = addr;
+    range.size = len;
+    rc = ioctl(dev->fd, AXIDMA_SYNC_FOR_DEVICE, &range);
+    if (rc < 0) {
+        perror("Failed to sync the DMA buffer for the device");
+    }
+
+    return rc;
+}
+
 /* This frees a region of memory that was allocated with a call to
  * axidma_malloc. The size passed in here must match the one used for that
  * call, or this function will throw an exception. */
@@ -399,6 +579,92 @@ void axidma_set_callback(axidma_dev_t dev, int channel, axidma_cb_t callback,
     return;
 }
 
+/* Maps the driver's completion ring into our address space. After this, the
+ * driver reports asynchronous completions through the ring, not signals. */
+int axidma_setup_completion_ring(axidma_dev_t dev, int num_entries)
+{
+    long page_size;
+    size_t size;
+    void *addr;
+
+    assert(dev->ring == NULL);
+    assert(num_entries > 0);
+
+    // Round the ring up to a whole number of pages
+    page_size = sysconf(_SC_PAGESIZE);
+    size = sizeof(*dev->ring) + num_entries * sizeof(dev->ring->entries[0]);
+    size = (size + page_size - 1) / page_size * page_size;
+
+    // The page offset tells the driver to map the ring, not a DMA buffer
+    addr = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, dev->fd,
+                AXIDMA_MMAP_COMPLETION_RING * page_size);
+    if (addr == MAP_FAILED) {
+        perror("Failed to map the AXI DMA completion ring");
+        return -errno;
+    }
+
+    dev->ring = addr;
+    dev->ring_size = size;
+    return 0;
+}
+
+/* Copies out all of the completions that the driver has posted since the last
+ * call, up to the given maximum, and hands their slots back to the driver. */
+int axidma_reap_completions(axidma_dev_t dev,
+        struct axidma_completion *completions, int max_completions)
+{
+    int i, count;
+    uint32_t head, tail;
+    struct axidma_completion_ring *ring;
+
+    assert(dev->ring != NULL);
+
+    // The acquire pairs with the driver's release, making the entries visible
+    ring = dev->ring;
+    head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    tail = ring->tail;
+    count = head - tail;
+    if (count > max_completions) {
+        count = max_completions;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        completions[i] = ring->entries[(tail + i) % ring->num_entries];
+    }
+
+    // Only release the slots to the driver after we are done reading them
+    __atomic_store_n(&ring->tail, tail + count, __ATOMIC_RELEASE);
+    return count;
+}
+
+// Returns the device's file descriptor, so it can be used in an event loop
+int axidma_get_poll_fd(axidma_dev_t dev)
+{
+    return dev->fd;
+}
+
+/* Binds an eventfd to the given channel, so that asynchronous completions on
+ * it can be waited upon with poll() or epoll. */
+int axidma_set_channel_eventfd(axidma_dev_t dev, int channel, int eventfd)
+{
+    int rc;
+    struct axidma_channel_eventfd chan_eventfd;
+
+    assert(find_channel(dev, channel) != NULL);
+
+    // Setup the argument structure for the IOCTL
+    chan_eventfd.channel_id = channel;
+    chan_eventfd.fd = eventfd;
+
+    rc = ioctl(dev->fd, AXIDMA_SET_CHANNEL_EVENTFD, &chan_eventfd);
+    if (rc < 0) {
+        perror("Failed to set the eventfd for the DMA channel");
+    }
+
+    return rc;
+}
+
 /* Registers a DMA buffer allocated by another driver with the AXI DMA driver.
  * This allows it to be used in DMA transfers later on. The user must make sure
  * that the driver that allocated the buffer has exported it. The file
@@ -439,6 +705,53 @@ void axidma_unregister_buffer(axidma_dev_t dev, void *user_addr)
     return;
 }
 
+int axidma_export_buffer(axidma_dev_t dev, void *user_addr)
+{
+    int rc;
+    struct axidma_export_buffer export_buffer;
+
+    // Perform the export with the driver, which returns the dma-buf
+    export_buffer.user_addr = user_addr;
+    rc = ioctl(dev->fd, AXIDMA_EXPORT_BUFFER, &export_buffer);
+    if (rc < 0) {
+        perror("Failed to export the DMA buffer");
+        return rc;
+    }
+
+    return export_buffer.fd;
+}
+
+int axidma_pin_buffer(axidma_dev_t dev, void *user_addr, size_t size)
+{
+    int rc;
+    struct axidma_pin_buffer pin_buffer;
+
+    // Setup the argument structure to the IOCTL
+    pin_buffer.user_addr = user_addr;
+    pin_buffer.size = size;
+
+    // Pin the memory, and map it for DMA
+    rc = ioctl(dev->fd, AXIDMA_PIN_BUFFER, &pin_buffer);
+    if (rc < 0) {
+        perror("Failed to pin the memory for DMA");
+    }
+
+    return rc;
+}
+
+void axidma_unpin_buffer(axidma_dev_t dev, void *user_addr)
+{
+    int rc;
+
+    rc = ioctl(dev->fd, AXIDMA_UNPIN_BUFFER, user_addr);
+    if (rc < 0) {
+        perror("Failed to unpin the memory");
+        assert(false);
+    }
+
+    return;
+}
+
 /* This performs a one-way transfer over AXI DMA, the direction being specified
  * by the user. The user determines if this is blocking or not with `wait. */
 int axidma_oneway_transfer(axidma_dev_t dev, int channel, void *buf,
@@ -453,20 +766,22 @@ int axidma_oneway_transfer(axidma_dev_t dev, int channel, void *buf,
 
     // Setup the argument structure to the IOCTL
     dma_chan = find_channel(dev, channel);
+    memset(&trans, 0, sizeof(trans));
     trans.wait = wait;
     trans.channel_id = channel;
     trans.buf = buf;
     trans.buf_len = len;
+    trans.user_tag = 0;
     axidma_cmd = dir_to_ioctl(dma_chan->dir);
 
-    // Perform the given transfer
+    /* Perform the given transfer. For synchronous transfers, the driver
+     * returns the number of bytes actually transferred. */
     rc = ioctl(dev->fd, axidma_cmd, &trans);
     if (rc < 0) {
         perror("Failed to perform the AXI DMA transfer");
-        return rc;
     }
 
-    return 0;
+    return rc;
 }
 
 /* This performs a two-way transfer over AXI DMA, both sending data out and
@@ -514,6 +829,251 @@ int axidma_twoway_transfer(axidma_dev_t dev, int tx_channel, void *tx_buf,
     return rc;
 }
 
+/* This submits a batch of one-way transfers over AXI DMA with a single ioctl,
+ * so the system call and engine start are paid once for the whole batch. */
+int axidma_submit_batch(axidma_dev_t dev, struct axidma_transaction *trans,
+        int num_trans)
+{
+    int rc, i;
+    struct axidma_batch_transaction batch;
+
+    assert(0 < num_trans && num_trans <= AXIDMA_MAX_BATCH_TRANSACTIONS);
+    for (i = 0; i < num_trans; i++)
+    {
+        assert(find_channel(dev, trans[i].channel_id) != NULL);
+    }
+
+    // Setup the argument structure for the IOCTL
+    batch.num_transactions = num_trans;
+    batch.transactions = trans;
+
+    // Submit all of the transfers in the batch
+    rc = ioctl(dev->fd, AXIDMA_DMA_SUBMIT_BATCH, &batch);
+    if (rc < 0) {
+        perror("Failed to submit the AXI DMA batch transfer");
+    }
+
+    return rc;
+}
+
+int axidma_submit(axidma_dev_t dev, int channel, void *buf, size_t len,
+        uint64_t user_tag, struct axidma_handle *handle)
+{
+    return axidma_submit_app(dev, channel, buf, len, user_tag, NULL, handle);
+}
+
+int axidma_submit_app(axidma_dev_t dev, int channel, void *buf, size_t len,
+        uint64_t user_tag, const uint32_t *app, struct axidma_handle *handle)
+{
+    return submit_transfer(dev, channel, buf, len, user_tag, app, 0, handle);
+}
+
+int axidma_submit_rx_app(axidma_dev_t dev, int channel, void *buf, size_t len,
+        uint64_t user_tag, struct axidma_handle *handle)
+{
+    return submit_transfer(dev, channel, buf, len, user_tag, NULL,
+                           AXIDMA_TRANS_RX_APP, handle);
+}
+
+int axidma_wait(axidma_dev_t dev, struct axidma_handle *handle,
+        uint64_t timeout_ns)
+{
+    int rc;
+    struct axidma_wait wait;
+
+    // Setup the argument structure to the IOCTL
+    wait.handle = *handle;
+    wait.timeout_ns = timeout_ns;
+
+    // Timeouts and failed transfers are reported through the return value
+    rc = ioctl(dev->fd, AXIDMA_DMA_WAIT, &wait);
+    return (rc < 0) ? -errno : rc;
+}
+
+int axidma_poll(axidma_dev_t dev, struct axidma_handle *handle)
+{
+    int rc;
+
+    rc = ioctl(dev->fd, AXIDMA_DMA_POLL, handle);
+    return (rc < 0) ? -errno : rc;
+}
+
+int axidma_cancel(axidma_dev_t dev, struct axidma_handle *handle)
+{
+    int rc;
+
+    rc = ioctl(dev->fd, AXIDMA_DMA_CANCEL, handle);
+    if (rc < 0) {
+        perror("Failed to cancel the DMA transfer");
+    }
+
+    return rc;
+}
+
+int axidma_prepare(axidma_dev_t dev, int channel, void *buf, size_t len,
+        bool wait, uint64_t user_tag)
+{
+    int rc;
+    struct axidma_prepare prepare;
+
+    assert(find_channel(dev, channel) != NULL);
+
+    // Setup the argument structure to the IOCTL
+    memset(&prepare, 0, sizeof(prepare));
+    prepare.trans.wait = wait;
+    prepare.trans.channel_id = channel;
+    prepare.trans.buf = buf;
+    prepare.trans.buf_len = len;
+    prepare.trans.user_tag = user_tag;
+
+    // Prepare the transfer, and get its id back
+    rc = ioctl(dev->fd, AXIDMA_PREPARE, &prepare);
+    if (rc < 0) {
+        perror("Failed to prepare the DMA transfer");
+        return -errno;
+    }
+
+    return prepare.id;
+}
+
+int axidma_start(axidma_dev_t dev, int id)
+{
+    int rc;
+
+    rc = ioctl(dev->fd, AXIDMA_START_PREPARED, id);
+    if (rc < 0) {
+        perror("Failed to start the prepared DMA transfer");
+        return -errno;
+    }
+
+    return rc;
+}
+
+void axidma_unprepare(axidma_dev_t dev, int id)
+{
+    int rc;
+
+    rc = ioctl(dev->fd, AXIDMA_UNPREPARE, id);
+    if (rc < 0) {
+        perror("Failed to free the prepared DMA transfer");
+    }
+
+    return;
+}
+
+int axidma_set_poll_budget(axidma_dev_t dev, int channel, uint64_t budget_ns)
+{
+    int rc;
+    struct axidma_busy_poll poll;
+
+    assert(find_channel(dev, channel) != NULL);
+
+    // Setup the argument structure to the IOCTL
+    memset(&poll, 0, sizeof(poll));
+    poll.channel_id = channel;
+    poll.budget_ns = budget_ns;
+
+    rc = ioctl(dev->fd, AXIDMA_SET_POLL_BUDGET, &poll);
+    if (rc < 0) {
+        perror("Failed to set the poll budget for the channel");
+    }
+
+    return rc;
+}
+
+int axidma_get_poll_stats(axidma_dev_t dev, int channel,
+        struct axidma_busy_poll *stats)
+{
+    int rc;
+
+    assert(find_channel(dev, channel) != NULL);
+
+    memset(stats, 0, sizeof(*stats));
+    stats->channel_id = channel;
+    rc = ioctl(dev->fd, AXIDMA_GET_POLL_STATS, stats);
+    if (rc < 0) {
+        perror("Failed to get the poll statistics for the channel");
+    }
+
+    return rc;
+}
+
+int axidma_set_channel_config(axidma_dev_t dev,
+        const struct axidma_channel_config *config)
+{
+    int rc;
+
+    assert(find_channel(dev, config->channel_id) != NULL);
+
+    rc = ioctl(dev->fd, AXIDMA_SET_CHANNEL_CONFIG, config);
+    if (rc < 0) {
+        perror("Failed to set the tunables for the channel");
+    }
+
+    return rc;
+}
+
+int axidma_get_channel_config(axidma_dev_t dev, int channel,
+        struct axidma_channel_config *config)
+{
+    int rc;
+
+    assert(find_channel(dev, channel) != NULL);
+
+    memset(config, 0, sizeof(*config));
+    config->channel_id = channel;
+    rc = ioctl(dev->fd, AXIDMA_GET_CHANNEL_CONFIG, config);
+    if (rc < 0) {
+        perror("Failed to get the tunables for the channel");
+    }
+
+    return rc;
+}
+
+int axidma_get_stats(axidma_dev_t dev, int channel,
+        struct axidma_channel_stats *stats)
+{
+    int rc;
+
+    assert(find_channel(dev, channel) != NULL);
+
+    stats->channel_id = channel;
+    rc = ioctl(dev->fd, AXIDMA_GET_STATS, stats);
+    if (rc < 0) {
+        perror("Failed to get the statistics for the channel");
+    }
+
+    return rc;
+}
+
+int axidma_claim_channel(axidma_dev_t dev, int channel)
+{
+    int rc;
+
+    assert(find_channel(dev, channel) != NULL);
+
+    rc = ioctl(dev->fd, AXIDMA_CLAIM_CHANNEL, channel);
+    if (rc < 0) {
+        perror("Failed to claim the channel");
+    }
+
+    return rc;
+}
+
+int axidma_release_channel(axidma_dev_t dev, int channel)
+{
+    int rc;
+
+    assert(find_channel(dev, channel) != NULL);
+
+    rc = ioctl(dev->fd, AXIDMA_RELEASE_CHANNEL, channel);
+    if (rc < 0) {
+        perror("Failed to release the channel");
+    }
+
+    return rc;
+}
+
 /* This function performs a video transfer over AXI DMA, setting up a VDMA
  * channel to either read from or write to given frame buffers on-demand
  * continuously. This call is always non-blocking. The transfer can only be
@@ -572,6 +1132,156 @@ void axidma_stop_transfer(axidma_dev_t dev, int channel)
 
     return;
 }
+
+/* Maps the indices for a receive ring, and starts the ring on the channel,
+ * with every slot armed. */
+axidma_rx_ring_t axidma_start_rx_ring(axidma_dev_t dev, int channel, void *buf,
+        size_t slot_size, int num_slots)
+{
+    long page_size;
+    void *addr;
+    struct axidma_rx_stream *stream;
+    struct axidma_rx_ring_config config;
+
+    assert(find_channel(dev, channel) != NULL);
+    assert(find_channel(dev, channel)->dir == AXIDMA_READ);
+    assert(num_slots > 0);
+
+    stream = malloc(sizeof(*stream));
+    if (stream == NULL) {
+        return NULL;
+    }
+
+    // Round the indices up to a whole number of pages
+    page_size = sysconf(_SC_PAGESIZE);
+    stream->ring_size = sizeof(*stream->ring) +
+                        num_slots * sizeof(stream->ring->lengths[0]);
+    stream->ring_size = (stream->ring_size + page_size - 1) / page_size *
+                        page_size;
+
+    // The page offset tells the driver to map ring indices, not a DMA buffer
+    addr = mmap(NULL, stream->ring_size, PROT_READ|PROT_WRITE, MAP_SHARED,
+                dev->fd, AXIDMA_MMAP_RX_RING * page_size);
+    if (addr == MAP_FAILED) {
+        perror("Failed to map the AXI DMA receive ring");
+        free(stream);
+        return NULL;
+    }
+    stream->dev = dev;
+    stream->channel_id = channel;
+    stream->ring = addr;
+    stream->buf = buf;
+    stream->slot_size = slot_size;
+    stream->num_slots = num_slots;
+
+    // Setup the argument structure for the IOCTL, and start the ring
+    config.channel_id = channel;
+    config.ring = stream->ring;
+    config.buf = buf;
+    config.slot_size = slot_size;
+    config.num_slots = num_slots;
+    if (ioctl(dev->fd, AXIDMA_START_RX_RING, &config) < 0) {
+        perror("Failed to start the AXI DMA receive ring");
+        munmap(stream->ring, stream->ring_size);
+        free(stream);
+        return NULL;
+    }
+
+    return stream;
+}
+
+/* Returns the oldest slot that the driver has filled, and that we have not
+ * handed back yet. */
+void *axidma_rx_ring_next(axidma_rx_ring_t stream, size_t *length)
+{
+    uint32_t producer, consumer, slot;
+    struct axidma_rx_ring *ring;
+
+    // The acquire pairs with the driver's release, making the length visible
+    ring = stream->ring;
+    producer = __atomic_load_n(&ring->producer, __ATOMIC_ACQUIRE);
+    consumer = ring->consumer;
+    if (producer == consumer) {
+        if (ring->status < 0) {
+            errno = -ring->status;
+        }
+        return NULL;
+    }
+
+    slot = consumer % stream->num_slots;
+    *length = ring->lengths[slot];
+    return stream->buf + slot * stream->slot_size;
+}
+
+/* Hands the oldest slot back to the driver. The driver re-arms it on its next
+ * completion, unless the ring has stalled, in which case it is kicked. */
+void axidma_rx_ring_release(axidma_rx_ring_t stream)
+{
+    uint32_t consumer;
+    struct axidma_rx_ring *ring;
+
+    ring = stream->ring;
+    consumer = ring->consumer;
+    assert(consumer != __atomic_load_n(&ring->producer, __ATOMIC_ACQUIRE));
+
+    /* Only hand back the slot after we are done with it. The fence orders the
+     * store against the load of the flags, which pairs with the driver
+     * checking our index again after it sets the flag. */
+    __atomic_store_n(&ring->consumer, consumer + 1, __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ring->flags, __ATOMIC_RELAXED) &
+            AXIDMA_RX_RING_NEED_KICK) {
+        if (ioctl(stream->dev->fd, AXIDMA_KICK_RX_RING,
+                  stream->channel_id) < 0) {
+            perror("Failed to kick the AXI DMA receive ring");
+        }
+    }
+
+    return;
+}
+
+// Stops the receive ring's channel, and unmaps its indices
+void axidma_stop_rx_ring(axidma_rx_ring_t stream)
+{
+    axidma_stop_transfer(stream->dev, stream->channel_id);
+    if (munmap(stream->ring, stream->ring_size) < 0) {
+        perror("Failed to unmap the AXI DMA receive ring");
+        assert(false);
+    }
+
+    free(stream);
+    return;
+}
+
+/* Binds the receive channel to the transmit channel, so that the driver sends
+ * out every packet received, from the same buffer. */
+int axidma_start_forward(axidma_dev_t dev, int rx_channel, int tx_channel,
+        void *buf, size_t slot_size, int num_slots, size_t max_length)
+{
+    int rc;
+    struct axidma_forward_config config;
+
+    assert(find_channel(dev, rx_channel) != NULL);
+    assert(find_channel(dev, rx_channel)->dir == AXIDMA_READ);
+    assert(find_channel(dev, tx_channel) != NULL);
+    assert(find_channel(dev, tx_channel)->dir == AXIDMA_WRITE);
+
+    // Setup the argument structure for the IOCTL
+    config.rx_channel_id = rx_channel;
+    config.tx_channel_id = tx_channel;
+    config.buf = buf;
+    config.slot_size = slot_size;
+    config.num_slots = num_slots;
+    config.max_length = max_length;
+
+    rc = ioctl(dev->fd, AXIDMA_START_FORWARD, &config);
+    if (rc < 0) {
+        perror("Failed to start forwarding between the DMA channels");
+    }
+
+    return rc;
+}
+
 void XDma_Out32(unsigned int * Addr, unsigned int Value)
 {
 	volatile unsigned int *LocalAddr = (volatile unsigned int *)Addr;
@@ -599,13 +1309,9 @@ int axidma_config()
      mmap 函数的返回值就等于映射之后得到的实际地址
     */
     map_base0 = mmap(NULL, 1024 * 4, PROT_READ | PROT_WRITE, MAP_SHARED, fd, XPAR_BRAM_0_BASEADDR);
-    map_base1 = mmap(NULL, 1024 * 4, PROT_READ | PROT_WRITE, MAP_SHARED, fd, DMA_0_BASEADDR);
-    map_base2 = mmap(NULL, 1024 * 4, PROT_READ | PROT_WRITE, MAP_SHARED, fd, DMA_1_BASEADDR);
-    map_base3 = mmap(NULL, 1024 * 4, PROT_READ | PROT_WRITE, MAP_SHARED, fd, DMA_2_BASEADDR);
-    map_base4 = mmap(NULL, 1024 * 4, PROT_READ | PROT_WRITE, MAP_SHARED, fd, DMA_3_BASEADDR);
     
     
-    if (map_base0 == 0 || map_base1 == 0|| map_base2 == 0|| map_base3 == 0|| map_base4 == 0) { 
+    if (map_base0 == 0) { 
         printf("NULL pointer\n");
     }   
     else {
@@ -676,8 +1382,11 @@ int rapidio_jm_read(axidma_dev_t dev, struct dma_transfer *trans0,
         fprintf(stderr, "DMA read transaction failed.\n");
         // goto free_output_buf;
         axidma_free(dev, trans0->output_buf, trans0->output_size);
+        return rc;
     }
-    Length = XDma_In32(map_base1+0x58);
+
+    // The driver returns the number of bytes actually received
+    Length = rc;
    
     // canshujiancha
     if(Length > 10240)
@@ -687,10 +1396,16 @@ int rapidio_jm_read(axidma_dev_t dev, struct dma_transfer *trans0,
 	    }
   
     // rc = robust_write(trans->output_fd, trans->output_buf, trans->output_size);
+    // The receive buffer is cached, so drop any stale lines before reading
+    axidma_sync_for_cpu(dev, trans0->output_buf, Length);
     memcpy(rbuffer0,trans0->output_buf,Length);
-    XBram_Out32(map_base0+8,0x1);
-    //   usleep(15);
-    XBram_Out32(map_base0+8,0x0);
+    // The driver acknowledges the packet itself if it has the register
+    if (!(axidma_get_ready_flags(dev, trans0->output_channel) &
+          AXIDMA_CHAN_READY_ACK)) {
+        XBram_Out32(map_base0+8,0x1);
+        //   usleep(15);
+        XBram_Out32(map_base0+8,0x0);
+    }
     // free_output_buf:
     // axidma_free(dev, trans->output_buf, trans->output_size);
     // free_input_buf:
@@ -756,8 +1471,11 @@ int rapidio_dx_read(axidma_dev_t dev, struct dma_transfer *trans1,
         fprintf(stderr, "DMA read transaction failed.\n");
         // goto free_output_buf;
         axidma_free(dev, trans1->output_buf, trans1->output_size);
+        return rc;
     }
-    Length = XDma_In32(map_base2+0x58);
+
+    // The driver returns the number of bytes actually received
+    Length = rc;
    
     // canshujiancha
     if(Length > 10240)
@@ -767,10 +1485,16 @@ int rapidio_dx_read(axidma_dev_t dev, struct dma_transfer *trans1,
 	    }
   
     // rc = robust_write(trans->output_fd, trans->output_buf, trans->output_size);
+    // The receive buffer is cached, so drop any stale lines before reading
+    axidma_sync_for_cpu(dev, trans1->output_buf, Length);
     memcpy(rbuffer1,trans1->output_buf,Length);
-    XBram_Out32(map_base0+20,0x1);
-    //   usleep(15);
-    XBram_Out32(map_base0+20,0x0);
+    // The driver acknowledges the packet itself if it has the register
+    if (!(axidma_get_ready_flags(dev, trans1->output_channel) &
+          AXIDMA_CHAN_READY_ACK)) {
+        XBram_Out32(map_base0+20,0x1);
+        //   usleep(15);
+        XBram_Out32(map_base0+20,0x0);
+    }
     // free_output_buf:
     // axidma_free(dev, trans->output_buf, trans->output_size);
     // free_input_buf:
@@ -832,8 +1556,11 @@ int rapidio_dd_read(axidma_dev_t dev, struct dma_transfer *trans2,
         fprintf(stderr, "DMA read transaction failed.\n");
         // goto free_output_buf;
         axidma_free(dev, trans2->output_buf, trans2->output_size);
+        return rc;
     }
-    Length = XDma_In32(map_base3+0x58);
+
+    // The driver returns the number of bytes actually received
+    Length = rc;
    
     // canshujiancha
     if(Length > 10240)
@@ -843,10 +1570,16 @@ int rapidio_dd_read(axidma_dev_t dev, struct dma_transfer *trans2,
 	    }
   
     // rc = robust_write(trans->output_fd, trans->output_buf, trans->output_size);
+    // The receive buffer is cached, so drop any stale lines before reading
+    axidma_sync_for_cpu(dev, trans2->output_buf, Length);
     memcpy(rbuffer2,trans2->output_buf,Length);
-    XBram_Out32(map_base0+32,0x1);
-    //   usleep(15);
-    XBram_Out32(map_base0+32,0x0);
+    // The driver acknowledges the packet itself if it has the register
+    if (!(axidma_get_ready_flags(dev, trans2->output_channel) &
+          AXIDMA_CHAN_READY_ACK)) {
+        XBram_Out32(map_base0+32,0x1);
+        //   usleep(15);
+        XBram_Out32(map_base0+32,0x0);
+    }
     // free_output_buf:
     // axidma_free(dev, trans->output_buf, trans->output_size);
     // free_input_buf:
@@ -908,8 +1641,11 @@ int rapidio_dj_read(axidma_dev_t dev, struct dma_transfer *trans3,
         fprintf(stderr, "DMA read transaction failed.\n");
         // goto free_output_buf;
         axidma_free(dev, trans3->output_buf, trans3->output_size);
+        return rc;
     }
-    Length = XDma_In32(map_base4+0x58);
+
+    // The driver returns the number of bytes actually received
+    Length = rc;
    
     // canshujiancha
     if(Length > 10240)
@@ -919,10 +1655,16 @@ int rapidio_dj_read(axidma_dev_t dev, struct dma_transfer *trans3,
 	    }
   
     // rc = robust_write(trans->output_fd, trans->output_buf, trans->output_size);
+    // The receive buffer is cached, so drop any stale lines before reading
+    axidma_sync_for_cpu(dev, trans3->output_buf, Length);
     memcpy(rbuffer3,trans3->output_buf,Length);
-    XBram_Out32(map_base0+44,0x1);
-    //   usleep(15);
-    XBram_Out32(map_base0+44,0x0);
+    // The driver acknowledges the packet itself if it has the register
+    if (!(axidma_get_ready_flags(dev, trans3->output_channel) &
+          AXIDMA_CHAN_READY_ACK)) {
+        XBram_Out32(map_base0+44,0x1);
+        //   usleep(15);
+        XBram_Out32(map_base0+44,0x0);
+    }
     // free_output_buf:
     // axidma_free(dev, trans->output_buf, trans->output_size);
     // free_input_buf:
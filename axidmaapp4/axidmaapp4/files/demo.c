@@ -209,6 +209,27 @@ static int parse_args(int argc, char **argv,  int *input_channel, int *output_ch
     return 0;
 }
 
+/* Waits for the fabric to raise a receive channel's data-ready GPIO, and
+ * clears the event. Returns false if poll returned without it. */
+static bool wait_rx_gpio(struct pollfd *fds, int gpio)
+{
+    int ret;
+    char buff[10];
+
+    ret = poll(fds,1,-1);
+    if( ret == -1 )
+        MSG("poll\n");
+    if( !(fds[0].revents & POLLPRI) )
+        return false;
+    ret = lseek(gpio,0,SEEK_SET);
+    if( ret == -1 )
+        MSG("lseek\n");
+    ret = read(gpio,buff,10);
+    if( ret == -1 )
+        MSG("read\n");
+    return true;
+}
+
 //receive
 void *rapidio_taks_rec(void *arg)
 {
@@ -218,6 +239,7 @@ void *rapidio_taks_rec(void *arg)
     unsigned int rec_len = 0;
     struct pollfd fds[1];
     char buff[10];
+    int ready_irq;
     static cnt = 0;
    
     fds[0].fd = gpio_fd1;
@@ -228,24 +250,21 @@ void *rapidio_taks_rec(void *arg)
     printf("\tTransmit Channel: %d\n", trans0.input_channel);
     printf("\tReceive Channel: %d\n", trans0.output_channel); 
 
-
-    ret = read(gpio_fd1,buff,10);
-    if( ret == -1 )
-        MSG("read\n");
-
-    while(1)
+    /* If the driver takes the channel's data-ready interrupt, it holds each
+     * receive until the packet is ready, so there is no GPIO to poll */
+    ready_irq = axidma_get_ready_flags(axidma_dev, trans0.output_channel) &
+                AXIDMA_CHAN_READY_IRQ;
+    if( !ready_irq )
     {
-      ret = poll(fds,1,-1);
-      if( ret == -1 )
-          MSG("poll\n");
-      if( fds[0].revents & POLLPRI)
-      {
-        ret = lseek(gpio_fd1,0,SEEK_SET);
-        if( ret == -1 )
-            MSG("lseek\n");
         ret = read(gpio_fd1,buff,10);
         if( ret == -1 )
             MSG("read\n");
+    }
+
+    while(1)
+    {
+      if( ready_irq || wait_rx_gpio(fds, gpio_fd1))
+      {
 
     //    printf("\n--------------------------------------------------------------------------------\n");
         rec_len = rapidio_jm_read(axidma_dev, &trans0, rbuffer0);
@@ -307,6 +326,7 @@ void *rapidio_taks_rec1(void *arg)
     unsigned int rec_len = 0;
     struct pollfd fds[1];
     char buff[10];
+    int ready_irq;
     static cnt = 0;
   
 
@@ -318,23 +338,21 @@ void *rapidio_taks_rec1(void *arg)
     printf("\tTransmit Channel: %d\n", trans1.input_channel);
     printf("\tReceive Channel: %d\n", trans1.output_channel); 
 
-    ret = read(gpio_fd3,buff,10);
-    if( ret == -1 )
-        MSG("read\n");
-
-    while(1)
+    /* If the driver takes the channel's data-ready interrupt, it holds each
+     * receive until the packet is ready, so there is no GPIO to poll */
+    ready_irq = axidma_get_ready_flags(axidma_dev, trans1.output_channel) &
+                AXIDMA_CHAN_READY_IRQ;
+    if( !ready_irq )
     {
-      ret = poll(fds,1,-1);
-      if( ret == -1 )
-          MSG("poll\n");
-      if( fds[0].revents & POLLPRI)
-      {
-        ret = lseek(gpio_fd3,0,SEEK_SET);
-        if( ret == -1 )
-            MSG("lseek\n");
         ret = read(gpio_fd3,buff,10);
         if( ret == -1 )
             MSG("read\n");
+    }
+
+    while(1)
+    {
+      if( ready_irq || wait_rx_gpio(fds, gpio_fd3))
+      {
 
     //    printf("\n--------------------------------------------------------------------------------\n");
         rec_len = rapidio_dx_read(axidma_dev, &trans1, rbuffer1);
@@ -396,6 +414,7 @@ void *rapidio_taks_rec2(void *arg)
     unsigned int rec_len = 0;
     struct pollfd fds[1];
     char buff[10];
+    int ready_irq;
     static cnt = 0;
   
 
@@ -407,23 +426,21 @@ void *rapidio_taks_rec2(void *arg)
     printf("\tTransmit Channel: %d\n", trans2.input_channel);
     printf("\tReceive Channel: %d\n", trans2.output_channel); 
 
-    ret = read(gpio_fd5,buff,10);
-    if( ret == -1 )
-        MSG("read\n");
-
-    while(1)
+    /* If the driver takes the channel's data-ready interrupt, it holds each
+     * receive until the packet is ready, so there is no GPIO to poll */
+    ready_irq = axidma_get_ready_flags(axidma_dev, trans2.output_channel) &
+                AXIDMA_CHAN_READY_IRQ;
+    if( !ready_irq )
     {
-      ret = poll(fds,1,-1);
-      if( ret == -1 )
-          MSG("poll\n");
-      if( fds[0].revents & POLLPRI)
-      {
-        ret = lseek(gpio_fd5,0,SEEK_SET);
-        if( ret == -1 )
-            MSG("lseek\n");
         ret = read(gpio_fd5,buff,10);
         if( ret == -1 )
             MSG("read\n");
+    }
+
+    while(1)
+    {
+      if( ready_irq || wait_rx_gpio(fds, gpio_fd5))
+      {
 
     //    printf("\n--------------------------------------------------------------------------------\n");
         rec_len = rapidio_dd_read(axidma_dev, &trans2, rbuffer2);
@@ -486,6 +503,7 @@ void *rapidio_taks_rec3(void *arg)
     unsigned int rec_len = 0;
     struct pollfd fds[1];
     char buff[10];
+    int ready_irq;
     static cnt = 0;
   
 
@@ -497,23 +515,21 @@ void *rapidio_taks_rec3(void *arg)
     printf("\tTransmit Channel: %d\n", trans3.input_channel);
     printf("\tReceive Channel: %d\n", trans3.output_channel); 
 
-    ret = read(gpio_fd7,buff,10);
-    if( ret == -1 )
-        MSG("read\n");
-
-    while(1)
+    /* If the driver takes the channel's data-ready interrupt, it holds each
+     * receive until the packet is ready, so there is no GPIO to poll */
+    ready_irq = axidma_get_ready_flags(axidma_dev, trans3.output_channel) &
+                AXIDMA_CHAN_READY_IRQ;
+    if( !ready_irq )
     {
-      ret = poll(fds,1,-1);
-      if( ret == -1 )
-          MSG("poll\n");
-      if( fds[0].revents & POLLPRI)
-      {
-        ret = lseek(gpio_fd7,0,SEEK_SET);
-        if( ret == -1 )
-            MSG("lseek\n");
         ret = read(gpio_fd7,buff,10);
         if( ret == -1 )
             MSG("read\n");
+    }
+
+    while(1)
+    {
+      if( ready_irq || wait_rx_gpio(fds, gpio_fd7))
+      {
 
     //    printf("\n--------------------------------------------------------------------------------\n");
         rec_len = rapidio_dj_read(axidma_dev, &trans3, rbuffer3);
@@ -773,7 +789,7 @@ int main(int argc, char **argv)
     /*****************初始化设备和默认配置准备*******************************/
 
     // 初始化AXIDMA设备
-    axidma_dev = axidma_init();
+    axidma_dev = axidma_init(NULL);
     if (axidma_dev == NULL) {
         fprintf(stderr, "Error: Failed to initialize the AXI DMA device.\n");
         rc = 1;
@@ -822,49 +838,57 @@ int main(int argc, char **argv)
     trans3.output_size = MAXLENGTH;//DJ接收长度
     trans3.input_size = TESTLENGTH;//DJ发送长度
     // 为输出文件分配一个缓冲区
-    trans0.output_buf = axidma_malloc(axidma_dev, trans0.output_size);
+    trans0.output_buf = axidma_malloc(axidma_dev, trans0.output_size,
+            AXIDMA_MEM_CACHED);
     if (trans0.output_buf == NULL) {
         rc = -ENOMEM;
         // goto free_output_buf;
         axidma_free(axidma_dev, trans0.output_buf, trans0.output_size);
     }
-    trans0.input_buf = axidma_malloc(axidma_dev, trans0.input_size);
+    trans0.input_buf = axidma_malloc(axidma_dev, trans0.input_size,
+            AXIDMA_MEM_WRITECOMBINE);
     if (trans0.input_buf == NULL) {
         fprintf(stderr, "Failed to allocate the input buffer.\n");
         rc = -ENOMEM;
         axidma_free(axidma_dev, trans0.input_buf, trans0.input_size);
     }
-    trans1.output_buf = axidma_malloc(axidma_dev, trans1.output_size);
+    trans1.output_buf = axidma_malloc(axidma_dev, trans1.output_size,
+            AXIDMA_MEM_CACHED);
     if (trans1.output_buf == NULL) {
         rc = -ENOMEM;
         // goto free_output_buf;
         axidma_free(axidma_dev, trans1.output_buf, trans1.output_size);
     }
-    trans1.input_buf = axidma_malloc(axidma_dev, trans1.input_size);
+    trans1.input_buf = axidma_malloc(axidma_dev, trans1.input_size,
+            AXIDMA_MEM_WRITECOMBINE);
     if (trans1.input_buf == NULL) {
         fprintf(stderr, "Failed to allocate the input buffer.\n");
         rc = -ENOMEM;
         axidma_free(axidma_dev, trans1.input_buf, trans1.input_size);
     }
-    trans2.output_buf = axidma_malloc(axidma_dev, trans2.output_size);
+    trans2.output_buf = axidma_malloc(axidma_dev, trans2.output_size,
+            AXIDMA_MEM_CACHED);
     if (trans2.output_buf == NULL) {
         rc = -ENOMEM;
         // goto free_output_buf;
         axidma_free(axidma_dev, trans2.output_buf, trans2.output_size);
     }
-    trans2.input_buf = axidma_malloc(axidma_dev, trans2.input_size);
+    trans2.input_buf = axidma_malloc(axidma_dev, trans2.input_size,
+            AXIDMA_MEM_WRITECOMBINE);
     if (trans2.input_buf == NULL) {
         fprintf(stderr, "Failed to allocate the input buffer.\n");
         rc = -ENOMEM;
         axidma_free(axidma_dev, trans2.input_buf, trans2.input_size);
     }
-    trans3.output_buf = axidma_malloc(axidma_dev, trans3.output_size);
+    trans3.output_buf = axidma_malloc(axidma_dev, trans3.output_size,
+            AXIDMA_MEM_CACHED);
     if (trans3.output_buf == NULL) {
         rc = -ENOMEM;
         // goto free_output_buf;
         axidma_free(axidma_dev, trans3.output_buf, trans3.output_size);
     }
-    trans3.input_buf = axidma_malloc(axidma_dev, trans3.input_size);
+    trans3.input_buf = axidma_malloc(axidma_dev, trans3.input_size,
+            AXIDMA_MEM_WRITECOMBINE);
     if (trans3.input_buf == NULL) {
         fprintf(stderr, "Failed to allocate the input buffer.\n");
         rc = -ENOMEM;
@@ -16,6 +16,7 @@
 #include <linux/stat.h>             // Module parameter permission values
 #include <linux/platform_device.h>  // Platform device definitions
 #include <linux/mod_devicetable.h>  // of_device_id
+#include <linux/version.h>          // Linux version macros
 
 // Local dependencies
 #include "axidma.h"                 // Internal definitions
@@ -24,14 +25,25 @@
  * Module Parameters
  *----------------------------------------------------------------------------*/
 
-// The name to use for the character device. This is "axidma" by default.
+/* The name to use for the character devices, which is followed by the index of
+ * each device. This is "axidma" by default. */
 static char *chrdev_name = CHRDEV_NAME;
 module_param(chrdev_name, charp, S_IRUGO);
 
-// The minor number to use for the character device. 0 by default.
+// The minor number to use for the first character device. 0 by default.
 static int minor_num = MINOR_NUMBER;
 module_param(minor_num, int, S_IRUGO);
 
+/* The number of transfers that can be outstanding on each channel at once.
+ * This is AXIDMA_DEFAULT_QUEUE_DEPTH by default. */
+static int queue_depth = AXIDMA_DEFAULT_QUEUE_DEPTH;
+module_param(queue_depth, int, S_IRUGO);
+
+/* How long a thread spins waiting for a synchronous transfer before sleeping,
+ * in nanoseconds. This is AXIDMA_DEFAULT_POLL_BUDGET by default. */
+static ulong poll_budget_ns = AXIDMA_DEFAULT_POLL_BUDGET;
+module_param(poll_budget_ns, ulong, S_IRUGO);
+
 /*----------------------------------------------------------------------------
  * Platform Device Functions
  *----------------------------------------------------------------------------*/
@@ -49,6 +61,8 @@ static int axidma_probe(struct platform_device *pdev)
         return -ENOMEM;
     }
     axidma_dev->pdev = pdev;
+    axidma_dev->queue_depth = queue_depth;
+    axidma_dev->poll_budget_ns = poll_budget_ns;
 
     // Initialize the DMA interface
     rc = axidma_dma_init(pdev, axidma_dev);
@@ -56,12 +70,7 @@ static int axidma_probe(struct platform_device *pdev)
         goto free_axidma_dev;
     }
 
-    // Assign the character device name, minor number, and number of devices
-    axidma_dev->chrdev_name = chrdev_name;
-    axidma_dev->minor_num = minor_num;
-    axidma_dev->num_devices = NUM_DEVICES;
-
-    // Initialize the character device for the module.
+    // Create the character device file for this instance of the DMA
     rc = axidma_chrdev_init(axidma_dev);
     if (rc < 0) {
         goto destroy_dma_dev;
@@ -76,10 +85,15 @@ destroy_dma_dev:
     axidma_dma_exit(axidma_dev);
 free_axidma_dev:
     kfree(axidma_dev);
-    return -ENOSYS;
+    return rc;
 }
 
+// From the 6.11 kernel, the platform driver's remove cannot fail
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6,11,0)
 static int axidma_remove(struct platform_device *pdev)
+#else
+static void axidma_remove(struct platform_device *pdev)
+#endif
 {
     struct axidma_device *axidma_dev;
     printk("%s:%s[%d] called\n", __FILE__, __func__, __LINE__);
@@ -96,7 +110,9 @@ static int axidma_remove(struct platform_device *pdev)
     // Free the device structure
     kfree(axidma_dev);
     printk("%s:%s[%d] end\n", __FILE__, __func__, __LINE__);
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6,11,0)
     return 0;
+#endif
 }
 
 static const struct of_device_id axidma_compatible_of_ids[] = {
@@ -120,14 +136,29 @@ static struct platform_driver axidma_driver = {
 
 static int __init axidma_init(void)
 {
+    int rc;
+
     printk("%s:%s[%d] called\n", __FILE__, __func__, __LINE__);
-    return platform_driver_register(&axidma_driver);
+
+    // Reserve the character device numbers for every device that is probed
+    rc = axidma_chrdev_register(chrdev_name, minor_num);
+    if (rc < 0) {
+        return rc;
+    }
+
+    rc = platform_driver_register(&axidma_driver);
+    if (rc < 0) {
+        axidma_chrdev_unregister();
+    }
+    return rc;
 }
 
 static void __exit axidma_exit(void)
 {
     printk("%s:%s[%d] called\n", __FILE__, __func__, __LINE__);
-    return platform_driver_unregister(&axidma_driver);
+    platform_driver_unregister(&axidma_driver);
+    axidma_chrdev_unregister();
+    return;
 }
 
 module_init(axidma_init);
@@ -20,6 +20,13 @@
 #include <linux/signal.h>           // Definition of signal numbers
 #include <linux/dmaengine.h>        // Definitions for DMA structures and types
 #include <linux/platform_device.h>  // Defintions for a platform device
+#include <linux/spinlock.h>         // Spinlock definitions
+#include <linux/wait.h>             // Wait queue definitions
+#include <linux/rbtree.h>           // Red-black tree definitions
+#include <linux/rwsem.h>            // Reader-writer semaphore definitions
+#include <linux/mutex.h>            // Mutex definitions
+#include <linux/idr.h>              // ID allocation definitions
+#include <linux/atomic.h>           // Atomic counter definitions
 
 // Local dependencies
 #include "axidma_ioctl.h"           // IOCTL argument structures
@@ -42,17 +49,29 @@
     printk(KERN_INFO MODULE_NAME ": %s: %s: %d: " fmt, __FILENAME__, __func__, \
             __LINE__, ## __VA_ARGS__)
 
-// Forward declaration of the callback data structure for DMA
-struct axidma_cb_data;
-
-// All of the meta-data needed for an axidma device
+// The default number of transfers that can be outstanding on each channel
+#define AXIDMA_DEFAULT_QUEUE_DEPTH  16
+// By default, threads never spin waiting for synchronous transfers
+#define AXIDMA_DEFAULT_POLL_BUDGET  0
+// By default, every transfer raises its own interrupt
+#define AXIDMA_DEFAULT_IRQ_THRESHOLD    1
+// The default for the longest a transfer is held back to share an interrupt
+#define AXIDMA_DEFAULT_IRQ_DELAY_US     100
+// The default timeout for synchronous transfers, 20 seconds
+#define AXIDMA_DEFAULT_TIMEOUT_MS       20000
+
+// Forward declaration of the per-channel transfer queue
+struct axidma_queue;
+// Forward declaration of the reserved memory pool for DMA buffers
+struct axidma_pool;
+
+/* All of the meta-data needed for an axidma device. The channels are fixed
+ * once the device is probed, so they are read without locking. The state for
+ * each channel lives in its transfer queue, under the queue's own locks. */
 struct axidma_device {
-    int num_devices;                // The number of devices
-    unsigned int minor_num;         // The minor number of the device
+    int index;                      // The instance number of the device
     dev_t dev_num;                  // The device number of the device
-    char *chrdev_name;              // The name of the character device
     struct device *device;          // Device structure for the char device
-    struct class *dev_class;        // The device class for the chardevice
     struct cdev chrdev;             // The character device structure
 
     int num_dma_tx_chans;           // The number of transmit DMA channels
@@ -60,12 +79,39 @@ struct axidma_device {
     int num_vdma_tx_chans;          // The number of transmit VDMA channels
     int num_vdma_rx_chans;          // The number of receive  VDMA channels
     int num_chans;                  // The total number of DMA channels
-    int notify_signal;              // Signal used to notify transfer completion
     struct platform_device *pdev;   // The platofrm device from the device tree
-    struct axidma_cb_data *cb_data; // The callback data for each channel
+    int queue_depth;                // Outstanding transfers per channel
+    u64 poll_budget_ns;             // Initial spin budget for each channel
+    struct axidma_queue *queues;    // The transfer queue for each channel
+    struct mutex forward_lock;      // Serializes starting and stopping forwards
+    wait_queue_head_t notify_wait;  // Woken when a file's last report is done
     struct axidma_chan *channels;   // All available channels
-    struct list_head dmabuf_list;   // List of allocated DMA buffers
-    struct list_head external_dmabufs;  // Buffers allocated in other drivers
+    struct axidma_channel_config *chan_configs; // Tunables for each channel
+    struct kobject **chan_kobjs;    // The sysfs directory for each channel
+    struct dentry *debugfs_dir;     // The debugfs directory for the device
+    struct axidma_pool *pool;       // Reserved memory for buffers, or NULL
+};
+
+/* The state of one open file of the device. Each file owns the buffers that
+ * it maps, pins or registers, its prepared transfers and its completion
+ * notifications, so that processes sharing the device never see each other's
+ * memory. The buffer tree is read-mostly, so transfers on different channels
+ * only share the completion ring. */
+struct axidma_context {
+    struct axidma_device *dev;      // The device the file was opened on
+    int notify_signal;              // Signal used to notify transfer completion
+    struct rw_semaphore buffers_lock;   // Protects the buffer tree
+    struct rb_root buffers;         // All DMA buffers, by user address
+    unsigned long buffers_gen;      // Incremented when a buffer is removed
+    spinlock_t prepared_lock;       // Protects the prepared transfer table
+    struct idr prepared;            // Prepared transfers, by their id
+
+    spinlock_t notify_lock;         // Protects the completion ring
+    wait_queue_head_t completion_wait;  // Woken when a completion is posted
+    struct axidma_completion_ring *ring;    // Completion ring, if mapped
+    u32 ring_entries;               // The number of entries in the ring
+    u32 ring_head;                  // The driver's copy of the producer index
+    atomic_t notifying;             // Asynchronous transfers not yet reported
 };
 
 /*----------------------------------------------------------------------------
@@ -74,12 +120,14 @@ struct axidma_device {
 
 // Default name of the character of the device
 #define CHRDEV_NAME                 AXIDMA_DEV_NAME
-// Default minor number for the device
+// Default minor number for the first device
 #define MINOR_NUMBER                0
-// The default number of character devices for DMA
-#define NUM_DEVICES                 1
+// The most AXI DMA devices that can be probed at once
+#define MAX_DEVICES                 8
 
 // Function prototypes
+int axidma_chrdev_register(const char *name, unsigned int minor_num);
+void axidma_chrdev_unregister(void);
 int axidma_chrdev_init(struct axidma_device *dev);
 void axidma_chrdev_exit(struct axidma_device *dev);
 
@@ -98,19 +146,70 @@ void axidma_get_num_channels(struct axidma_device *dev,
                              struct axidma_num_channels *num_chans);
 void axidma_get_channel_info(struct axidma_device *dev,
                              struct axidma_channel_info *chan_info);
-int axidma_set_signal(struct axidma_device *dev, int signal);
-int axidma_read_transfer(struct axidma_device *dev,
+int axidma_set_signal(struct axidma_context *ctx, int signal);
+int axidma_set_eventfd(struct axidma_context *ctx,
+                       struct axidma_channel_eventfd *chan_eventfd);
+void axidma_clear_eventfds(struct axidma_device *dev,
+                           struct axidma_context *ctx);
+bool axidma_completions_pending(struct axidma_context *ctx);
+int axidma_read_transfer(struct axidma_context *ctx,
                           struct axidma_transaction *trans);
-int axidma_write_transfer(struct axidma_device *dev,
+int axidma_write_transfer(struct axidma_context *ctx,
                           struct axidma_transaction *trans);
-int axidma_rw_transfer(struct axidma_device *dev,
+int axidma_rw_transfer(struct axidma_context *ctx,
                        struct axidma_inout_transaction *trans);
-int axidma_video_transfer(struct axidma_device *dev,
+int axidma_batch_transfer(struct axidma_context *ctx,
+                          struct axidma_transaction *trans, int num_trans);
+int axidma_submit_transfer(struct axidma_context *ctx,
+                           struct axidma_submit *submit);
+int axidma_wait_handle(struct axidma_context *ctx, struct axidma_wait *wait);
+int axidma_poll_handle(struct axidma_context *ctx,
+                       struct axidma_handle *handle);
+int axidma_cancel_handle(struct axidma_context *ctx,
+                         struct axidma_handle *handle);
+void axidma_release_handles(struct axidma_context *ctx);
+void axidma_release_transfers(struct axidma_context *ctx);
+int axidma_video_transfer(struct axidma_context *ctx,
                           struct axidma_video_transaction *trans,
                           enum axidma_dir dir);
-int axidma_stop_channel(struct axidma_device *dev, struct axidma_chan *chan);
-dma_addr_t axidma_uservirt_to_dma(struct axidma_device *dev, void *user_addr,
+int axidma_stop_channel(struct axidma_context *ctx, struct axidma_chan *chan);
+int axidma_claim_channel(struct axidma_context *ctx, int channel_id);
+int axidma_release_channel(struct axidma_context *ctx, int channel_id);
+void axidma_release_claims(struct axidma_context *ctx);
+int axidma_set_channel_config(struct axidma_device *dev,
+                              struct axidma_context *ctx,
+                              struct axidma_channel_config *config);
+int axidma_get_channel_config(struct axidma_device *dev,
+                              struct axidma_channel_config *config);
+int axidma_get_stats(struct axidma_device *dev,
+                     struct axidma_channel_stats *stats);
+int axidma_set_poll_budget(struct axidma_context *ctx,
+                           struct axidma_busy_poll *poll);
+int axidma_get_poll_stats(struct axidma_device *dev,
+                          struct axidma_busy_poll *poll);
+int axidma_prepare_transfer(struct axidma_context *ctx,
+                            struct axidma_prepare *prepare);
+int axidma_start_prepared(struct axidma_context *ctx, int id);
+int axidma_unprepare_transfer(struct axidma_context *ctx, int id);
+void axidma_release_prepared(struct axidma_context *ctx);
+int axidma_start_rx_ring(struct axidma_context *ctx,
+                         struct axidma_rx_ring_config *config,
+                         struct axidma_rx_ring *ring, u32 num_slots);
+int axidma_kick_rx_ring(struct axidma_context *ctx, int channel_id);
+void axidma_stop_rx_rings(struct axidma_device *dev,
+                          struct axidma_rx_ring *ring);
+void axidma_stop_rx_ring_slots(struct axidma_context *ctx, void *user_addr,
+                               size_t size);
+int axidma_start_forward(struct axidma_context *ctx,
+                         struct axidma_forward_config *config);
+void axidma_stop_forwards(struct axidma_context *ctx, void *user_addr,
+                          size_t size);
+void axidma_stop_transfers(struct axidma_context *ctx, void *user_addr,
+                           size_t size);
+dma_addr_t axidma_uservirt_to_dma(struct axidma_context *ctx, void *user_addr,
                                   size_t size);
+int axidma_uservirt_to_sg(struct axidma_context *ctx, void *user_addr,
+        size_t size, struct scatterlist *sg_list, int max_ents);
 
 /*----------------------------------------------------------------------------
  * Device Tree Definitions
@@ -120,9 +219,18 @@ dma_addr_t axidma_uservirt_to_dma(struct axidma_device *dev, void *user_addr,
 #define axidma_node_err(node, fmt, ...) \
     axidma_err("Device tree node %s: " fmt, node->name, ##__VA_ARGS__)
 
+// The number of channels of an MCDMA engine, half of them in each direction
+#define AXIDMA_MCDMA_MAX_CHANS      32
+
 // Function Prototypes
 int axidma_of_num_channels(struct platform_device *pdev);
 int axidma_of_parse_dma_nodes(struct platform_device *pdev,
                               struct axidma_device *dev);
+int axidma_of_parse_memory_region(struct platform_device *pdev,
+                                  struct resource *res);
+int axidma_of_parse_ready_irq(struct platform_device *pdev,
+                              struct axidma_chan *chan);
+int axidma_of_parse_ready_ack(struct platform_device *pdev,
+                              struct axidma_chan *chan, struct resource *res);
 
 #endif /* AXIDMA_H_ */
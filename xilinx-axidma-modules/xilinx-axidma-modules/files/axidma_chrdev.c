@@ -20,11 +20,28 @@
 #include <linux/mm.h>           // Memory types and remapping functions
 #include <linux/uaccess.h>      // Userspace memory access functions
 #include <linux/slab.h>         // Kernel allocation functions
+#include <linux/vmalloc.h>      // Virtually contiguous allocation functions
 #include <linux/errno.h>        // Linux error codes
 #include <linux/of_device.h>    // Device tree device related functions
+#include <linux/poll.h>         // Poll table definitions and functions
+#include <linux/gfp.h>          // Page allocation functions
+#include <linux/dma-mapping.h>  // DMA allocation and streaming functions
+#include <linux/version.h>      // Linux version macros
+#include <linux/rbtree.h>       // Red-black tree definitions and functions
+#include <linux/rwsem.h>        // Reader-writer semaphore functions
+#include <linux/kobject.h>      // Kernel object and sysfs attribute functions
+#include <linux/sysfs.h>        // Sysfs attribute group functions
+#include <linux/kernel.h>       // String to integer conversion functions
+#include <linux/debugfs.h>      // Debug filesystem functions
+#include <linux/seq_file.h>     // Sequential file output functions
+#include <linux/idr.h>          // Index allocation functions
 
 #include <linux/dma-buf.h>      // DMA shared buffers interface
 #include <linux/scatterlist.h>  // Scatter-gather table definitions
+#include <linux/kref.h>         // Reference counting functions
+#include <linux/mutex.h>        // Mutual exclusion lock functions
+#include <linux/genalloc.h>     // General purpose memory pool allocator
+#include <linux/io.h>           // Memory remapping functions
 
 // Local dependencies
 #include "axidma.h"             // Local definitions
@@ -34,28 +51,87 @@
  * Internal Definitions
  *----------------------------------------------------------------------------*/
 
-// TODO: Maybe this can be improved?
-static struct axidma_device *axidma_dev;
+/* The character device region and class are shared by every AXI DMA device
+ * that is probed. Each device takes the next free index, which is its minor
+ * number relative to the first one, and the number in its name. */
+static struct class *axidma_class;
+static dev_t axidma_dev_base;
+static const char *axidma_chrdev_name;
+static DEFINE_IDA(axidma_ida);
+
+// The kinds of memory that userspace can use for DMA transfers
+enum axidma_buffer_type {
+    AXIDMA_BUFFER_DMA,          // A buffer allocated by this driver
+    AXIDMA_BUFFER_EXTERNAL,     // A buffer allocated by another driver
+    AXIDMA_BUFFER_PINNED,       // Ordinary user memory, pinned for DMA
+};
+
+/* The part common to all buffers that userspace can use for transfers. Every
+ * buffer is kept in the device's tree, ordered by its user virtual address,
+ * and buffers in the tree never overlap. */
+struct axidma_buffer {
+    enum axidma_buffer_type type;   // The kind of buffer this is part of
+    void *user_addr;                // User virtual address of the buffer
+    size_t size;                    // Size of the buffer
+    struct rb_node node;            // Node in the device's buffer tree
+};
 
-// A structure that represents a DMA buffer allocation
+/* A structure that represents a DMA buffer allocation. The memory is freed
+ * once the buffer is unmapped and every dma-buf exported for it is released,
+ * so it can outlive the mapping of the process that allocated it. */
 struct axidma_dma_allocation {
-    size_t size;                // Size of the buffer
-    void *user_addr;            // User virtual address of the buffer
+    struct axidma_buffer buf;   // User address range, and tree node
+    int mem_type;               // The mmap page offset it was allocated with
     void *kern_addr;            // Kernel virtual address of the buffer
     dma_addr_t dma_addr;        // DMA bus address of the buffer
-    struct list_head list;      // List node pointers for allocation list
+    struct device *dma_dev;     // The device the memory was allocated for
+    struct axidma_pool *pool;   // The reserved memory it came from, or NULL
+    struct kref ref;            // Held by the mapping and each exported dma-buf
 };
 
 /* A structure that represents a DMA buffer allocation imported from another
- * driver in the kernel, through the DMA buffer sharing interface. */
+ * driver in the kernel, through the DMA buffer sharing interface. The buffer
+ * may be scattered in memory, and is only mapped once it is used. */
 struct axidma_external_allocation {
+    struct axidma_buffer buf;               // User address range, and tree node
     int fd;                                 // File descritpor for buffer share
     struct dma_buf *dma_buf;                // Structure representing the buffer
     struct dma_buf_attachment *dma_attach;  // Structre represnting attachment
-    size_t size;                            // Total size of the buffer
-    void *user_addr;                        // Buffer's user virtual address
-    struct sg_table *sg_table;              // DMA scatter-gather table
-    struct list_head list;                  // Node pointers for the list
+    struct mutex map_lock;                  // Serializes mapping on first use
+    struct sg_table *sg_table;              // DMA scatter-gather table, or NULL
+};
+
+/* A structure that represents ordinary user memory that has been pinned, and
+ * mapped for DMA as a scatter-gather table. */
+struct axidma_pinned_allocation {
+    struct axidma_buffer buf;               // User address range, and tree node
+    int num_pages;                          // The number of pages pinned
+    struct page **pages;                    // The pinned pages
+    struct sg_table sg_table;               // DMA scatter-gather table
+    int sg_nents;                           // Number of DMA mapped entries
+};
+
+/* A region of reserved memory from the device tree, which uncached and
+ * write-combined buffers are carved out of instead of the DMA allocator. The
+ * region is mapped for the device once, so a buffer is just an offset in it. */
+struct axidma_pool {
+    struct kref ref;                // Held by the device and each buffer
+    struct gen_pool *gen_pool;      // Allocator for the pages of the region
+    struct device *dma_dev;         // The device the region is mapped for
+    phys_addr_t phys_addr;          // Physical address of the region
+    dma_addr_t dma_addr;            // DMA bus address of the region
+    void *kern_addr;                // Kernel virtual address of the region
+    size_t size;                    // The size of the region
+};
+
+/* A ring shared with userspace through mmap. Splitting or moving the mapping
+ * opens a VMA for each new piece, and every piece is closed on its own, so the
+ * ring is only released once the last piece of it is unmapped. */
+struct axidma_ring_map {
+    struct kref ref;                // Held by each VMA that maps part of it
+    struct axidma_context *ctx;     // The file that mapped the ring
+    void *ring;                     // The ring, allocated with vmalloc_user
+    size_t size;                    // The size of the ring's allocation
 };
 
 /*----------------------------------------------------------------------------
@@ -69,47 +145,400 @@ static bool valid_dma_request(void *dma_start, size_t dma_size, void *user_addr,
            (char *)user_addr + user_size <= (char *)dma_start + dma_size;
 }
 
-/* Converts the given user space virtual address to a DMA address. If the
- * conversion is unsuccessful, then (dma_addr_t)NULL is returned. */
-dma_addr_t axidma_uservirt_to_dma(struct axidma_device *dev, void *user_addr,
-                                  size_t size)
+/* Adds a buffer to the device's tree of buffers. The buffer's user address
+ * range cannot overlap with any buffer already in the tree. The buffer lock
+ * must be held for writing. */
+static int axidma_insert_buffer(struct axidma_context *ctx,
+                                struct axidma_buffer *buf)
 {
-    bool valid;
-    dma_addr_t offset;
-    struct list_head *iter;
-    struct axidma_dma_allocation *dma_alloc;
-    struct axidma_external_allocation *dma_ext_alloc;
+    struct rb_node **link, *parent;
+    struct axidma_buffer *cur;
 
-    // First iterate over DMA buffers allocated by this driver
-    list_for_each(iter, &dev->dmabuf_list)
+    parent = NULL;
+    link = &ctx->buffers.rb_node;
+    while (*link != NULL)
     {
-        dma_alloc = container_of(iter, struct axidma_dma_allocation, list);
-        valid = valid_dma_request(dma_alloc->user_addr, dma_alloc->size,
-                                  user_addr, size);
-        if (valid) {
-            offset = (dma_addr_t)(user_addr - dma_alloc->user_addr);
-            return dma_alloc->dma_addr + offset;
+        parent = *link;
+        cur = rb_entry(parent, struct axidma_buffer, node);
+        if ((char *)buf->user_addr + buf->size <= (char *)cur->user_addr) {
+            link = &parent->rb_left;
+        } else if ((char *)buf->user_addr >=
+                   (char *)cur->user_addr + cur->size) {
+            link = &parent->rb_right;
+        } else {
+            axidma_err("Buffer at %p of size %zu overlaps with the buffer at "
+                       "%p.\n", buf->user_addr, buf->size, cur->user_addr);
+            return -EEXIST;
         }
     }
 
-    // Otherwise, iterate over the DMA buffers allocated by other drivers
-    list_for_each(iter, &dev->external_dmabufs)
+    rb_link_node(&buf->node, parent, link);
+    rb_insert_color(&buf->node, &ctx->buffers);
+    return 0;
+}
+
+/* Removes a buffer from the tree, and lets prepared transfers know that their
+ * buffer may be gone. The buffer lock must be held for writing. */
+static void axidma_remove_buffer(struct axidma_context *ctx,
+                                 struct axidma_buffer *buf)
+{
+    rb_erase(&buf->node, &ctx->buffers);
+    WRITE_ONCE(ctx->buffers_gen, ctx->buffers_gen + 1);
+    return;
+}
+
+/* Stops the receive rings, forwarding and transfers of the file that use the
+ * buffer, so that the engine is done with its memory before it is released.
+ * The buffer lock must be held for writing. */
+static void axidma_quiesce_buffer(struct axidma_context *ctx,
+                                  struct axidma_buffer *buf)
+{
+    axidma_stop_rx_ring_slots(ctx, buf->user_addr, buf->size);
+    axidma_stop_forwards(ctx, buf->user_addr, buf->size);
+    axidma_stop_transfers(ctx, buf->user_addr, buf->size);
+    return;
+}
+
+/* Finds the buffer that holds the given user range, if any. Since buffers
+ * never overlap, only the buffer with the greatest start address at or below
+ * the range's start can hold it. The buffer lock must be held. */
+static struct axidma_buffer *axidma_find_buffer(struct axidma_context *ctx,
+        void *user_addr, size_t size)
+{
+    struct rb_node *node;
+    struct axidma_buffer *buf, *found;
+
+    found = NULL;
+    node = ctx->buffers.rb_node;
+    while (node != NULL)
     {
-        dma_ext_alloc = container_of(iter, struct axidma_external_allocation,
-                                     list);
-        valid = valid_dma_request(dma_ext_alloc->user_addr, dma_ext_alloc->size,
-                                  user_addr, size);
-        if (valid) {
-            offset = (dma_addr_t)(user_addr - dma_ext_alloc->user_addr);
-            return sg_dma_address(&dma_ext_alloc->sg_table->sgl[0]) + offset;
+        buf = rb_entry(node, struct axidma_buffer, node);
+        if (user_addr < buf->user_addr) {
+            node = node->rb_left;
+        } else {
+            found = buf;
+            node = node->rb_right;
+        }
+    }
+
+    if (found == NULL || !valid_dma_request(found->user_addr, found->size,
+                                            user_addr, size)) {
+        return NULL;
+    }
+    return found;
+}
+
+/* Maps an external buffer for the device, the first time that it is used for
+ * a transfer. The mapping is kept until the buffer is unregistered. */
+static int axidma_map_external(struct axidma_external_allocation *dma_alloc)
+{
+    int rc;
+    struct sg_table *sg_table;
+
+    rc = 0;
+    mutex_lock(&dma_alloc->map_lock);
+    if (dma_alloc->sg_table != NULL) {
+        goto unlock;
+    }
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6,2,0)
+    sg_table = dma_buf_map_attachment(dma_alloc->dma_attach,
+                                      DMA_BIDIRECTIONAL);
+#else
+    sg_table = dma_buf_map_attachment_unlocked(dma_alloc->dma_attach,
+                                               DMA_BIDIRECTIONAL);
+#endif
+    if (IS_ERR(sg_table)) {
+        axidma_err("Unable to map external DMA buffer for usage.\n");
+        rc = PTR_ERR(sg_table);
+        goto unlock;
+    }
+    dma_alloc->sg_table = sg_table;
+
+unlock:
+    mutex_unlock(&dma_alloc->map_lock);
+    return rc;
+}
+
+/* Gets the DMA mapped scatter-gather list of a buffer that is not contiguous,
+ * which is either pinned memory or an external buffer. */
+static int axidma_buffer_sg(struct axidma_buffer *buf,
+                            struct scatterlist **sgl, int *nents)
+{
+    int rc;
+    struct axidma_pinned_allocation *pin_alloc;
+    struct axidma_external_allocation *dma_ext_alloc;
+
+    if (buf->type == AXIDMA_BUFFER_PINNED) {
+        pin_alloc = container_of(buf, struct axidma_pinned_allocation, buf);
+        *sgl = pin_alloc->sg_table.sgl;
+        *nents = pin_alloc->sg_nents;
+        return 0;
+    }
+
+    dma_ext_alloc = container_of(buf, struct axidma_external_allocation, buf);
+    rc = axidma_map_external(dma_ext_alloc);
+    if (rc < 0) {
+        return rc;
+    }
+    *sgl = dma_ext_alloc->sg_table->sgl;
+    *nents = dma_ext_alloc->sg_table->nents;
+    return 0;
+}
+
+/* Takes the part of each mapped chunk of a buffer that overlaps the range
+ * [start, start + size), writing at most `max_ents` entries. Returns the
+ * number of entries needed. */
+static int axidma_range_to_sg(struct scatterlist *sgl, int nents, size_t start,
+        size_t size, struct scatterlist *sg_list, int max_ents)
+{
+    int i, num_ents;
+    size_t end, ent_start, ent_end;
+    struct scatterlist *sg;
+
+    num_ents = 0;
+    end = start + size;
+    ent_start = 0;
+    for_each_sg(sgl, sg, nents, i)
+    {
+        ent_end = ent_start + sg_dma_len(sg);
+        if (ent_end > start && ent_start < end) {
+            if (num_ents < max_ents) {
+                sg_dma_address(&sg_list[num_ents]) = sg_dma_address(sg) +
+                        (max(start, ent_start) - ent_start);
+                sg_dma_len(&sg_list[num_ents]) = min(end, ent_end) -
+                        max(start, ent_start);
+            }
+            num_ents += 1;
+        }
+        ent_start = ent_end;
+    }
+
+    return num_ents;
+}
+
+/* Converts a user range in a buffer to its DMA address. Pinned memory and
+ * external buffers may be scattered, so (dma_addr_t)NULL is returned for them
+ * unless the range falls within one contiguous chunk. */
+static dma_addr_t axidma_buffer_to_dma(struct axidma_buffer *buf,
+                                       void *user_addr, size_t size)
+{
+    int nents;
+    size_t offset;
+    struct scatterlist *sgl, sg_ent;
+    struct axidma_dma_allocation *dma_alloc;
+
+    offset = (char *)user_addr - (char *)buf->user_addr;
+    if (buf->type == AXIDMA_BUFFER_DMA) {
+        dma_alloc = container_of(buf, struct axidma_dma_allocation, buf);
+        return dma_alloc->dma_addr + offset;
+    }
+
+    if (axidma_buffer_sg(buf, &sgl, &nents) < 0 ||
+            axidma_range_to_sg(sgl, nents, offset, size, &sg_ent, 1) != 1) {
+        return (dma_addr_t)NULL;
+    }
+    return sg_dma_address(&sg_ent);
+}
+
+/* Converts the given user space virtual address to a DMA address. If the
+ * conversion is unsuccessful, then (dma_addr_t)NULL is returned. The buffer
+ * lock must be held for reading, and kept until the transfer is submitted. */
+dma_addr_t axidma_uservirt_to_dma(struct axidma_context *ctx, void *user_addr,
+                                  size_t size)
+{
+    struct axidma_buffer *buf;
+
+    buf = axidma_find_buffer(ctx, user_addr, size);
+    return (buf != NULL) ? axidma_buffer_to_dma(buf, user_addr, size) :
+                           (dma_addr_t)NULL;
+}
+
+/* Fills in a scatter-gather list with the DMA addresses for the given user
+ * range, writing at most `max_ents` entries. Buffers from the driver need one
+ * entry, while pinned memory and external buffers need one for each
+ * physically contiguous chunk. Returns the number of entries needed, which
+ * can be more than `max_ents`, or a negative error code if the range is not
+ * known or cannot be mapped. The buffer lock must be held for reading, and
+ * kept until the transfer is submitted. */
+int axidma_uservirt_to_sg(struct axidma_context *ctx, void *user_addr,
+        size_t size, struct scatterlist *sg_list, int max_ents)
+{
+    int nents, num_ents;
+    struct scatterlist *sgl;
+    struct axidma_buffer *buf;
+
+    buf = axidma_find_buffer(ctx, user_addr, size);
+    if (buf == NULL) {
+        axidma_err("Requested transfer address %p does not fall within a "
+                   "previously allocated or pinned buffer.\n", user_addr);
+        return -EFAULT;
+    }
+
+    // Contiguous buffers map to a single entry
+    if (buf->type == AXIDMA_BUFFER_DMA) {
+        if (max_ents >= 1) {
+            sg_dma_address(&sg_list[0]) = axidma_buffer_to_dma(buf, user_addr,
+                                                               size);
+            sg_dma_len(&sg_list[0]) = size;
         }
+        return 1;
     }
 
-    // No matching allocation was found
-    return (dma_addr_t)NULL;
+    num_ents = axidma_buffer_sg(buf, &sgl, &nents);
+    if (num_ents < 0) {
+        return num_ents;
+    }
+    return axidma_range_to_sg(sgl, nents,
+            (char *)user_addr - (char *)buf->user_addr, size, sg_list,
+            max_ents);
 }
 
-static int axidma_get_external(struct axidma_device *dev,
+static void axidma_release_pages(struct page **pages, int num_pages)
+{
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5,8,0)
+    int i;
+
+    // The device may have written to any of the pages
+    for (i = 0; i < num_pages; i++)
+    {
+        set_page_dirty_lock(pages[i]);
+        put_page(pages[i]);
+    }
+#else
+    unpin_user_pages_dirty_lock(pages, num_pages, true);
+#endif
+    return;
+}
+
+static int axidma_pin_user(struct axidma_context *ctx,
+                           struct axidma_pin_buffer *pin_buf)
+{
+    int rc, num_pinned;
+    unsigned long start, offset;
+    struct axidma_pinned_allocation *pin_alloc;
+
+    if (pin_buf->size == 0) {
+        axidma_err("Unable to pin an empty memory region.\n");
+        return -EINVAL;
+    }
+
+    // Allocate a structure to store information about the pinned memory
+    pin_alloc = kzalloc(sizeof(*pin_alloc), GFP_KERNEL);
+    if (pin_alloc == NULL) {
+        axidma_err("Unable to allocate pinned memory structure.\n");
+        return -ENOMEM;
+    }
+    pin_alloc->buf.type = AXIDMA_BUFFER_PINNED;
+    pin_alloc->buf.user_addr = pin_buf->user_addr;
+    pin_alloc->buf.size = pin_buf->size;
+
+    // Determine the pages that the region spans
+    start = (unsigned long)pin_buf->user_addr;
+    offset = offset_in_page(start);
+    pin_alloc->num_pages = DIV_ROUND_UP(offset + pin_buf->size, PAGE_SIZE);
+    pin_alloc->pages = kcalloc(pin_alloc->num_pages,
+            sizeof(pin_alloc->pages[0]), GFP_KERNEL);
+    if (pin_alloc->pages == NULL) {
+        axidma_err("Unable to allocate the page array for pinned memory.\n");
+        rc = -ENOMEM;
+        goto free_pin_alloc;
+    }
+
+    // Pin the pages for writing, since the device may receive into them
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5,2,0)
+    num_pinned = get_user_pages_fast(start & PAGE_MASK, pin_alloc->num_pages,
+                                     1, pin_alloc->pages);
+#elif LINUX_VERSION_CODE < KERNEL_VERSION(5,8,0)
+    num_pinned = get_user_pages_fast(start & PAGE_MASK, pin_alloc->num_pages,
+            FOLL_WRITE | FOLL_LONGTERM, pin_alloc->pages);
+#else
+    num_pinned = pin_user_pages_fast(start & PAGE_MASK, pin_alloc->num_pages,
+            FOLL_WRITE | FOLL_LONGTERM, pin_alloc->pages);
+#endif
+    if (num_pinned != pin_alloc->num_pages) {
+        axidma_err("Unable to pin user memory at %p of size %zu.\n",
+                   pin_buf->user_addr, pin_buf->size);
+        rc = (num_pinned < 0) ? num_pinned : -EFAULT;
+        num_pinned = max(num_pinned, 0);
+        goto release_pages;
+    }
+
+    // Build a scatter-gather table for the pages, and map it for DMA
+    rc = sg_alloc_table_from_pages(&pin_alloc->sg_table, pin_alloc->pages,
+            pin_alloc->num_pages, offset, pin_buf->size, GFP_KERNEL);
+    if (rc < 0) {
+        axidma_err("Unable to build scatter-gather table for pinned memory.\n");
+        goto release_pages;
+    }
+    pin_alloc->sg_nents = dma_map_sg(&ctx->dev->pdev->dev,
+            pin_alloc->sg_table.sgl, pin_alloc->sg_table.orig_nents,
+            DMA_BIDIRECTIONAL);
+    if (pin_alloc->sg_nents == 0) {
+        axidma_err("Unable to map pinned memory for DMA.\n");
+        rc = -ENOMEM;
+        goto free_sg_table;
+    }
+
+    // Add the region to the driver's tree of buffers
+    down_write(&ctx->buffers_lock);
+    rc = axidma_insert_buffer(ctx, &pin_alloc->buf);
+    up_write(&ctx->buffers_lock);
+    if (rc < 0) {
+        goto unmap_sg_table;
+    }
+    return 0;
+
+unmap_sg_table:
+    dma_unmap_sg(&ctx->dev->pdev->dev, pin_alloc->sg_table.sgl,
+                 pin_alloc->sg_table.orig_nents, DMA_BIDIRECTIONAL);
+free_sg_table:
+    sg_free_table(&pin_alloc->sg_table);
+release_pages:
+    axidma_release_pages(pin_alloc->pages, num_pinned);
+    kfree(pin_alloc->pages);
+free_pin_alloc:
+    kfree(pin_alloc);
+    return rc;
+}
+
+// Frees pinned memory. The buffer lock must be held for writing.
+static void axidma_free_pinned(struct axidma_context *ctx,
+                               struct axidma_pinned_allocation *pin_alloc)
+{
+    // Unmap the memory, and release the pages back to the process
+    dma_unmap_sg(&ctx->dev->pdev->dev, pin_alloc->sg_table.sgl,
+                 pin_alloc->sg_table.orig_nents, DMA_BIDIRECTIONAL);
+    sg_free_table(&pin_alloc->sg_table);
+    axidma_release_pages(pin_alloc->pages, pin_alloc->num_pages);
+    kfree(pin_alloc->pages);
+
+    axidma_remove_buffer(ctx, &pin_alloc->buf);
+    kfree(pin_alloc);
+    return;
+}
+
+static int axidma_unpin_user(struct axidma_context *ctx, void *user_addr)
+{
+    struct axidma_buffer *buf;
+
+    down_write(&ctx->buffers_lock);
+    buf = axidma_find_buffer(ctx, user_addr, 0);
+    if (buf != NULL && buf->type == AXIDMA_BUFFER_PINNED &&
+            buf->user_addr == user_addr) {
+        axidma_quiesce_buffer(ctx, buf);
+        axidma_free_pinned(ctx, container_of(buf,
+                struct axidma_pinned_allocation, buf));
+        up_write(&ctx->buffers_lock);
+        return 0;
+    }
+    up_write(&ctx->buffers_lock);
+
+    axidma_err("No pinned memory at address %p.\n", user_addr);
+    return -ENOENT;
+}
+
+static int axidma_get_external(struct axidma_context *ctx,
                                struct axidma_register_buffer *ext_buf)
 {
     int rc;
@@ -131,41 +560,38 @@ static int axidma_get_external(struct axidma_device *dev,
         goto free_ext_alloc;
     }
 
-    // Attach ourselves to the DMA buffer, indicating usage
-    dma_alloc->dma_attach = dma_buf_attach(dma_alloc->dma_buf, dev->device);
+    // The registered range cannot extend past the end of the buffer
+    if (ext_buf->size == 0 || ext_buf->size > dma_alloc->dma_buf->size) {
+        axidma_err("Size %zu is not within the external DMA buffer of size "
+                   "%zu.\n", ext_buf->size, dma_alloc->dma_buf->size);
+        rc = -EINVAL;
+        goto put_ext_dma;
+    }
+
+    /* Attach ourselves to the DMA buffer, indicating usage. It is mapped for
+     * the device when it is first used for a transfer. */
+    dma_alloc->dma_attach = dma_buf_attach(dma_alloc->dma_buf,
+                                           ctx->dev->device);
     if (IS_ERR(dma_alloc->dma_attach)) {
         axidma_err("Unable to attach to the external DMA buffer.\n");
         rc = PTR_ERR(dma_alloc->dma_attach);
         goto put_ext_dma;
     }
-
-    // TODO: Maybe this should only be done on-demand
-    // Map the DMA buffer for the life of our attachment
-    dma_alloc->sg_table = dma_buf_map_attachment(dma_alloc->dma_attach,
-                                                 DMA_BIDIRECTIONAL);
-    if (IS_ERR(dma_alloc->sg_table)) {
-        axidma_err("Unable to map external DMA buffer for usage.\n");
-        rc = PTR_ERR(dma_alloc->sg_table);
+    mutex_init(&dma_alloc->map_lock);
+    dma_alloc->sg_table = NULL;
+
+    // Add ourselves the driver's tree of buffers
+    dma_alloc->buf.type = AXIDMA_BUFFER_EXTERNAL;
+    dma_alloc->buf.size = ext_buf->size;
+    dma_alloc->buf.user_addr = ext_buf->user_addr;
+    down_write(&ctx->buffers_lock);
+    rc = axidma_insert_buffer(ctx, &dma_alloc->buf);
+    up_write(&ctx->buffers_lock);
+    if (rc < 0) {
         goto detach_ext_dma;
     }
-
-    // The allocation is expected to be one contiguous memory region
-    if (dma_alloc->sg_table->nents != 1) {
-        axidma_err("External DMA allocations must a single contiguous region "
-                   "of physical memory.\n");
-        rc = -EINVAL;
-        goto unmap_ext_dma;
-    }
-
-    // Add ourselves the driver's list of external allocations
-    dma_alloc->size = ext_buf->size;
-    dma_alloc->user_addr = ext_buf->user_addr;
-    list_add(&dma_alloc->list, &dev->external_dmabufs);
     return 0;
 
-unmap_ext_dma:
-    dma_buf_unmap_attachment(dma_alloc->dma_attach, dma_alloc->sg_table,
-                             DMA_BIDIRECTIONAL);
 detach_ext_dma:
     dma_buf_detach(dma_alloc->dma_buf, dma_alloc->dma_attach);
 put_ext_dma:
@@ -175,48 +601,511 @@ free_ext_alloc:
     return rc;
 }
 
-static int axidma_put_external(struct axidma_device *dev, void *user_addr)
+// Unmaps an external buffer that was removed from the tree, and detaches it
+static void axidma_free_external(struct axidma_external_allocation *dma_alloc)
 {
-    void *end_user_addr;
-    struct list_head *iter;
-    struct axidma_external_allocation *dma_alloc;
+    if (dma_alloc->sg_table != NULL) {
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6,2,0)
+        dma_buf_unmap_attachment(dma_alloc->dma_attach, dma_alloc->sg_table,
+                                 DMA_BIDIRECTIONAL);
+#else
+        dma_buf_unmap_attachment_unlocked(dma_alloc->dma_attach,
+                dma_alloc->sg_table, DMA_BIDIRECTIONAL);
+#endif
+    }
+    mutex_destroy(&dma_alloc->map_lock);
+    dma_buf_detach(dma_alloc->dma_buf, dma_alloc->dma_attach);
+    dma_buf_put(dma_alloc->dma_buf);
+
+    // Free the allocation structure
+    kfree(dma_alloc);
+    return;
+}
+
+static int axidma_put_external(struct axidma_context *ctx, void *user_addr)
+{
+    struct axidma_buffer *buf;
+
+    // Find the allocation corresponding to the user address, and remove it
+    down_write(&ctx->buffers_lock);
+    buf = axidma_find_buffer(ctx, user_addr, 0);
+    if (buf == NULL || buf->type != AXIDMA_BUFFER_EXTERNAL) {
+        up_write(&ctx->buffers_lock);
+        return -ENOENT;
+    }
+    axidma_quiesce_buffer(ctx, buf);
+    axidma_remove_buffer(ctx, buf);
+    up_write(&ctx->buffers_lock);
+
+    // Unmap the buffer, and detach ourselves from it
+    axidma_free_external(container_of(buf, struct axidma_external_allocation,
+                                      buf));
+    return 0;
+}
 
-    // Find the allocation corresponding to the user address
-    list_for_each(iter, &dev->external_dmabufs)
+/* Unpins the user memory and releases the external buffers of the file. The
+ * buffers it allocated are freed as their mappings are closed, which always
+ * happens before the file is released. */
+static void axidma_release_buffers(struct axidma_context *ctx)
+{
+    struct rb_node *node, *next;
+    struct axidma_buffer *buf;
+
+    down_write(&ctx->buffers_lock);
+    for (node = rb_first(&ctx->buffers); node != NULL; node = next)
     {
-        dma_alloc = container_of(iter, struct axidma_external_allocation, list);
-        end_user_addr = (char *)dma_alloc->user_addr + dma_alloc->size;
-
-        if (dma_alloc->user_addr <= user_addr && user_addr <= end_user_addr) {
-            // Unmap the buffer, and detach ourselves from it
-            dma_buf_unmap_attachment(dma_alloc->dma_attach,
-                    dma_alloc->sg_table, DMA_BIDIRECTIONAL);
-            dma_buf_detach(dma_alloc->dma_buf, dma_alloc->dma_attach);
-            dma_buf_put(dma_alloc->dma_buf);
-
-            // Free the allocation structure
-            kfree(dma_alloc);
-            return 0;
+        next = rb_next(node);
+        buf = rb_entry(node, struct axidma_buffer, node);
+        if (buf->type == AXIDMA_BUFFER_PINNED) {
+            axidma_free_pinned(ctx, container_of(buf,
+                    struct axidma_pinned_allocation, buf));
+        } else if (buf->type == AXIDMA_BUFFER_EXTERNAL) {
+            axidma_remove_buffer(ctx, buf);
+            axidma_free_external(container_of(buf,
+                    struct axidma_external_allocation, buf));
         }
     }
+    up_write(&ctx->buffers_lock);
 
-    return -ENOENT;
+    return;
+}
+
+/* Maps a physical range that has no pages behind it for a device. Before
+ * 4.9, there was no interface for this, and the device is assumed to see
+ * physical addresses directly. */
+static int axidma_map_phys(struct device *dma_dev, phys_addr_t phys_addr,
+        size_t size, enum dma_data_direction dir, dma_addr_t *dma_addr)
+{
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4,9,0)
+    *dma_addr = (dma_addr_t)phys_addr;
+#else
+    *dma_addr = dma_map_resource(dma_dev, phys_addr, size, dir, 0);
+    if (dma_mapping_error(dma_dev, *dma_addr)) {
+        return -ENOMEM;
+    }
+#endif
+    return 0;
+}
+
+static void axidma_unmap_phys(struct device *dma_dev, dma_addr_t dma_addr,
+                              size_t size, enum dma_data_direction dir)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,9,0)
+    dma_unmap_resource(dma_dev, dma_addr, size, dir, 0);
+#endif
+    return;
+}
+
+// Sets up the pool for the reserved memory region of the device, if it has one
+static int axidma_pool_init(struct axidma_device *dev)
+{
+    int rc;
+    struct resource res;
+    struct axidma_pool *pool;
+
+    dev->pool = NULL;
+    rc = axidma_of_parse_memory_region(dev->pdev, &res);
+    if (rc == -ENOENT) {
+        return 0;
+    } else if (rc < 0) {
+        return rc;
+    }
+
+    pool = kzalloc(sizeof(*pool), GFP_KERNEL);
+    if (pool == NULL) {
+        axidma_err("Unable to allocate the reserved memory pool.\n");
+        return -ENOMEM;
+    }
+    kref_init(&pool->ref);
+    pool->dma_dev = &dev->pdev->dev;
+    pool->phys_addr = res.start;
+    pool->size = resource_size(&res);
+
+    /* The region is not in the kernel's linear mapping, so map it
+     * write-combined, which is also how its buffers are mapped to userspace */
+    pool->kern_addr = memremap(pool->phys_addr, pool->size, MEMREMAP_WC);
+    if (pool->kern_addr == NULL) {
+        axidma_err("Unable to map the reserved memory at %pa.\n",
+                   &pool->phys_addr);
+        rc = -ENOMEM;
+        goto free_pool;
+    }
+
+    rc = axidma_map_phys(pool->dma_dev, pool->phys_addr, pool->size,
+                         DMA_BIDIRECTIONAL, &pool->dma_addr);
+    if (rc < 0) {
+        axidma_err("Unable to map the reserved memory for DMA.\n");
+        goto unmap_region;
+    }
+
+    // Buffers are carved out of the region in whole pages
+    pool->gen_pool = gen_pool_create(PAGE_SHIFT, -1);
+    if (pool->gen_pool == NULL) {
+        axidma_err("Unable to create the reserved memory allocator.\n");
+        rc = -ENOMEM;
+        goto unmap_dma;
+    }
+    rc = gen_pool_add_virt(pool->gen_pool, (unsigned long)pool->kern_addr,
+                           pool->phys_addr, pool->size, -1);
+    if (rc < 0) {
+        axidma_err("Unable to add the reserved memory to the allocator.\n");
+        goto destroy_gen_pool;
+    }
+
+    axidma_info("Using %zu bytes of reserved memory at %pa for DMA "
+                "buffers.\n", pool->size, &pool->phys_addr);
+    dev->pool = pool;
+    return 0;
+
+destroy_gen_pool:
+    gen_pool_destroy(pool->gen_pool);
+unmap_dma:
+    axidma_unmap_phys(pool->dma_dev, pool->dma_addr, pool->size,
+                      DMA_BIDIRECTIONAL);
+unmap_region:
+    memunmap(pool->kern_addr);
+free_pool:
+    kfree(pool);
+    return rc;
+}
+
+// Frees the pool once the device and all of the buffers from it are gone
+static void axidma_pool_release(struct kref *ref)
+{
+    struct axidma_pool *pool;
+
+    pool = container_of(ref, struct axidma_pool, ref);
+    gen_pool_destroy(pool->gen_pool);
+    axidma_unmap_phys(pool->dma_dev, pool->dma_addr, pool->size,
+                      DMA_BIDIRECTIONAL);
+    memunmap(pool->kern_addr);
+    kfree(pool);
+    return;
+}
+
+static void axidma_pool_exit(struct axidma_device *dev)
+{
+    if (dev->pool != NULL) {
+        kref_put(&dev->pool->ref, axidma_pool_release);
+    }
+    return;
+}
+
+// Carves a buffer out of the reserved memory pool
+static int axidma_pool_alloc(struct axidma_pool *pool,
+                             struct axidma_dma_allocation *dma_alloc)
+{
+    unsigned long vaddr;
+
+    vaddr = gen_pool_alloc(pool->gen_pool, dma_alloc->buf.size);
+    if (vaddr == 0) {
+        axidma_err("Unable to allocate %zu bytes of reserved memory, %zu bytes "
+                   "are free.\n", dma_alloc->buf.size,
+                   gen_pool_avail(pool->gen_pool));
+        return -ENOMEM;
+    }
+
+    /* Clear the memory, as the DMA allocator would, since it may still hold
+     * the data of a buffer that another process freed. The region is mapped
+     * with memremap, so it is plain memory rather than I/O memory. Drain the
+     * write-combining buffers before the pages are mapped anywhere else. */
+    memset((void *)vaddr, 0, dma_alloc->buf.size);
+    wmb();
+
+    kref_get(&pool->ref);
+    dma_alloc->pool = pool;
+    dma_alloc->kern_addr = (void *)vaddr;
+    dma_alloc->dma_addr = pool->dma_addr +
+            ((char *)dma_alloc->kern_addr - (char *)pool->kern_addr);
+    return 0;
+}
+
+static void axidma_pool_free(struct axidma_dma_allocation *dma_alloc)
+{
+    struct axidma_pool *pool;
+
+    pool = dma_alloc->pool;
+    gen_pool_free(pool->gen_pool, (unsigned long)dma_alloc->kern_addr,
+                  dma_alloc->buf.size);
+    kref_put(&pool->ref, axidma_pool_release);
+    return;
+}
+
+// Gets the physical address of a buffer from the reserved memory pool
+static phys_addr_t axidma_pool_phys(struct axidma_dma_allocation *dma_alloc)
+{
+    return gen_pool_virt_to_phys(dma_alloc->pool->gen_pool,
+                                 (unsigned long)dma_alloc->kern_addr);
+}
+
+/* Allocates the memory for a DMA buffer of the given type. Uncached and
+ * write-combined buffers come from the device's reserved memory if it has
+ * any, and from the DMA allocator otherwise. Cacheable buffers are plain
+ * pages, which are mapped for streaming DMA for their whole lifetime. */
+static int axidma_alloc_buffer(struct axidma_device *dev,
+                               struct axidma_dma_allocation *dma_alloc)
+{
+    struct device *dma_dev;
+
+    dma_dev = &dev->pdev->dev;
+    dma_alloc->dma_dev = dma_dev;
+    dma_alloc->pool = NULL;
+
+    // Uncached buffers come from the reserved memory, when the device has it
+    if (dev->pool != NULL &&
+            dma_alloc->mem_type != AXIDMA_MMAP_CACHED_BUFFER) {
+        return axidma_pool_alloc(dev->pool, dma_alloc);
+    }
+
+    switch (dma_alloc->mem_type) {
+        case AXIDMA_MMAP_DMA_BUFFER:
+            dma_alloc->kern_addr = dma_alloc_coherent(dma_dev,
+                    dma_alloc->buf.size, &dma_alloc->dma_addr, GFP_KERNEL);
+            break;
+
+        case AXIDMA_MMAP_WRITECOMBINE_BUFFER:
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4,8,0)
+            dma_alloc->kern_addr = dma_alloc_writecombine(dma_dev,
+                    dma_alloc->buf.size, &dma_alloc->dma_addr, GFP_KERNEL);
+#else
+            dma_alloc->kern_addr = dma_alloc_wc(dma_dev, dma_alloc->buf.size,
+                    &dma_alloc->dma_addr, GFP_KERNEL);
+#endif
+            break;
+
+        case AXIDMA_MMAP_CACHED_BUFFER:
+            dma_alloc->kern_addr = alloc_pages_exact(dma_alloc->buf.size,
+                                                     GFP_KERNEL | __GFP_ZERO);
+            if (dma_alloc->kern_addr == NULL) {
+                break;
+            }
+
+            dma_alloc->dma_addr = dma_map_single(dma_dev, dma_alloc->kern_addr,
+                    dma_alloc->buf.size, DMA_BIDIRECTIONAL);
+            if (dma_mapping_error(dma_dev, dma_alloc->dma_addr)) {
+                axidma_err("Unable to map the cacheable buffer for DMA.\n");
+                free_pages_exact(dma_alloc->kern_addr, dma_alloc->buf.size);
+                return -ENOMEM;
+            }
+            break;
+
+        default:
+            axidma_err("Invalid memory type %d for the DMA buffer.\n",
+                       dma_alloc->mem_type);
+            return -EINVAL;
+    }
+
+    if (dma_alloc->kern_addr == NULL) {
+        axidma_err("Unable to allocate contiguous DMA memory region of size "
+                   "%zu.\n", dma_alloc->buf.size);
+        axidma_err("Please make sure that you specified cma=<size> on the "
+                   "kernel command line, and the size is large enough.\n");
+        return -ENOMEM;
+    }
+
+    return 0;
+}
+
+static void axidma_free_buffer(struct axidma_dma_allocation *dma_alloc)
+{
+    struct device *dma_dev;
+
+    if (dma_alloc->pool != NULL) {
+        axidma_pool_free(dma_alloc);
+        return;
+    }
+
+    dma_dev = dma_alloc->dma_dev;
+    switch (dma_alloc->mem_type) {
+        case AXIDMA_MMAP_DMA_BUFFER:
+            dma_free_coherent(dma_dev, dma_alloc->buf.size,
+                              dma_alloc->kern_addr, dma_alloc->dma_addr);
+            break;
+
+        case AXIDMA_MMAP_WRITECOMBINE_BUFFER:
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4,8,0)
+            dma_free_writecombine(dma_dev, dma_alloc->buf.size,
+                                  dma_alloc->kern_addr, dma_alloc->dma_addr);
+#else
+            dma_free_wc(dma_dev, dma_alloc->buf.size, dma_alloc->kern_addr,
+                        dma_alloc->dma_addr);
+#endif
+            break;
+
+        case AXIDMA_MMAP_CACHED_BUFFER:
+            dma_unmap_single(dma_dev, dma_alloc->dma_addr, dma_alloc->buf.size,
+                             DMA_BIDIRECTIONAL);
+            free_pages_exact(dma_alloc->kern_addr, dma_alloc->buf.size);
+            break;
+    }
+
+    return;
+}
+
+// Frees a DMA buffer once its mapping and exported dma-bufs are all gone
+static void axidma_release_dma_alloc(struct kref *ref)
+{
+    struct axidma_dma_allocation *dma_alloc;
+
+    dma_alloc = container_of(ref, struct axidma_dma_allocation, ref);
+    axidma_free_buffer(dma_alloc);
+    kfree(dma_alloc);
+    return;
+}
+
+/* Maps a DMA buffer into userspace, with the caching its type calls for. The
+ * page offset of the VMA is the offset of the mapping into the buffer. */
+static int axidma_map_buffer(struct axidma_dma_allocation *dma_alloc,
+                             struct vm_area_struct *vma)
+{
+    unsigned long pfn;
+    pgprot_t prot;
+    struct device *dma_dev;
+
+    /* Reserved memory has no pages, so it is mapped by its frame numbers. It
+     * must have the same memory type as the kernel's mapping of the region,
+     * and device memory would fault on the unaligned accesses of memcpy. */
+    if (dma_alloc->pool != NULL) {
+        pfn = axidma_pool_phys(dma_alloc) >> PAGE_SHIFT;
+        prot = pgprot_writecombine(vma->vm_page_prot);
+        return remap_pfn_range(vma, vma->vm_start, pfn + vma->vm_pgoff,
+                               vma->vm_end - vma->vm_start, prot);
+    }
+
+    dma_dev = dma_alloc->dma_dev;
+    switch (dma_alloc->mem_type) {
+        case AXIDMA_MMAP_WRITECOMBINE_BUFFER:
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4,8,0)
+            return dma_mmap_writecombine(dma_dev, vma, dma_alloc->kern_addr,
+                    dma_alloc->dma_addr, dma_alloc->buf.size);
+#else
+            return dma_mmap_wc(dma_dev, vma, dma_alloc->kern_addr,
+                               dma_alloc->dma_addr, dma_alloc->buf.size);
+#endif
+
+        case AXIDMA_MMAP_CACHED_BUFFER:
+            pfn = virt_to_phys(dma_alloc->kern_addr) >> PAGE_SHIFT;
+            return remap_pfn_range(vma, vma->vm_start, pfn + vma->vm_pgoff,
+                                   vma->vm_end - vma->vm_start,
+                                   vma->vm_page_prot);
+
+        default:
+            return dma_mmap_coherent(dma_dev, vma, dma_alloc->kern_addr,
+                                     dma_alloc->dma_addr, dma_alloc->buf.size);
+    }
+}
+
+/* Synchronizes the chunks of pinned memory that overlap the given range. The
+ * chunks are only synchronized whole, since that is how they were mapped. */
+static void axidma_sync_pinned(struct axidma_device *dev,
+                               struct axidma_pinned_allocation *pin_alloc,
+                               struct axidma_sync_range *range, bool for_cpu)
+{
+    int i, num_ents;
+    size_t start, end, ent_start;
+    struct scatterlist *sg, *first_sg;
+
+    // Find the first chunk overlapping the range, and how many follow it
+    start = (char *)range->user_addr - (char *)pin_alloc->buf.user_addr;
+    end = start + range->size;
+    ent_start = 0;
+    num_ents = 0;
+    first_sg = NULL;
+    for_each_sg(pin_alloc->sg_table.sgl, sg, pin_alloc->sg_table.orig_nents, i)
+    {
+        if (ent_start + sg->length > start && ent_start < end) {
+            first_sg = (first_sg == NULL) ? sg : first_sg;
+            num_ents += 1;
+        }
+        ent_start += sg->length;
+    }
+    if (first_sg == NULL) {
+        return;
+    }
+
+    if (for_cpu) {
+        dma_sync_sg_for_cpu(&dev->pdev->dev, first_sg, num_ents,
+                            DMA_BIDIRECTIONAL);
+    } else {
+        dma_sync_sg_for_device(&dev->pdev->dev, first_sg, num_ents,
+                               DMA_BIDIRECTIONAL);
+    }
+    return;
+}
+
+/* Synchronizes a range of a DMA buffer allocated by the driver between the CPU
+ * and the device, in the given direction. Only cacheable buffers need cache
+ * maintenance, while write-combined buffers only need their writes drained. */
+static int axidma_sync_buffer(struct axidma_context *ctx,
+                              struct axidma_sync_range *range, bool for_cpu)
+{
+    int rc;
+    dma_addr_t offset;
+    struct device *dma_dev;
+    struct axidma_buffer *buf;
+    struct axidma_dma_allocation *dma_alloc;
+
+    // Find the buffer that holds the range
+    rc = 0;
+    down_read(&ctx->buffers_lock);
+    buf = axidma_find_buffer(ctx, range->user_addr, range->size);
+    if (buf == NULL || buf->type == AXIDMA_BUFFER_EXTERNAL) {
+        axidma_err("Sync range at %p of size %zu does not fall within a DMA "
+                   "buffer allocated or pinned by the driver.\n",
+                   range->user_addr, range->size);
+        rc = -EINVAL;
+        goto unlock;
+    }
+
+    // Pinned user memory is always cached, and synchronized chunk by chunk
+    if (buf->type == AXIDMA_BUFFER_PINNED) {
+        axidma_sync_pinned(ctx->dev, container_of(buf,
+                struct axidma_pinned_allocation, buf), range, for_cpu);
+        goto unlock;
+    }
+    dma_alloc = container_of(buf, struct axidma_dma_allocation, buf);
+
+    dma_dev = &ctx->dev->pdev->dev;
+    offset = (dma_addr_t)(range->user_addr - dma_alloc->buf.user_addr);
+    switch (dma_alloc->mem_type) {
+        case AXIDMA_MMAP_CACHED_BUFFER:
+            if (for_cpu) {
+                dma_sync_single_range_for_cpu(dma_dev, dma_alloc->dma_addr,
+                        offset, range->size, DMA_BIDIRECTIONAL);
+            } else {
+                dma_sync_single_range_for_device(dma_dev, dma_alloc->dma_addr,
+                        offset, range->size, DMA_BIDIRECTIONAL);
+            }
+            break;
+
+        case AXIDMA_MMAP_WRITECOMBINE_BUFFER:
+            if (!for_cpu) {
+                wmb();
+            }
+            break;
+    }
+
+unlock:
+    up_read(&ctx->buffers_lock);
+    return rc;
 }
 
 static void axidma_vma_close(struct vm_area_struct *vma)
 {
-    struct axidma_device *dev;
+    struct axidma_context *ctx;
     struct axidma_dma_allocation *dma_alloc;
 
-    // Get the AXI DMA allocation data and free the DMA buffer
-    dev = axidma_dev;
+    /* Get the AXI DMA allocation data, stop everything running on it, and
+     * remove it from the file's tree. */
+    ctx = vma->vm_file->private_data;
     dma_alloc = vma->vm_private_data;
-    dma_free_coherent(&dev->pdev->dev, dma_alloc->size, dma_alloc->kern_addr,
-                      dma_alloc->dma_addr);
+    down_write(&ctx->buffers_lock);
+    axidma_quiesce_buffer(ctx, &dma_alloc->buf);
+    axidma_remove_buffer(ctx, &dma_alloc->buf);
+    up_write(&ctx->buffers_lock);
 
-    // Remove the allocation from the list, and free the structure
-    list_del(&dma_alloc->list);
-    kfree(dma_alloc);
+    // Free the DMA buffer, unless it was exported and is still in use
+    kref_put(&dma_alloc->ref, axidma_release_dma_alloc);
 
     return;
 }
@@ -226,40 +1115,590 @@ static const struct vm_operations_struct axidma_vm_ops = {
     .close = axidma_vma_close,
 };
 
+// Takes a reference to a ring for a new piece of its mapping
+static void axidma_ring_vma_open(struct vm_area_struct *vma)
+{
+    struct axidma_ring_map *map;
+
+    map = vma->vm_private_data;
+    kref_get(&map->ref);
+    return;
+}
+
+// Detaches the completion ring from its file, and frees it
+static void axidma_release_ring(struct kref *ref)
+{
+    unsigned long flags;
+    struct axidma_ring_map *map;
+    struct axidma_context *ctx;
+
+    // Detach the ring from the file, so that no more completions are posted
+    map = container_of(ref, struct axidma_ring_map, ref);
+    ctx = map->ctx;
+    spin_lock_irqsave(&ctx->notify_lock, flags);
+    if (ctx->ring == map->ring) {
+        ctx->ring = NULL;
+    }
+    spin_unlock_irqrestore(&ctx->notify_lock, flags);
+
+    vfree(map->ring);
+    kfree(map);
+    return;
+}
+
+static void axidma_ring_vma_close(struct vm_area_struct *vma)
+{
+    struct axidma_ring_map *map;
+
+    map = vma->vm_private_data;
+    kref_put(&map->ref, axidma_release_ring);
+    return;
+}
+
+// The VMA operations for the completion ring
+static const struct vm_operations_struct axidma_ring_vm_ops = {
+    .open = axidma_ring_vma_open,
+    .close = axidma_ring_vma_close,
+};
+
+/* Allocates the completion ring, sized to fill the requested mapping, and maps
+ * it into userspace. Each file can have one completion ring mapped at a time,
+ * which receives the completions of the file's own transfers. */
+static int axidma_mmap_ring(struct axidma_context *ctx,
+                            struct vm_area_struct *vma)
+{
+    int rc;
+    size_t size;
+    u32 num_entries;
+    unsigned long flags;
+    struct axidma_ring_map *map;
+    struct axidma_completion_ring *ring;
+
+    // Determine how many completion entries fit in the requested region
+    size = vma->vm_end - vma->vm_start;
+    if (size < sizeof(*ring) + sizeof(ring->entries[0])) {
+        axidma_err("Completion ring of size %zu is too small to hold any "
+                   "entries.\n", size);
+        return -EINVAL;
+    }
+    num_entries = (size - sizeof(*ring)) / sizeof(ring->entries[0]);
+
+    map = kmalloc(sizeof(*map), GFP_KERNEL);
+    if (map == NULL) {
+        axidma_err("Unable to allocate the completion ring mapping.\n");
+        return -ENOMEM;
+    }
+
+    // Allocate the ring with zeroed memory that is safe to map to userspace
+    ring = vmalloc_user(size);
+    if (ring == NULL) {
+        axidma_err("Unable to allocate completion ring of size %zu.\n", size);
+        rc = -ENOMEM;
+        goto free_map;
+    }
+    ring->num_entries = num_entries;
+    kref_init(&map->ref);
+    map->ctx = ctx;
+    map->ring = ring;
+    map->size = size;
+
+    rc = remap_vmalloc_range(vma, ring, 0);
+    if (rc < 0) {
+        axidma_err("Unable to map the completion ring to userspace.\n");
+        goto free_ring;
+    }
+
+    // Attach the ring to the file, unless one is already in use
+    spin_lock_irqsave(&ctx->notify_lock, flags);
+    if (ctx->ring != NULL) {
+        spin_unlock_irqrestore(&ctx->notify_lock, flags);
+        axidma_err("A completion ring is already mapped for the file.\n");
+        rc = -EBUSY;
+        goto free_ring;
+    }
+    ctx->ring = ring;
+    ctx->ring_entries = num_entries;
+    ctx->ring_head = 0;
+    spin_unlock_irqrestore(&ctx->notify_lock, flags);
+
+    // The ring belongs to this process only, and cannot be resized
+    vma->vm_ops = &axidma_ring_vm_ops;
+    vma->vm_private_data = map;
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6,3,0)
+    vma->vm_flags |= VM_DONTCOPY | VM_DONTEXPAND;
+#else
+    vm_flags_set(vma, VM_DONTCOPY | VM_DONTEXPAND);
+#endif
+    return 0;
+
+free_ring:
+    vfree(ring);
+free_map:
+    kfree(map);
+    return rc;
+}
+
+// Stops the receive ring that uses the indices, and frees them
+static void axidma_release_rx_ring(struct kref *ref)
+{
+    struct axidma_ring_map *map;
+
+    map = container_of(ref, struct axidma_ring_map, ref);
+    axidma_stop_rx_rings(map->ctx->dev, map->ring);
+
+    vfree(map->ring);
+    kfree(map);
+    return;
+}
+
+static void axidma_rx_ring_vma_close(struct vm_area_struct *vma)
+{
+    struct axidma_ring_map *map;
+
+    map = vma->vm_private_data;
+    kref_put(&map->ref, axidma_release_rx_ring);
+    return;
+}
+
+// The VMA operations for the indices of a receive ring
+static const struct vm_operations_struct axidma_rx_ring_vm_ops = {
+    .open = axidma_ring_vma_open,
+    .close = axidma_rx_ring_vma_close,
+};
+
+/* Allocates the indices for a receive ring, with as many slot lengths as fit
+ * in the requested mapping, and maps them into userspace. The ring is started
+ * on a channel later, by passing the address of the mapping. */
+static int axidma_mmap_rx_ring(struct axidma_context *ctx,
+                               struct vm_area_struct *vma)
+{
+    int rc;
+    size_t size;
+    struct axidma_ring_map *map;
+    struct axidma_rx_ring *ring;
+
+    // Determine how many slots the requested region can describe
+    size = vma->vm_end - vma->vm_start;
+    if (size < sizeof(*ring) + sizeof(ring->lengths[0])) {
+        axidma_err("Receive ring of size %zu is too small to hold any "
+                   "slots.\n", size);
+        return -EINVAL;
+    }
+
+    map = kmalloc(sizeof(*map), GFP_KERNEL);
+    if (map == NULL) {
+        axidma_err("Unable to allocate the receive ring mapping.\n");
+        return -ENOMEM;
+    }
+
+    // Allocate the indices with zeroed memory that is safe to map to userspace
+    ring = vmalloc_user(size);
+    if (ring == NULL) {
+        axidma_err("Unable to allocate receive ring of size %zu.\n", size);
+        rc = -ENOMEM;
+        goto free_map;
+    }
+    ring->num_slots = (size - sizeof(*ring)) / sizeof(ring->lengths[0]);
+    kref_init(&map->ref);
+    map->ctx = ctx;
+    map->ring = ring;
+    map->size = size;
+
+    rc = remap_vmalloc_range(vma, ring, 0);
+    if (rc < 0) {
+        axidma_err("Unable to map the receive ring to userspace.\n");
+        goto free_ring;
+    }
+
+    // The indices belong to this process only, and cannot be resized
+    vma->vm_ops = &axidma_rx_ring_vm_ops;
+    vma->vm_private_data = map;
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6,3,0)
+    vma->vm_flags |= VM_DONTCOPY | VM_DONTEXPAND;
+#else
+    vm_flags_set(vma, VM_DONTCOPY | VM_DONTEXPAND);
+#endif
+    return 0;
+
+free_ring:
+    vfree(ring);
+free_map:
+    kfree(map);
+    return rc;
+}
+
+/* Starts a receive ring on the indices mapped at the given user address. The
+ * mapping is looked up, and kept from being unmapped, under the mmap lock,
+ * which is held until the ring is running. */
+static int axidma_start_user_rx_ring(struct axidma_context *ctx,
+                                     struct axidma_rx_ring_config *config)
+{
+    int rc;
+    u32 num_slots;
+    struct mm_struct *mm;
+    struct vm_area_struct *vma;
+    struct axidma_ring_map *map;
+
+    mm = current->mm;
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5,8,0)
+    down_read(&mm->mmap_sem);
+#else
+    mmap_read_lock(mm);
+#endif
+
+    /* The address must be the start of indices mapped from this file. A piece
+     * split off the end of the mapping no longer starts at the first page. */
+    vma = find_vma(mm, (unsigned long)config->ring);
+    if (vma == NULL || vma->vm_start != (unsigned long)config->ring ||
+            vma->vm_ops != &axidma_rx_ring_vm_ops ||
+            vma->vm_pgoff != AXIDMA_MMAP_RX_RING ||
+            vma->vm_file->private_data != ctx) {
+        axidma_err("Address %p is not a receive ring mapped from the "
+                   "file.\n", config->ring);
+        rc = -EINVAL;
+        goto unlock;
+    }
+
+    // The indices must have room for the length of every slot
+    map = vma->vm_private_data;
+    num_slots = (map->size - sizeof(struct axidma_rx_ring)) / sizeof(__u32);
+    if (config->num_slots <= 0 || config->num_slots > num_slots) {
+        axidma_err("Receive ring mapping holds %u slots, but %d were "
+                   "requested.\n", num_slots, config->num_slots);
+        rc = -EINVAL;
+        goto unlock;
+    }
+    rc = axidma_start_rx_ring(ctx, config, map->ring, config->num_slots);
+
+unlock:
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5,8,0)
+    up_read(&mm->mmap_sem);
+#else
+    mmap_read_unlock(mm);
+#endif
+    return rc;
+}
+
+/*----------------------------------------------------------------------------
+ * DMA Buffer Export
+ *----------------------------------------------------------------------------*/
+
+/* Maps an exported buffer for a device that imported it. The buffer is
+ * physically contiguous, but memory from the DMA allocator may not be in the
+ * kernel's linear map, so the allocator is asked to describe it. Reserved
+ * memory has no pages at all, so only its DMA address is filled in. */
+static struct sg_table *axidma_dmabuf_map(struct dma_buf_attachment *attach,
+                                          enum dma_data_direction dir)
+{
+    int rc;
+    struct sg_table *sg_table;
+    struct axidma_dma_allocation *dma_alloc;
+
+    dma_alloc = attach->dmabuf->priv;
+    sg_table = kmalloc(sizeof(*sg_table), GFP_KERNEL);
+    if (sg_table == NULL) {
+        axidma_err("Unable to allocate the scatter-gather table.\n");
+        return ERR_PTR(-ENOMEM);
+    }
+
+    if (dma_alloc->pool != NULL) {
+        rc = sg_alloc_table(sg_table, 1, GFP_KERNEL);
+        if (rc < 0) {
+            goto free_table;
+        }
+
+        rc = axidma_map_phys(attach->dev, axidma_pool_phys(dma_alloc),
+                dma_alloc->buf.size, dir, &sg_dma_address(sg_table->sgl));
+        if (rc < 0) {
+            axidma_err("Unable to map the exported buffer for the device.\n");
+            goto free_sg;
+        }
+        sg_dma_len(sg_table->sgl) = dma_alloc->buf.size;
+        sg_table->nents = 1;
+        return sg_table;
+    } else if (dma_alloc->mem_type == AXIDMA_MMAP_CACHED_BUFFER) {
+        rc = sg_alloc_table(sg_table, 1, GFP_KERNEL);
+        if (rc == 0) {
+            sg_set_page(sg_table->sgl, virt_to_page(dma_alloc->kern_addr),
+                        PAGE_ALIGN(dma_alloc->buf.size), 0);
+        }
+    } else {
+        rc = dma_get_sgtable(dma_alloc->dma_dev, sg_table,
+                dma_alloc->kern_addr, dma_alloc->dma_addr, dma_alloc->buf.size);
+    }
+    if (rc < 0) {
+        axidma_err("Unable to describe the exported buffer.\n");
+        goto free_table;
+    }
+
+    // Map the buffer for the importing device
+    sg_table->nents = dma_map_sg(attach->dev, sg_table->sgl,
+                                 sg_table->orig_nents, dir);
+    if (sg_table->nents == 0) {
+        axidma_err("Unable to map the exported buffer for the device.\n");
+        rc = -ENOMEM;
+        goto free_sg;
+    }
+
+    return sg_table;
+
+free_sg:
+    sg_free_table(sg_table);
+free_table:
+    kfree(sg_table);
+    return ERR_PTR(rc);
+}
+
+static void axidma_dmabuf_unmap(struct dma_buf_attachment *attach,
+                                struct sg_table *sg_table,
+                                enum dma_data_direction dir)
+{
+    struct axidma_dma_allocation *dma_alloc;
+
+    dma_alloc = attach->dmabuf->priv;
+    if (dma_alloc->pool != NULL) {
+        axidma_unmap_phys(attach->dev, sg_dma_address(sg_table->sgl),
+                          dma_alloc->buf.size, dir);
+    } else {
+        dma_unmap_sg(attach->dev, sg_table->sgl, sg_table->orig_nents, dir);
+    }
+    sg_free_table(sg_table);
+    kfree(sg_table);
+    return;
+}
+
+// Drops the dma-buf's reference on the buffer, and on its device
+static void axidma_dmabuf_release(struct dma_buf *dma_buf)
+{
+    struct device *dma_dev;
+    struct axidma_dma_allocation *dma_alloc;
+
+    dma_alloc = dma_buf->priv;
+    dma_dev = dma_alloc->dma_dev;
+    kref_put(&dma_alloc->ref, axidma_release_dma_alloc);
+    put_device(dma_dev);
+    return;
+}
+
+static int axidma_dmabuf_mmap(struct dma_buf *dma_buf,
+                              struct vm_area_struct *vma)
+{
+    return axidma_map_buffer(dma_buf->priv, vma);
+}
+
+/* Synchronizes a cacheable buffer around the CPU accesses of processes that
+ * mapped the dma-buf. The other buffer types are not cached. */
+static int axidma_dmabuf_begin_cpu_access(struct dma_buf *dma_buf,
+                                          enum dma_data_direction dir)
+{
+    struct axidma_dma_allocation *dma_alloc;
+
+    dma_alloc = dma_buf->priv;
+    if (dma_alloc->mem_type == AXIDMA_MMAP_CACHED_BUFFER) {
+        dma_sync_single_for_cpu(dma_alloc->dma_dev, dma_alloc->dma_addr,
+                                dma_alloc->buf.size, dir);
+    }
+    return 0;
+}
+
+static int axidma_dmabuf_end_cpu_access(struct dma_buf *dma_buf,
+                                        enum dma_data_direction dir)
+{
+    struct axidma_dma_allocation *dma_alloc;
+
+    dma_alloc = dma_buf->priv;
+    if (dma_alloc->mem_type == AXIDMA_MMAP_CACHED_BUFFER) {
+        dma_sync_single_for_device(dma_alloc->dma_dev, dma_alloc->dma_addr,
+                                   dma_alloc->buf.size, dir);
+    }
+    return 0;
+}
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4,19,0)
+// Older kernels require exporters to map single pages into the kernel
+static void *axidma_dmabuf_kmap(struct dma_buf *dma_buf, unsigned long page)
+{
+    struct axidma_dma_allocation *dma_alloc;
+
+    dma_alloc = dma_buf->priv;
+    return (char *)dma_alloc->kern_addr + page * PAGE_SIZE;
+}
+#endif
+
+// The operations for dma-bufs exported from DMA buffers
+static const struct dma_buf_ops axidma_dmabuf_ops = {
+    .map_dma_buf = axidma_dmabuf_map,
+    .unmap_dma_buf = axidma_dmabuf_unmap,
+    .release = axidma_dmabuf_release,
+    .mmap = axidma_dmabuf_mmap,
+    .begin_cpu_access = axidma_dmabuf_begin_cpu_access,
+    .end_cpu_access = axidma_dmabuf_end_cpu_access,
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4,12,0)
+    .kmap_atomic = axidma_dmabuf_kmap,
+    .kmap = axidma_dmabuf_kmap,
+#elif LINUX_VERSION_CODE < KERNEL_VERSION(4,19,0)
+    .map_atomic = axidma_dmabuf_kmap,
+    .map = axidma_dmabuf_kmap,
+#endif
+};
+
+static int axidma_export_buffer(struct axidma_context *ctx,
+                                struct axidma_export_buffer *export)
+{
+    int rc;
+    struct dma_buf *dma_buf;
+    struct axidma_buffer *buf;
+    struct axidma_dma_allocation *dma_alloc;
+    DEFINE_DMA_BUF_EXPORT_INFO(exp_info);
+
+    // Only whole buffers that the driver allocated can be exported
+    down_read(&ctx->buffers_lock);
+    buf = axidma_find_buffer(ctx, export->user_addr, 0);
+    if (buf == NULL || buf->type != AXIDMA_BUFFER_DMA ||
+            buf->user_addr != export->user_addr) {
+        up_read(&ctx->buffers_lock);
+        axidma_err("No DMA buffer starts at address %p.\n",
+                   export->user_addr);
+        return -ENOENT;
+    }
+
+    /* The dma-buf keeps the buffer allocated after it is unmapped, and keeps
+     * its device around for freeing it */
+    dma_alloc = container_of(buf, struct axidma_dma_allocation, buf);
+    kref_get(&dma_alloc->ref);
+    up_read(&ctx->buffers_lock);
+    get_device(dma_alloc->dma_dev);
+
+    exp_info.ops = &axidma_dmabuf_ops;
+    exp_info.size = dma_alloc->buf.size;
+    exp_info.flags = O_RDWR;
+    exp_info.priv = dma_alloc;
+    dma_buf = dma_buf_export(&exp_info);
+    if (IS_ERR(dma_buf)) {
+        axidma_err("Unable to export the DMA buffer.\n");
+        rc = PTR_ERR(dma_buf);
+        goto put_buffer;
+    }
+
+    // Install a file descriptor for the dma-buf, which now owns the references
+    rc = dma_buf_fd(dma_buf, O_CLOEXEC);
+    if (rc < 0) {
+        axidma_err("Unable to get a file descriptor for the dma-buf.\n");
+        dma_buf_put(dma_buf);
+        return rc;
+    }
+
+    export->fd = rc;
+    return 0;
+
+put_buffer:
+    kref_put(&dma_alloc->ref, axidma_release_dma_alloc);
+    put_device(dma_alloc->dma_dev);
+    return rc;
+}
+
 /*----------------------------------------------------------------------------
  * File Operations
  *----------------------------------------------------------------------------*/
 
 static int axidma_open(struct inode *inode, struct file *file)
 {
-    // Only the root user can open this device, and it must be exclusive
+    struct axidma_context *ctx;
+
+    // Only the root user can open this device
     if (!capable(CAP_SYS_ADMIN)) {
         axidma_err("Only root can open this device.");
         return -EACCES;
-    } else if (!(file->f_flags & O_EXCL)) {
-        axidma_err("O_EXCL must be specified for open()\n");
-        return -EINVAL;
     }
 
-    // Place the axidma structure in the private data of the file
-    file->private_data = (void *)axidma_dev;
+    /* Each open file gets its own context, which owns its buffers, transfers
+     * and completion state, so that several processes can share the device */
+    ctx = kmalloc(sizeof(*ctx), GFP_KERNEL);
+    if (ctx == NULL) {
+        axidma_err("Unable to allocate the file context.\n");
+        return -ENOMEM;
+    }
+    ctx->dev = container_of(inode->i_cdev, struct axidma_device, chrdev);
+    ctx->notify_signal = -1;
+
+    // Initialize the tree for DMA mmap'ed allocations
+    init_rwsem(&ctx->buffers_lock);
+    ctx->buffers = RB_ROOT;
+    ctx->buffers_gen = 0;
+
+    // Initialize the table of prepared transfers
+    spin_lock_init(&ctx->prepared_lock);
+    idr_init(&ctx->prepared);
+
+    // No completion ring is mapped until userspace requests one
+    spin_lock_init(&ctx->notify_lock);
+    init_waitqueue_head(&ctx->completion_wait);
+    ctx->ring = NULL;
+    atomic_set(&ctx->notifying, 0);
+
+    file->private_data = ctx;
     return 0;
 }
 
 static int axidma_release(struct inode *inode, struct file *file)
 {
+    struct axidma_context *ctx;
+
+    /* Stop the forwarding and transfers of this file that are still in
+     * flight, so that none of their callbacks refer to the context after it is
+     * freed. Then drop its transfer handles, channel claims, eventfds,
+     * prepared transfers and the memory it pinned or imported. */
+    ctx = file->private_data;
+    axidma_stop_forwards(ctx, NULL, 0);
+    axidma_release_transfers(ctx);
+    axidma_release_handles(ctx);
+    axidma_release_claims(ctx);
+    axidma_clear_eventfds(ctx->dev, ctx);
+    axidma_release_prepared(ctx);
+    idr_destroy(&ctx->prepared);
+    axidma_release_buffers(ctx);
+
     file->private_data = NULL;
+    kfree(ctx);
+    return 0;
+}
+
+static unsigned int axidma_poll(struct file *file, poll_table *wait)
+{
+    struct axidma_context *ctx;
+
+    // The file is readable when there are completions waiting to be reaped
+    ctx = file->private_data;
+    poll_wait(file, &ctx->completion_wait, wait);
+    if (axidma_completions_pending(ctx)) {
+        return POLLIN | POLLRDNORM;
+    }
+
     return 0;
 }
 
 static int axidma_mmap(struct file *file, struct vm_area_struct *vma)
 {
     int rc;
+    struct axidma_context *ctx;
     struct axidma_device *dev;
     struct axidma_dma_allocation *dma_alloc;
 
-    // Get the axidma device structure
-    dev = file->private_data;
+    // Get the context of the file, and the axidma device structure
+    ctx = file->private_data;
+    dev = ctx->dev;
+
+    // The page offset selects the completion ring, or the type of DMA buffer
+    if (vma->vm_pgoff == AXIDMA_MMAP_COMPLETION_RING) {
+        return axidma_mmap_ring(ctx, vma);
+    } else if (vma->vm_pgoff == AXIDMA_MMAP_RX_RING) {
+        return axidma_mmap_rx_ring(ctx, vma);
+    } else if (vma->vm_pgoff != AXIDMA_MMAP_DMA_BUFFER &&
+               vma->vm_pgoff != AXIDMA_MMAP_CACHED_BUFFER &&
+               vma->vm_pgoff != AXIDMA_MMAP_WRITECOMBINE_BUFFER) {
+        axidma_err("Invalid page offset %lu for mmap.\n", vma->vm_pgoff);
+        return -EINVAL;
+    }
 
     // Allocate a structure to store data about the DMA mapping
     dma_alloc = kmalloc(sizeof(*dma_alloc), GFP_KERNEL);
@@ -269,32 +1708,41 @@ static int axidma_mmap(struct file *file, struct vm_area_struct *vma)
         goto ret;
     }
 
-    // Set the user virtual address and the size
-    dma_alloc->size = vma->vm_end - vma->vm_start;
-    dma_alloc->user_addr = (void *)vma->vm_start;
+    // Set the memory type, the user virtual address and the size
+    dma_alloc->mem_type = vma->vm_pgoff;
+    dma_alloc->buf.type = AXIDMA_BUFFER_DMA;
+    dma_alloc->buf.size = vma->vm_end - vma->vm_start;
+    dma_alloc->buf.user_addr = (void *)vma->vm_start;
+
+    /* Add the allocation to the file's tree of buffers. Pinned memory or an
+     * external buffer may still claim this range, if it was left registered
+     * after its mapping went away. */
+    down_write(&ctx->buffers_lock);
+    rc = axidma_insert_buffer(ctx, &dma_alloc->buf);
+    up_write(&ctx->buffers_lock);
+    if (rc < 0) {
+        goto free_vma_data;
+    }
 
     // Configure the DMA device
     of_dma_configure(dev->device, NULL);
 
-    // Allocate the requested region a contiguous and uncached for DMA
-    dma_alloc->kern_addr = dma_alloc_coherent(&dev->pdev->dev, dma_alloc->size,
-                                              &dma_alloc->dma_addr, GFP_KERNEL);
-    if (dma_alloc->kern_addr == NULL) {
-        axidma_err("Unable to allocate contiguous DMA memory region of size "
-                   "%zu.\n", dma_alloc->size);
-        axidma_err("Please make sure that you specified cma=<size> on the "
-                   "kernel command line, and the size is large enough.\n");
-        rc = -ENOMEM;
-        goto free_vma_data;
+    // Allocate the requested region as contiguous memory of the given type
+    rc = axidma_alloc_buffer(dev, dma_alloc);
+    if (rc < 0) {
+        goto remove_buffer;
     }
+    kref_init(&dma_alloc->ref);
+
+    // The page offset only selected the buffer type, the mapping starts at 0
+    vma->vm_pgoff = 0;
 
     // Map the region into userspace
-    rc = dma_mmap_coherent(&dev->pdev->dev, vma, dma_alloc->kern_addr,
-                           dma_alloc->dma_addr, dma_alloc->size);
+    rc = axidma_map_buffer(dma_alloc, vma);
     if (rc < 0) {
         axidma_err("Unable to remap address %p to userspace address %p, size "
-                   "%zu.\n", dma_alloc->kern_addr, dma_alloc->user_addr,
-                   dma_alloc->size);
+                   "%zu.\n", dma_alloc->kern_addr, dma_alloc->buf.user_addr,
+                   dma_alloc->buf.size);
         goto free_dma_region;
     }
 
@@ -303,18 +1751,22 @@ static int axidma_mmap(struct file *file, struct vm_area_struct *vma)
     vma->vm_ops = &axidma_vm_ops;
     vma->vm_private_data = dma_alloc;
 
-    // Do not copy this memory region if this process is forked.
-    /* TODO: Figure out the proper way to actually handle multiple processes
-     * referring to the DMA buffer. */
+    /* Do not copy this memory region if this process is forked. Buffers belong
+     * to the file that mapped them, so other processes open their own. */
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6,3,0)
     vma->vm_flags |= VM_DONTCOPY;
+#else
+    vm_flags_set(vma, VM_DONTCOPY);
+#endif
 
-    // Add the allocation to the driver's list of DMA buffers
-    list_add(&dma_alloc->list, &dev->dmabuf_list);
     return 0;
 
 free_dma_region:
-    dma_free_coherent(&dev->pdev->dev, dma_alloc->size, dma_alloc->kern_addr,
-                      dma_alloc->dma_addr);
+    axidma_free_buffer(dma_alloc);
+remove_buffer:
+    down_write(&ctx->buffers_lock);
+    axidma_remove_buffer(ctx, &dma_alloc->buf);
+    up_write(&ctx->buffers_lock);
 free_vma_data:
     kfree(dma_alloc);
 ret:
@@ -325,12 +1777,21 @@ ret:
  * The user specifies the mode, either readonly, or not (read-write). */
 static bool axidma_access_ok(const void __user *arg, size_t size, bool readonly)
 {
-    // Note that VERIFY_WRITE implies VERIFY_WRITE, so read-write is handled
+    /* Note that VERIFY_WRITE implies VERIFY_WRITE, so read-write is handled.
+     * From the 5.0 kernel, the access type is no longer checked. */
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5,0,0)
     if (!readonly && !access_ok(VERIFY_WRITE, arg, size)) {
+#else
+    if (!readonly && !access_ok(arg, size)) {
+#endif
         axidma_err("Argument address %p, size %zu cannot be written to.\n",
                    arg, size);
         return false;
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5,0,0)
     } else if (!access_ok(VERIFY_READ, arg, size)) {
+#else
+    } else if (!access_ok(arg, size)) {
+#endif
         axidma_err("Argument address %p, size %zu cannot be read from.\n",
                    arg, size);
         return false;
@@ -344,12 +1805,27 @@ static long axidma_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
     long rc;
     size_t size;
     void *__user arg_ptr;
+    struct axidma_context *ctx;
     struct axidma_device *dev;
     struct axidma_num_channels num_chans;
     struct axidma_channel_info usr_chans, kern_chans;
     struct axidma_register_buffer ext_buf;
-    struct axidma_transaction trans;
+    struct axidma_export_buffer export;
+    struct axidma_transaction trans, *trans_array;
     struct axidma_inout_transaction inout_trans;
+    struct axidma_batch_transaction batch_trans;
+    struct axidma_channel_eventfd chan_eventfd;
+    struct axidma_submit submit;
+    struct axidma_wait wait;
+    struct axidma_handle handle;
+    struct axidma_sync_range sync_range;
+    struct axidma_pin_buffer pin_buf;
+    struct axidma_rx_ring_config rx_ring;
+    struct axidma_forward_config forward;
+    struct axidma_prepare prepare;
+    struct axidma_busy_poll busy_poll;
+    struct axidma_channel_config chan_config;
+    struct axidma_channel_stats chan_stats;
     struct axidma_video_transaction video_trans, *__user user_video_trans;
     struct axidma_chan chan_info;
 
@@ -376,8 +1852,9 @@ static long axidma_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
         }
     }
 
-    // Get the axidma device from the file
-    dev = file->private_data;
+    // Get the context of the file, and the axidma device it was opened on
+    ctx = file->private_data;
+    dev = ctx->dev;
 
     // Perform the specified command
     switch (cmd) {
@@ -412,7 +1889,7 @@ static long axidma_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
             break;
 
         case AXIDMA_SET_DMA_SIGNAL:
-            rc = axidma_set_signal(dev, arg);
+            rc = axidma_set_signal(ctx, arg);
             break;
 
         case AXIDMA_REGISTER_BUFFER:
@@ -421,7 +1898,7 @@ static long axidma_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
                            "for AXIDMA_REGISTER_BUFFER.\n");
                 return -EFAULT;
             }
-            rc = axidma_get_external(dev, &ext_buf);
+            rc = axidma_get_external(ctx, &ext_buf);
             break;
 
         case AXIDMA_DMA_READ:
@@ -430,7 +1907,7 @@ static long axidma_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
                            "AXIDMA_DMA_READ.\n");
                 return -EFAULT;
             }
-            rc = axidma_read_transfer(dev, &trans);
+            rc = axidma_read_transfer(ctx, &trans);
             break;
 
         case AXIDMA_DMA_WRITE:
@@ -439,7 +1916,7 @@ static long axidma_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
                            "AXIDMA_DMA_WRITE.\n");
                 return -EFAULT;
             }
-            rc = axidma_write_transfer(dev, &trans);
+            rc = axidma_write_transfer(ctx, &trans);
             break;
 
         case AXIDMA_DMA_READWRITE:
@@ -449,7 +1926,45 @@ static long axidma_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
                            "AXIDMA_DMA_READWRITE.\n");
                 return -EFAULT;
             }
-            rc = axidma_rw_transfer(dev, &inout_trans);
+            rc = axidma_rw_transfer(ctx, &inout_trans);
+            break;
+
+        case AXIDMA_DMA_SUBMIT_BATCH:
+            if (copy_from_user(&batch_trans, arg_ptr,
+                               sizeof(batch_trans)) != 0) {
+                axidma_err("Unable to copy transfer info from userspace for "
+                           "AXIDMA_DMA_SUBMIT_BATCH.\n");
+                return -EFAULT;
+            }
+
+            // Check that the batch size is within the supported range
+            if (batch_trans.num_transactions <= 0 ||
+                batch_trans.num_transactions > AXIDMA_MAX_BATCH_TRANSACTIONS) {
+                axidma_err("Invalid number of transactions %d for "
+                           "AXIDMA_DMA_SUBMIT_BATCH.\n",
+                           batch_trans.num_transactions);
+                return -EINVAL;
+            }
+
+            // Copy the transaction array from user space to kernel space
+            size = batch_trans.num_transactions *
+                   sizeof(batch_trans.transactions[0]);
+            trans_array = kmalloc(size, GFP_KERNEL);
+            if (trans_array == NULL) {
+                axidma_err("Unable to allocate array for the transactions.\n");
+                return -ENOMEM;
+            }
+            if (copy_from_user(trans_array, batch_trans.transactions,
+                               size) != 0) {
+                axidma_err("Unable to copy the transaction array from "
+                           "userspace for AXIDMA_DMA_SUBMIT_BATCH.\n");
+                kfree(trans_array);
+                return -EFAULT;
+            }
+
+            rc = axidma_batch_transfer(ctx, trans_array,
+                                       batch_trans.num_transactions);
+            kfree(trans_array);
             break;
 
         case AXIDMA_DMA_VIDEO_READ:
@@ -479,7 +1994,7 @@ static long axidma_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
                 return -EFAULT;
             }
 
-            rc = axidma_video_transfer(dev, &video_trans, AXIDMA_READ);
+            rc = axidma_video_transfer(ctx, &video_trans, AXIDMA_READ);
             kfree(video_trans.frame_buffers);
             break;
 
@@ -510,7 +2025,7 @@ static long axidma_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
                 return -EFAULT;
             }
 
-            rc = axidma_video_transfer(dev, &video_trans, AXIDMA_WRITE);
+            rc = axidma_video_transfer(ctx, &video_trans, AXIDMA_WRITE);
             kfree(video_trans.frame_buffers);
             break;
 
@@ -519,11 +2034,253 @@ static long axidma_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
                 axidma_err("Unable to channel info from userspace for "
                            "AXIDMA_STOP_DMA_CHANNEL.\n");
             }
-            rc = axidma_stop_channel(dev, &chan_info);
+            rc = axidma_stop_channel(ctx, &chan_info);
             break;
 
         case AXIDMA_UNREGISTER_BUFFER:
-            rc = axidma_put_external(dev, (void *)arg);
+            rc = axidma_put_external(ctx, (void *)arg);
+            break;
+
+        case AXIDMA_SET_CHANNEL_EVENTFD:
+            if (copy_from_user(&chan_eventfd, arg_ptr,
+                               sizeof(chan_eventfd)) != 0) {
+                axidma_err("Unable to copy eventfd info from userspace for "
+                           "AXIDMA_SET_CHANNEL_EVENTFD.\n");
+                return -EFAULT;
+            }
+            rc = axidma_set_eventfd(ctx, &chan_eventfd);
+            break;
+
+        case AXIDMA_DMA_SUBMIT:
+            if (copy_from_user(&submit, arg_ptr, sizeof(submit)) != 0) {
+                axidma_err("Unable to copy transfer info from userspace for "
+                           "AXIDMA_DMA_SUBMIT.\n");
+                return -EFAULT;
+            }
+            rc = axidma_submit_transfer(ctx, &submit);
+            if (rc < 0) {
+                break;
+            }
+
+            // Return the handle for the transfer to the user
+            if (copy_to_user(arg_ptr, &submit, sizeof(submit)) != 0) {
+                axidma_err("Unable to copy transfer handle to userspace for "
+                           "AXIDMA_DMA_SUBMIT.\n");
+                return -EFAULT;
+            }
+            break;
+
+        case AXIDMA_DMA_WAIT:
+            if (copy_from_user(&wait, arg_ptr, sizeof(wait)) != 0) {
+                axidma_err("Unable to copy wait info from userspace for "
+                           "AXIDMA_DMA_WAIT.\n");
+                return -EFAULT;
+            }
+            rc = axidma_wait_handle(ctx, &wait);
+            break;
+
+        case AXIDMA_DMA_POLL:
+            if (copy_from_user(&handle, arg_ptr, sizeof(handle)) != 0) {
+                axidma_err("Unable to copy transfer handle from userspace for "
+                           "AXIDMA_DMA_POLL.\n");
+                return -EFAULT;
+            }
+            rc = axidma_poll_handle(ctx, &handle);
+            break;
+
+        case AXIDMA_DMA_CANCEL:
+            if (copy_from_user(&handle, arg_ptr, sizeof(handle)) != 0) {
+                axidma_err("Unable to copy transfer handle from userspace for "
+                           "AXIDMA_DMA_CANCEL.\n");
+                return -EFAULT;
+            }
+            rc = axidma_cancel_handle(ctx, &handle);
+            break;
+
+        case AXIDMA_SYNC_FOR_CPU:
+            if (copy_from_user(&sync_range, arg_ptr,
+                               sizeof(sync_range)) != 0) {
+                axidma_err("Unable to copy sync range from userspace for "
+                           "AXIDMA_SYNC_FOR_CPU.\n");
+                return -EFAULT;
+            }
+            rc = axidma_sync_buffer(ctx, &sync_range, true);
+            break;
+
+        case AXIDMA_SYNC_FOR_DEVICE:
+            if (copy_from_user(&sync_range, arg_ptr,
+                               sizeof(sync_range)) != 0) {
+                axidma_err("Unable to copy sync range from userspace for "
+                           "AXIDMA_SYNC_FOR_DEVICE.\n");
+                return -EFAULT;
+            }
+            rc = axidma_sync_buffer(ctx, &sync_range, false);
+            break;
+
+        case AXIDMA_PIN_BUFFER:
+            if (copy_from_user(&pin_buf, arg_ptr, sizeof(pin_buf)) != 0) {
+                axidma_err("Unable to copy pinned memory info from userspace "
+                           "for AXIDMA_PIN_BUFFER.\n");
+                return -EFAULT;
+            }
+            rc = axidma_pin_user(ctx, &pin_buf);
+            break;
+
+        case AXIDMA_UNPIN_BUFFER:
+            rc = axidma_unpin_user(ctx, (void *)arg);
+            break;
+
+        case AXIDMA_START_RX_RING:
+            if (copy_from_user(&rx_ring, arg_ptr, sizeof(rx_ring)) != 0) {
+                axidma_err("Unable to copy receive ring info from userspace "
+                           "for AXIDMA_START_RX_RING.\n");
+                return -EFAULT;
+            }
+            rc = axidma_start_user_rx_ring(ctx, &rx_ring);
+            break;
+
+        case AXIDMA_KICK_RX_RING:
+            rc = axidma_kick_rx_ring(ctx, (int)arg);
+            break;
+
+        case AXIDMA_PREPARE:
+            if (copy_from_user(&prepare, arg_ptr, sizeof(prepare)) != 0) {
+                axidma_err("Unable to copy transfer info from userspace for "
+                           "AXIDMA_PREPARE.\n");
+                return -EFAULT;
+            }
+            rc = axidma_prepare_transfer(ctx, &prepare);
+            if (rc < 0) {
+                break;
+            }
+
+            // Return the id of the prepared transfer to the user
+            if (copy_to_user(arg_ptr, &prepare, sizeof(prepare)) != 0) {
+                axidma_err("Unable to copy prepared transfer id to userspace "
+                           "for AXIDMA_PREPARE.\n");
+                axidma_unprepare_transfer(ctx, prepare.id);
+                return -EFAULT;
+            }
+            break;
+
+        case AXIDMA_START_PREPARED:
+            rc = axidma_start_prepared(ctx, (int)arg);
+            break;
+
+        case AXIDMA_UNPREPARE:
+            rc = axidma_unprepare_transfer(ctx, (int)arg);
+            break;
+
+        case AXIDMA_SET_POLL_BUDGET:
+            if (copy_from_user(&busy_poll, arg_ptr, sizeof(busy_poll)) != 0) {
+                axidma_err("Unable to copy poll budget from userspace for "
+                           "AXIDMA_SET_POLL_BUDGET.\n");
+                return -EFAULT;
+            }
+            rc = axidma_set_poll_budget(ctx, &busy_poll);
+            break;
+
+        case AXIDMA_GET_POLL_STATS:
+            if (copy_from_user(&busy_poll, arg_ptr, sizeof(busy_poll)) != 0) {
+                axidma_err("Unable to copy channel id from userspace for "
+                           "AXIDMA_GET_POLL_STATS.\n");
+                return -EFAULT;
+            }
+            rc = axidma_get_poll_stats(dev, &busy_poll);
+            if (rc < 0) {
+                break;
+            }
+
+            if (copy_to_user(arg_ptr, &busy_poll, sizeof(busy_poll)) != 0) {
+                axidma_err("Unable to copy poll stats to userspace for "
+                           "AXIDMA_GET_POLL_STATS.\n");
+                return -EFAULT;
+            }
+            break;
+
+        case AXIDMA_SET_CHANNEL_CONFIG:
+            if (copy_from_user(&chan_config, arg_ptr,
+                               sizeof(chan_config)) != 0) {
+                axidma_err("Unable to copy channel tunables from userspace "
+                           "for AXIDMA_SET_CHANNEL_CONFIG.\n");
+                return -EFAULT;
+            }
+            rc = axidma_set_channel_config(dev, ctx, &chan_config);
+            break;
+
+        case AXIDMA_GET_CHANNEL_CONFIG:
+            if (copy_from_user(&chan_config, arg_ptr,
+                               sizeof(chan_config)) != 0) {
+                axidma_err("Unable to copy channel id from userspace for "
+                           "AXIDMA_GET_CHANNEL_CONFIG.\n");
+                return -EFAULT;
+            }
+            rc = axidma_get_channel_config(dev, &chan_config);
+            if (rc < 0) {
+                break;
+            }
+
+            if (copy_to_user(arg_ptr, &chan_config,
+                             sizeof(chan_config)) != 0) {
+                axidma_err("Unable to copy channel tunables to userspace for "
+                           "AXIDMA_GET_CHANNEL_CONFIG.\n");
+                return -EFAULT;
+            }
+            break;
+
+        case AXIDMA_GET_STATS:
+            if (copy_from_user(&chan_stats.channel_id, arg_ptr,
+                               sizeof(chan_stats.channel_id)) != 0) {
+                axidma_err("Unable to copy channel id from userspace for "
+                           "AXIDMA_GET_STATS.\n");
+                return -EFAULT;
+            }
+            rc = axidma_get_stats(dev, &chan_stats);
+            if (rc < 0) {
+                break;
+            }
+
+            if (copy_to_user(arg_ptr, &chan_stats, sizeof(chan_stats)) != 0) {
+                axidma_err("Unable to copy channel statistics to userspace "
+                           "for AXIDMA_GET_STATS.\n");
+                return -EFAULT;
+            }
+            break;
+
+        case AXIDMA_CLAIM_CHANNEL:
+            rc = axidma_claim_channel(ctx, (int)arg);
+            break;
+
+        case AXIDMA_RELEASE_CHANNEL:
+            rc = axidma_release_channel(ctx, (int)arg);
+            break;
+
+        case AXIDMA_EXPORT_BUFFER:
+            if (copy_from_user(&export, arg_ptr, sizeof(export)) != 0) {
+                axidma_err("Unable to copy buffer address from userspace for "
+                           "AXIDMA_EXPORT_BUFFER.\n");
+                return -EFAULT;
+            }
+            rc = axidma_export_buffer(ctx, &export);
+            if (rc < 0) {
+                break;
+            }
+
+            // Return the dma-buf to the user
+            if (copy_to_user(arg_ptr, &export, sizeof(export)) != 0) {
+                axidma_err("Unable to copy the dma-buf to userspace for "
+                           "AXIDMA_EXPORT_BUFFER.\n");
+                return -EFAULT;
+            }
+            break;
+
+        case AXIDMA_START_FORWARD:
+            if (copy_from_user(&forward, arg_ptr, sizeof(forward)) != 0) {
+                axidma_err("Unable to copy forwarding info from userspace for "
+                           "AXIDMA_START_FORWARD.\n");
+                return -EFAULT;
+            }
+            rc = axidma_start_forward(ctx, &forward);
             break;
 
         // Invalid command (already handled in preamble)
@@ -540,66 +2297,366 @@ static const struct file_operations axidma_fops = {
     .open = axidma_open,
     .release = axidma_release,
     .mmap = axidma_mmap,
+    .poll = axidma_poll,
     .unlocked_ioctl = axidma_ioctl,
 };
 
 /*----------------------------------------------------------------------------
- * Initialization and Cleanup
+ * Sysfs Attributes
  *----------------------------------------------------------------------------*/
 
-int axidma_chrdev_init(struct axidma_device *dev)
+/* A tunable of a channel, shown as a file in the channel's sysfs directory.
+ * Each file reads and writes one field of the channel's tunables. */
+struct axidma_config_attr {
+    struct kobj_attribute attr;     // The sysfs attribute for the file
+    size_t offset;                  // The offset of the field in the tunables
+};
+
+/* Gets the device and channel id that a channel's sysfs directory is for. The
+ * directory is under the character device, which holds the device. */
+static int axidma_kobj_channel(struct kobject *kobj,
+                               struct axidma_device **dev)
+{
+    int i;
+
+    *dev = dev_get_drvdata(kobj_to_dev(kobj->parent));
+    for (i = 0; i < (*dev)->num_chans; i++)
+    {
+        if ((*dev)->chan_kobjs[i] == kobj) {
+            return (*dev)->channels[i].channel_id;
+        }
+    }
+
+    return -1;
+}
+
+static ssize_t axidma_config_show(struct kobject *kobj,
+        struct kobj_attribute *attr, char *buf)
+{
+    int rc;
+    struct axidma_device *dev;
+    struct axidma_config_attr *config_attr;
+    struct axidma_channel_config config;
+
+    config_attr = container_of(attr, struct axidma_config_attr, attr);
+    config.channel_id = axidma_kobj_channel(kobj, &dev);
+    rc = axidma_get_channel_config(dev, &config);
+    if (rc < 0) {
+        return rc;
+    }
+
+    return scnprintf(buf, PAGE_SIZE, "%u\n",
+                     *(u32 *)((char *)&config + config_attr->offset));
+}
+
+static ssize_t axidma_config_store(struct kobject *kobj,
+        struct kobj_attribute *attr, const char *buf, size_t count)
 {
     int rc;
+    u32 value;
+    struct axidma_device *dev;
+    struct axidma_config_attr *config_attr;
+    struct axidma_channel_config config;
+
+    rc = kstrtou32(buf, 0, &value);
+    if (rc < 0) {
+        return rc;
+    }
+
+    // Change only the one tunable, keeping the others as they are
+    config_attr = container_of(attr, struct axidma_config_attr, attr);
+    config.channel_id = axidma_kobj_channel(kobj, &dev);
+    rc = axidma_get_channel_config(dev, &config);
+    if (rc < 0) {
+        return rc;
+    }
+    *(u32 *)((char *)&config + config_attr->offset) = value;
+    rc = axidma_set_channel_config(dev, NULL, &config);
+
+    return (rc < 0) ? rc : count;
+}
+
+#define AXIDMA_CONFIG_ATTR(_name) \
+    struct axidma_config_attr axidma_attr_##_name = { \
+        .attr = __ATTR(_name, 0644, axidma_config_show, axidma_config_store), \
+        .offset = offsetof(struct axidma_channel_config, _name), \
+    }
+
+static AXIDMA_CONFIG_ATTR(irq_threshold);
+static AXIDMA_CONFIG_ATTR(irq_delay_us);
+static AXIDMA_CONFIG_ATTR(timeout_ms);
+static AXIDMA_CONFIG_ATTR(queue_depth);
+
+static struct attribute *axidma_config_attrs[] = {
+    &axidma_attr_irq_threshold.attr.attr,
+    &axidma_attr_irq_delay_us.attr.attr,
+    &axidma_attr_timeout_ms.attr.attr,
+    &axidma_attr_queue_depth.attr.attr,
+    NULL,
+};
+
+static const struct attribute_group axidma_config_group = {
+    .attrs = axidma_config_attrs,
+};
+
+// Removes the sysfs directories for the first num_chans channels
+static void axidma_sysfs_exit(struct axidma_device *dev, int num_chans)
+{
+    int i;
+
+    for (i = 0; i < num_chans; i++)
+    {
+        kobject_put(dev->chan_kobjs[i]);
+    }
+    kfree(dev->chan_kobjs);
+
+    return;
+}
+
+/* Creates a directory for each channel under the character device, named
+ * after the channel's id, holding a file for each of its tunables. */
+static int axidma_sysfs_init(struct axidma_device *dev)
+{
+    int i, rc;
+    char name[32];
+    struct kobject *kobj;
+
+    dev->chan_kobjs = kcalloc(dev->num_chans, sizeof(dev->chan_kobjs[0]),
+                              GFP_KERNEL);
+    if (dev->chan_kobjs == NULL) {
+        axidma_err("Unable to allocate the channel sysfs directories.\n");
+        return -ENOMEM;
+    }
+
+    for (i = 0; i < dev->num_chans; i++)
+    {
+        snprintf(name, sizeof(name), "channel%d",
+                 dev->channels[i].channel_id);
+        kobj = kobject_create_and_add(name, &dev->device->kobj);
+        if (kobj == NULL) {
+            axidma_err("Unable to create the sysfs directory %s.\n", name);
+            rc = -ENOMEM;
+            goto remove_kobjs;
+        }
+
+        rc = sysfs_create_group(kobj, &axidma_config_group);
+        if (rc < 0) {
+            axidma_err("Unable to create the sysfs files in %s.\n", name);
+            kobject_put(kobj);
+            goto remove_kobjs;
+        }
+        dev->chan_kobjs[i] = kobj;
+    }
+
+    return 0;
+
+remove_kobjs:
+    axidma_sysfs_exit(dev, i);
+    return rc;
+}
 
-    // Store a global pointer to the axidma device
-    axidma_dev = dev;
+/*----------------------------------------------------------------------------
+ * Debugfs Statistics
+ *----------------------------------------------------------------------------*/
+
+// Prints the statistics of every channel, with the non-empty latency buckets
+static int axidma_stats_show(struct seq_file *s, void *unused)
+{
+    int i, j;
+    struct axidma_chan *chan;
+    struct axidma_device *dev;
+    struct axidma_channel_stats stats;
+
+    dev = s->private;
+    if (dev->pool != NULL) {
+        seq_printf(s, "reserved memory: %zu of %zu bytes free\n",
+                   gen_pool_avail(dev->pool->gen_pool), dev->pool->size);
+    }
+    for (i = 0; i < dev->num_chans; i++)
+    {
+        chan = &dev->channels[i];
+        stats.channel_id = chan->channel_id;
+        if (axidma_get_stats(dev, &stats) < 0) {
+            continue;
+        }
+
+        seq_printf(s, "channel %d (%s %s, stream %d):\n", chan->channel_id,
+                   (chan->type == AXIDMA_DMA) ? "DMA" : "VDMA",
+                   (chan->dir == AXIDMA_WRITE) ? "transmit" : "receive",
+                   chan->stream_id);
+        seq_printf(s, "  submitted:      %llu\n", stats.submitted);
+        seq_printf(s, "  completed:      %llu\n", stats.completed);
+        seq_printf(s, "  bytes:          %llu\n", stats.bytes);
+        seq_printf(s, "  timeouts:       %llu\n", stats.timeouts);
+        seq_printf(s, "  errors:         %llu\n", stats.errors);
+        seq_printf(s, "  ready_irqs:     %llu\n", stats.ready_irqs);
+        seq_printf(s, "  in_flight:      %u\n", stats.in_flight);
+        seq_printf(s, "  max_in_flight:  %u\n", stats.max_in_flight);
+        seq_puts(s, "  latency_ns:\n");
+        for (j = 0; j < AXIDMA_LATENCY_BUCKETS; j++)
+        {
+            if (stats.latency_hist[j] == 0) {
+                continue;
+            } else if (j == AXIDMA_LATENCY_BUCKETS - 1) {
+                seq_printf(s, "    %llu+: %llu\n", 1ULL << j,
+                           stats.latency_hist[j]);
+            } else {
+                seq_printf(s, "    %llu-%llu: %llu\n", (j == 0) ? 0 : 1ULL << j,
+                           (1ULL << (j + 1)) - 1, stats.latency_hist[j]);
+            }
+        }
+    }
+
+    return 0;
+}
+
+static int axidma_stats_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, axidma_stats_show, inode->i_private);
+}
+
+static const struct file_operations axidma_stats_fops = {
+    .owner = THIS_MODULE,
+    .open = axidma_stats_open,
+    .read = seq_read,
+    .llseek = seq_lseek,
+    .release = single_release,
+};
+
+/* Creates the debugfs directory for the device, named after its device file.
+ * The statistics are only for debugging, so failing to create them
+ * does not stop the driver from loading. */
+static void axidma_debugfs_init(struct axidma_device *dev)
+{
+    dev->debugfs_dir = debugfs_create_dir(dev_name(dev->device), NULL);
+    if (IS_ERR_OR_NULL(dev->debugfs_dir)) {
+        axidma_info("Unable to create the debugfs directory.\n");
+        dev->debugfs_dir = NULL;
+        return;
+    }
+
+    debugfs_create_file("stats", 0444, dev->debugfs_dir, dev,
+                        &axidma_stats_fops);
+    return;
+}
+
+static void axidma_debugfs_exit(struct axidma_device *dev)
+{
+    debugfs_remove_recursive(dev->debugfs_dir);
+    return;
+}
 
-    // Allocate a major and minor number region for the character device
-    rc = alloc_chrdev_region(&dev->dev_num, dev->minor_num, dev->num_devices,
-                             dev->chrdev_name);
+/*----------------------------------------------------------------------------
+ * Initialization and Cleanup
+ *----------------------------------------------------------------------------*/
+
+// Returns the index of a device, so another device can take it
+static void axidma_free_index(int index)
+{
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4,19,0)
+    ida_simple_remove(&axidma_ida, index);
+#else
+    ida_free(&axidma_ida, index);
+#endif
+    return;
+}
+
+int axidma_chrdev_register(const char *name, unsigned int minor_num)
+{
+    int rc;
+
+    // Allocate a major and minor number region for all of the devices
+    rc = alloc_chrdev_region(&axidma_dev_base, minor_num, MAX_DEVICES, name);
     if (rc < 0) {
         axidma_err("Unable to allocate character device region.\n");
-        goto ret;
+        return rc;
     }
 
-    // Create a device class for our device
-    dev->dev_class = class_create(THIS_MODULE, dev->chrdev_name);
-    if (IS_ERR(dev->dev_class)) {
+    // Create a device class for our devices
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,4,0)
+    axidma_class = class_create(name);
+#else
+    axidma_class = class_create(THIS_MODULE, name);
+#endif
+    if (IS_ERR(axidma_class)) {
         axidma_err("Unable to create a device class.\n");
-        rc = PTR_ERR(dev->dev_class);
-        goto free_chrdev_region;
+        unregister_chrdev_region(axidma_dev_base, MAX_DEVICES);
+        return PTR_ERR(axidma_class);
+    }
+
+    axidma_chrdev_name = name;
+    return 0;
+}
+
+void axidma_chrdev_unregister(void)
+{
+    class_destroy(axidma_class);
+    unregister_chrdev_region(axidma_dev_base, MAX_DEVICES);
+    ida_destroy(&axidma_ida);
+    return;
+}
+
+int axidma_chrdev_init(struct axidma_device *dev)
+{
+    int rc;
+
+    // Carve the buffers out of the device's reserved memory, if it has any
+    rc = axidma_pool_init(dev);
+    if (rc < 0) {
+        goto ret;
     }
 
-    /* Create a device for our module. This will create a file on the
-     * filesystem, under "/dev/dev->chrdev_name". */
-    dev->device = device_create(dev->dev_class, NULL, dev->dev_num, NULL,
-                                dev->chrdev_name);
+    // Take the lowest free index for the device
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4,19,0)
+    rc = ida_simple_get(&axidma_ida, 0, MAX_DEVICES, GFP_KERNEL);
+#else
+    rc = ida_alloc_max(&axidma_ida, MAX_DEVICES - 1, GFP_KERNEL);
+#endif
+    if (rc < 0) {
+        axidma_err("Unable to allocate an index for the device, at most %d "
+                   "devices are supported.\n", MAX_DEVICES);
+        goto pool_cleanup;
+    }
+    dev->index = rc;
+    dev->dev_num = MKDEV(MAJOR(axidma_dev_base),
+                         MINOR(axidma_dev_base) + dev->index);
+
+    /* Create a device for the platform device. This will create a file on the
+     * filesystem, under "/dev/<chrdev_name><index>". The device holds ours, so
+     * that its sysfs attributes can find it. */
+    dev->device = device_create(axidma_class, &dev->pdev->dev, dev->dev_num,
+                                dev, "%s%d", axidma_chrdev_name, dev->index);
     if (IS_ERR(dev->device)) {
         axidma_err("Unable to create a device.\n");
         rc = PTR_ERR(dev->device);
-        goto class_cleanup;
+        goto free_index;
     }
 
     // Register our character device with the kernel
     cdev_init(&dev->chrdev, &axidma_fops);
-    rc = cdev_add(&dev->chrdev, dev->dev_num, dev->num_devices);
+    rc = cdev_add(&dev->chrdev, dev->dev_num, 1);
     if (rc < 0) {
         axidma_err("Unable to add a character device.\n");
         goto device_cleanup;
     }
 
-    // Initialize the list for DMA mmap'ed allocations
-    INIT_LIST_HEAD(&dev->dmabuf_list);
-    INIT_LIST_HEAD(&dev->external_dmabufs);
+    // Create a sysfs directory for the tunables of each channel
+    rc = axidma_sysfs_init(dev);
+    if (rc < 0) {
+        goto cdev_cleanup;
+    }
+    axidma_debugfs_init(dev);
 
     return 0;
 
+cdev_cleanup:
+    cdev_del(&dev->chrdev);
 device_cleanup:
-    device_destroy(dev->dev_class, dev->dev_num);
-class_cleanup:
-    class_destroy(dev->dev_class);
-free_chrdev_region:
-    unregister_chrdev_region(dev->dev_num, dev->num_devices);
+    device_destroy(axidma_class, dev->dev_num);
+free_index:
+    axidma_free_index(dev->index);
+pool_cleanup:
+    axidma_pool_exit(dev);
 ret:
     return rc;
 }
@@ -607,10 +2664,12 @@ ret:
 void axidma_chrdev_exit(struct axidma_device *dev)
 {
     // Cleanup all related character device structures
+    axidma_debugfs_exit(dev);
+    axidma_sysfs_exit(dev, dev->num_chans);
     cdev_del(&dev->chrdev);
-    device_destroy(dev->dev_class, dev->dev_num);
-    class_destroy(dev->dev_class);
-    unregister_chrdev_region(dev->dev_num, dev->num_devices);
+    device_destroy(axidma_class, dev->dev_num);
+    axidma_free_index(dev->index);
+    axidma_pool_exit(dev);
 
     return;
 }
@@ -26,6 +26,15 @@
 #include <linux/errno.h>            // Linux error codes
 #include <linux/platform_device.h>  // Platform device definitions
 #include <linux/device.h>           // Device definitions and functions
+#include <linux/ktime.h>            // Monotonic timestamp functions
+#include <linux/eventfd.h>          // Eventfd signaling functions
+#include <linux/mutex.h>            // Mutex definitions and functions
+#include <linux/kref.h>             // Reference counting functions
+#include <linux/atomic.h>           // Atomic counter functions
+#include <linux/hrtimer.h>          // High resolution timer functions
+#include <linux/log2.h>             // Integer logarithm functions
+#include <linux/interrupt.h>        // Interrupt request functions
+#include <linux/io.h>               // Register mapping and access functions
 
 /* Between 3.x and 4.x, the path to Xilinx's DMA include file changes. However,
  * in some 4.x kernels, the path is still the old one from 3.x. The macro is
@@ -40,26 +49,44 @@
 #include "axidma.h"                 // Internal definitions
 #include "axidma_ioctl.h"           // IOCTL interface definition and types
 
+// The tracepoints are defined in this file, and only used here
+#define CREATE_TRACE_POINTS
+#include "axidma_trace.h"           // Transfer lifecycle tracepoints
+
 /*----------------------------------------------------------------------------
  * Internal Definitions
  *----------------------------------------------------------------------------*/
 
-// The default timeout for DMA is 10 seconds
-#define AXIDMA_DMA_TIMEOUT      20000
+/* The number of scatter-gather entries kept inline for a transfer. Pinned user
+ * memory needs one entry per physically contiguous chunk, and transfers that
+ * need more entries than this allocate their list. */
+#define AXIDMA_INLINE_SG_LEN    4
+
+// The scatter-gather list for a transfer on a user buffer
+struct axidma_sg {
+    int sg_len;                     // The number of entries in the list
+    struct scatterlist *sg_list;    // The list, inline or allocated
+    struct scatterlist inline_sg[AXIDMA_INLINE_SG_LEN]; // Inline entries
+};
 
 // A convenient structure to pass between prep and start transfer functions
 struct axidma_transfer {
     int sg_len;                     // The length of the BD array
     struct scatterlist *sg_list;    // List of buffer descriptors
     bool wait;                      // Indicates if we should wait
+    bool reap;                      // Indicates if the record is kept to reap
     dma_cookie_t cookie;            // The DMA cookie for the transfer
-    struct completion comp;         // A completion to use for waiting
     enum axidma_dir dir;            // The direction of the transfer
     enum axidma_type type;          // The type of the transfer (VDMA/DMA)
     int channel_id;                 // The ID of the channel
     int notify_signal;              // The signal to use for async transfers
     struct task_struct *process;    // The process requesting the transfer
-    struct axidma_cb_data *cb_data; // The callback data struct
+    struct axidma_context *ctx;     // The file requesting the transfer
+    struct axidma_cb_data *cb_data; // The callback data, taken from the pool
+    u64 user_tag;                   // The tag to report on completion
+    const u32 *app;                 // The APP words to send with the packet
+    void *buf;                      // The user buffer, or NULL for several
+    size_t buf_len;                 // The length of the user buffer
 
     // VDMA specific fields (kept as union for extensability)
     union {
@@ -67,12 +94,131 @@ struct axidma_transfer {
     };
 };
 
-// The data to pass to the DMA transfer completion callback function
+/* The data to pass to the DMA transfer completion callback function. One of
+ * these is taken from the channel's pool for every transfer in flight. */
 struct axidma_cb_data {
+    struct list_head list;          // Node in the queue's free or active list
+    struct axidma_queue *queue;     // The queue this record belongs to
     int channel_id;                 // The id of the channel used
+    bool wait;                      // Indicates if a thread waits on this
+    bool reap;                      // Kept until reaped by its cookie
+    bool done;                      // Indicates if the transfer has finished
+    int status;                     // The result of the transfer
     int notify_signal;              // For async, signal to send
     struct task_struct *process;    // The process to send the signal to
-    struct completion *comp;        // For sync, the notification to kernel
+    struct axidma_context *ctx;     // The file the transfer belongs to
+    struct completion comp;         // For sync, the notification to kernel
+    dma_cookie_t cookie;            // The DMA cookie for the transfer
+    u64 user_tag;                   // For async, tag to report on completion
+    size_t length;                  // The number of bytes in the transfer
+    dma_addr_t dma_addr;            // The DMA address the transfer starts at
+    void *buf;                      // The user buffer, or NULL for several
+    size_t buf_len;                 // The length of the user buffer
+    u64 submit_ns;                  // The time the transfer was submitted
+    u64 complete_ns;                // The time the transfer finished
+    struct dma_async_tx_descriptor *txnd;   // The descriptor, for metadata
+    bool app_valid;                 // Indicates if the APP words were read
+    u32 app[AXIDMA_NUM_APP_WORDS];  // The APP words of a received packet
+    bool held;                      // Kept from the engine until data-ready
+    struct axidma_sg sg;            // The list of a held receive
+};
+
+/* The transfer queue for a channel. The callback records are preallocated, so
+ * that up to `depth` transfers can be in flight on the channel at once. All of
+ * the state for a channel lives here, under the channel's own locks, so that
+ * threads using different channels never contend with each other. */
+struct axidma_queue {
+    struct axidma_device *dev;      // The device the channel belongs to
+    struct axidma_chan *chan;       // The channel the queue feeds
+    struct mutex submit_lock;       // Orders submissions against flushes
+    spinlock_t lock;                // Protects the lists, records and eventfd
+    struct axidma_context *owner;   // The file that claimed the channel, if any
+    struct axidma_channel_config *config;   // The tunables, under the lock
+    int depth;                      // The number of records in the pool
+    int in_use;                     // The number of records taken from it
+    int deferred;                   // Transfers held back from the engine
+    struct hrtimer issue_timer;     // Starts the transfers held back
+    struct axidma_channel_stats stats;  // The counters, under the lock
+    struct axidma_cb_data *pool;    // The preallocated callback records
+    struct list_head free_list;     // Records available for new transfers
+    struct list_head active_list;   // Records in flight, in submission order
+    struct list_head reap_list;     // Finished records waiting to be reaped
+    wait_queue_head_t wait;         // Woken when a record is added to reap
+    struct eventfd_ctx *eventfd;    // Eventfd bound to the channel, if any
+    struct axidma_context *eventfd_owner;   // The file that bound the eventfd
+    struct axidma_rx_stream *rx_stream;     // The receive ring, if running
+    struct axidma_forward *forward; // The forwarding it is part of, if any
+    int ready_irq;                  // The data-ready interrupt, or 0 if none
+    void __iomem *ready_ack;        // Acknowledges data-ready, or NULL if none
+    int ready_pending;              // Data-ready raised with nothing held
+    u64 poll_budget_ns;             // How long waiters spin before sleeping
+    atomic64_t poll_hits;           // Transfers that finished while spinning
+    atomic64_t poll_misses;         // Transfers that slept after spinning
+    atomic64_t poll_spin_ns;        // The total time spent spinning
+};
+
+/* The state of a receive ring running continuously on a channel. Each slot is
+ * armed with its own descriptor, and the engine fills them in order, so the
+ * slot that finishes is always the one at the producer index. */
+struct axidma_rx_stream {
+    struct axidma_queue *queue;     // The queue of the channel it runs on
+    struct axidma_context *ctx;     // The file that started the ring
+    spinlock_t lock;                // Protects the indices and arming
+    struct axidma_rx_ring *ring;    // The indices shared with userspace
+    void *buf;                      // The user address of the first slot
+    u32 num_slots;                  // The number of slots in the ring
+    size_t slot_size;               // The number of bytes in each slot
+    struct axidma_sg *slots;        // The scatter-gather list for each slot
+    u32 producer;                   // Our copy of the producer index
+    u32 armed;                      // The number of slots ever armed
+    bool stopped;                   // Set once the ring must not be re-armed
+};
+
+/* A slot of a receive channel forwarded to a transmit channel. The slot is
+ * armed on the receive channel, then sent on the transmit channel with the
+ * length that was received, then armed again, and so on. */
+struct axidma_forward_slot {
+    struct axidma_forward *fwd;     // The forwarding the slot is part of
+    struct axidma_sg rx_sg;         // The scatter-gather list for the slot
+    struct axidma_sg tx_sg;         // The list for the bytes to send
+};
+
+/* The state of a receive channel forwarded to a transmit channel. It is
+ * attached to the queues of both channels, and set or cleared only with the
+ * device's forward lock and both of their submit locks held. */
+struct axidma_forward {
+    struct axidma_queue *rx_queue;  // The queue of the receive channel
+    struct axidma_queue *tx_queue;  // The queue of the transmit channel
+    struct axidma_context *ctx;     // The file that started the forwarding
+    spinlock_t lock;                // Serializes the callbacks and stopping
+    void *buf;                      // The user address of the first slot
+    u32 num_slots;                  // The number of slots
+    size_t slot_size;               // The number of bytes in each slot
+    size_t max_length;              // The most bytes to forward, or 0 for all
+    struct axidma_forward_slot *slots;  // The state of each slot
+    bool stopped;                   // Set once no slot may be re-armed
+};
+
+// The per-transaction state for a batch of transfers
+struct axidma_batch_entry {
+    struct axidma_chan *chan;       // The channel the transfer is on
+    struct axidma_queue *queue;     // The transfer queue for the channel
+    struct axidma_sg sg;            // The scatter-gather list for the buffer
+    struct axidma_transfer tfr;     // The transfer structure for the engine
+};
+
+/* A transfer prepared once and started repeatedly. The channel is looked up
+ * and the scatter-gather list is built only when the transfer is prepared, or
+ * again after a buffer is removed, since its address may no longer be valid.
+ * A start holds a reference, so that an unprepare can run at the same time. */
+struct axidma_prepared {
+    struct kref ref;                // Held by the table and each start
+    struct mutex lock;              // Protects the list while it is used
+    struct axidma_chan *chan;       // The channel the transfer is on
+    struct axidma_queue *queue;     // The transfer queue for the channel
+    struct axidma_transaction trans;    // The transfer as given by the user
+    struct axidma_sg sg;            // The scatter-gather list for the buffer
+    unsigned long buffers_gen;      // The buffer generation the list is from
 };
 
 /*----------------------------------------------------------------------------
@@ -102,13 +248,13 @@ static enum dma_transfer_direction axidma_to_dma_dir(enum axidma_dir dma_dir)
  * DMA Operations Helper Functions
  *----------------------------------------------------------------------------*/
 
-static int axidma_init_sg_entry(struct axidma_device *dev,
+static int axidma_init_sg_entry(struct axidma_context *ctx,
         struct scatterlist *sg_list, int index, void *buf, size_t buf_len)
 {
     dma_addr_t dma_addr;
 
     // Get the DMA address from the user virtual address
-    dma_addr = axidma_uservirt_to_dma(dev, buf, buf_len);
+    dma_addr = axidma_uservirt_to_dma(ctx, buf, buf_len);
     if (dma_addr == (dma_addr_t)NULL) {
         axidma_err("Requested transfer address %p does not fall within a "
                    "previously allocated DMA buffer.\n", buf);
@@ -122,6 +268,73 @@ static int axidma_init_sg_entry(struct axidma_device *dev,
     return 0;
 }
 
+/* Builds the scatter-gather list for a transfer on the given user buffer. The
+ * list must be freed with axidma_free_sg once the transfer is prepared. The
+ * buffer lock must be held for reading until the transfer is submitted, so
+ * that the buffer cannot be removed in between. */
+static int axidma_init_sg(struct axidma_context *ctx, struct axidma_sg *sg,
+                          void *buf, size_t buf_len)
+{
+    int sg_len;
+
+    // Try the inline entries first, since most buffers need only one
+    sg->sg_list = sg->inline_sg;
+    sg_init_table(sg->sg_list, AXIDMA_INLINE_SG_LEN);
+    sg_len = axidma_uservirt_to_sg(ctx, buf, buf_len, sg->sg_list,
+                                   AXIDMA_INLINE_SG_LEN);
+    if (sg_len <= AXIDMA_INLINE_SG_LEN) {
+        sg->sg_len = sg_len;
+        return (sg_len < 0) ? sg_len : 0;
+    }
+
+    // Otherwise, allocate a list that is large enough
+    sg->sg_list = kmalloc_array(sg_len, sizeof(sg->sg_list[0]), GFP_KERNEL);
+    if (sg->sg_list == NULL) {
+        axidma_err("Unable to allocate the scatter-gather list.\n");
+        return -ENOMEM;
+    }
+    sg_init_table(sg->sg_list, sg_len);
+    sg->sg_len = axidma_uservirt_to_sg(ctx, buf, buf_len, sg->sg_list, sg_len);
+    return 0;
+}
+
+static void axidma_free_sg(struct axidma_sg *sg)
+{
+    if (sg->sg_list != sg->inline_sg) {
+        kfree(sg->sg_list);
+    }
+    return;
+}
+
+/* Copies a scatter-gather list, for a transfer that is prepared after the list
+ * it was built from is freed. The copy must be freed with axidma_free_sg. */
+static int axidma_copy_sg(struct axidma_sg *sg, struct scatterlist *sg_list,
+                          int sg_len)
+{
+    int i;
+
+    if (sg_len <= AXIDMA_INLINE_SG_LEN) {
+        sg->sg_list = sg->inline_sg;
+        sg_init_table(sg->sg_list, AXIDMA_INLINE_SG_LEN);
+    } else {
+        sg->sg_list = kmalloc_array(sg_len, sizeof(sg->sg_list[0]),
+                                    GFP_KERNEL);
+        if (sg->sg_list == NULL) {
+            axidma_err("Unable to allocate the scatter-gather list.\n");
+            return -ENOMEM;
+        }
+        sg_init_table(sg->sg_list, sg_len);
+    }
+
+    for (i = 0; i < sg_len; i++)
+    {
+        sg_dma_address(&sg->sg_list[i]) = sg_dma_address(&sg_list[i]);
+        sg_dma_len(&sg->sg_list[i]) = sg_dma_len(&sg_list[i]);
+    }
+    sg->sg_len = sg_len;
+    return 0;
+}
+
 static struct axidma_chan *axidma_get_chan(struct axidma_device *dev,
         int channel_id)
 {
@@ -140,27 +353,490 @@ static struct axidma_chan *axidma_get_chan(struct axidma_device *dev,
     return NULL;
 }
 
-static void axidma_dma_callback(void *data)
+/* Checks that the APP words of a receive can be reported, if the transaction
+ * asks for them. They are only reported in the completion ring, and only read
+ * on kernels whose engine driver exposes the descriptor metadata. */
+static int axidma_check_rx_app(struct axidma_chan *chan, u32 flags, bool wait)
+{
+    if ((flags & AXIDMA_TRANS_RX_APP) == 0) {
+        return 0;
+    } else if (chan->dir != AXIDMA_READ || chan->type != AXIDMA_DMA) {
+        axidma_err("Only DMA receive channels report received APP words.\n");
+        return -EINVAL;
+    } else if (wait) {
+        axidma_err("Received APP words are only reported for asynchronous "
+                   "transfers.\n");
+        return -EOPNOTSUPP;
+    }
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,6,0)
+    if (dmaengine_is_metadata_mode_supported(chan->chan,
+                                             DESC_METADATA_ENGINE)) {
+        return 0;
+    }
+#endif
+    axidma_err("Channel %d cannot report the APP words of received packets.\n",
+               chan->channel_id);
+    return -EOPNOTSUPP;
+}
+
+// Gets the transfer queue that feeds the given channel
+static struct axidma_queue *axidma_get_queue(struct axidma_device *dev,
+        struct axidma_chan *chan)
+{
+    return &dev->queues[chan - dev->channels];
+}
+
+/* Checks that the file can use the channel, which it can unless another file
+ * has claimed the channel for itself. */
+static int axidma_check_claim(struct axidma_context *ctx,
+                              struct axidma_queue *queue)
+{
+    bool claimed;
+    unsigned long flags;
+
+    spin_lock_irqsave(&queue->lock, flags);
+    claimed = (queue->owner != NULL && queue->owner != ctx);
+    spin_unlock_irqrestore(&queue->lock, flags);
+
+    if (claimed) {
+        axidma_err("Channel %d is claimed by another file.\n",
+                   queue->chan->channel_id);
+        return -EBUSY;
+    }
+    return 0;
+}
+
+/* Counts a transfer handed to the engine. The queue lock must be held. */
+static void axidma_stats_submit(struct axidma_queue *queue)
+{
+    struct axidma_channel_stats *stats;
+
+    stats = &queue->stats;
+    stats->submitted += 1;
+    stats->in_flight += 1;
+    stats->max_in_flight = max(stats->max_in_flight, stats->in_flight);
+    return;
+}
+
+/* Counts a transfer that the engine is done with, successfully or not. Only
+ * successful transfers are added to the latency histogram. The queue lock must
+ * be held. */
+static void axidma_stats_finish(struct axidma_queue *queue,
+                                struct axidma_cb_data *cb_data)
+{
+    int bucket;
+    u64 latency_ns;
+    struct axidma_channel_stats *stats;
+
+    stats = &queue->stats;
+    stats->in_flight -= 1;
+    if (cb_data->status < 0) {
+        stats->errors += 1;
+        return;
+    }
+
+    stats->completed += 1;
+    stats->bytes += cb_data->length;
+    latency_ns = cb_data->complete_ns - cb_data->submit_ns;
+    bucket = (latency_ns == 0) ? 0 : ilog2(latency_ns);
+    bucket = min(bucket, AXIDMA_LATENCY_BUCKETS - 1);
+    stats->latency_hist[bucket] += 1;
+    return;
+}
+
+/* Takes a callback record from the channel's pool for a new transfer. Returns
+ * NULL if the channel already has the maximum number of transfers in flight,
+ * which is the channel's queue depth, and not always the size of the pool. */
+static struct axidma_cb_data *axidma_queue_get(struct axidma_queue *queue)
+{
+    unsigned long flags;
+    struct axidma_cb_data *cb_data;
+
+    spin_lock_irqsave(&queue->lock, flags);
+    cb_data = NULL;
+    if (queue->in_use < queue->config->queue_depth) {
+        cb_data = list_first_entry_or_null(&queue->free_list,
+                                           struct axidma_cb_data, list);
+    }
+    if (cb_data != NULL) {
+        list_del(&cb_data->list);
+        queue->in_use += 1;
+    }
+    spin_unlock_irqrestore(&queue->lock, flags);
+
+    return cb_data;
+}
+
+// Returns a callback record to the channel's pool
+static void axidma_queue_put(struct axidma_queue *queue,
+                             struct axidma_cb_data *cb_data)
+{
+    unsigned long flags;
+
+    spin_lock_irqsave(&queue->lock, flags);
+    list_add(&cb_data->list, &queue->free_list);
+    queue->in_use -= 1;
+    spin_unlock_irqrestore(&queue->lock, flags);
+    return;
+}
+
+/* Retires the record of a finished asynchronous transfer. Records that are
+ * reaped by their cookie are kept until userspace collects them, while all
+ * others are returned to the pool. */
+static void axidma_queue_retire(struct axidma_queue *queue,
+                                struct axidma_cb_data *cb_data)
+{
+    bool reap;
+    unsigned long flags;
+
+    spin_lock_irqsave(&queue->lock, flags);
+    reap = cb_data->reap;
+    if (reap) {
+        list_add_tail(&cb_data->list, &queue->reap_list);
+    } else {
+        list_add(&cb_data->list, &queue->free_list);
+        queue->in_use -= 1;
+    }
+    spin_unlock_irqrestore(&queue->lock, flags);
+
+    if (reap) {
+        wake_up_interruptible(&queue->wait);
+    }
+    return;
+}
+
+/* Finds the record of a transfer that is reaped by its cookie, either still in
+ * flight or waiting to be reaped. Only the file that submitted the transfer
+ * can find it. The queue lock must be held. */
+static struct axidma_cb_data *axidma_queue_find(struct axidma_queue *queue,
+        struct axidma_context *ctx, dma_cookie_t cookie)
 {
     struct axidma_cb_data *cb_data;
+
+    list_for_each_entry(cb_data, &queue->active_list, list)
+    {
+        if (cb_data->reap && cb_data->ctx == ctx && cb_data->cookie == cookie) {
+            return cb_data;
+        }
+    }
+    list_for_each_entry(cb_data, &queue->reap_list, list)
+    {
+        if (cb_data->ctx == ctx && cb_data->cookie == cookie) {
+            return cb_data;
+        }
+    }
+
+    return NULL;
+}
+
+/* Posts a completion entry for an asynchronous transfer to the completion
+ * ring of the file that submitted it. Returns false if the file has no
+ * completion ring mapped. */
+static bool axidma_post_completion(struct axidma_cb_data *cb_data)
+{
+    u32 head;
+    unsigned long flags;
+    struct axidma_context *ctx;
+    struct axidma_completion_ring *ring;
+    struct axidma_completion *entry;
+
+    ctx = cb_data->ctx;
+    spin_lock_irqsave(&ctx->notify_lock, flags);
+    ring = ctx->ring;
+    if (ring == NULL) {
+        spin_unlock_irqrestore(&ctx->notify_lock, flags);
+        return false;
+    }
+
+    /* Only trust our own copies of the head and size, since userspace can
+     * write anywhere in the ring. If the consumer has fallen behind, drop the
+     * completion rather than overwrite entries it has not read yet. */
+    head = ctx->ring_head;
+    if (head - smp_load_acquire(&ring->tail) >= ctx->ring_entries) {
+        ring->dropped += 1;
+        spin_unlock_irqrestore(&ctx->notify_lock, flags);
+        return true;
+    }
+
+    entry = &ring->entries[head % ctx->ring_entries];
+    entry->user_tag = cb_data->user_tag;
+    entry->submit_ns = cb_data->submit_ns;
+    entry->complete_ns = cb_data->complete_ns;
+    entry->length = cb_data->length;
+    entry->status = cb_data->status;
+    entry->channel_id = cb_data->channel_id;
+    memcpy(entry->app, cb_data->app, sizeof(entry->app));
+    entry->flags = cb_data->app_valid ? AXIDMA_COMPLETION_APP_VALID : 0;
+    entry->reserved = 0;
+
+    // Publish the entry only after all of its fields are visible
+    ctx->ring_head = head + 1;
+    smp_store_release(&ring->head, ctx->ring_head);
+    spin_unlock_irqrestore(&ctx->notify_lock, flags);
+
+    // Wake up anyone polling on the file for completions
+    wake_up_interruptible(&ctx->completion_wait);
+    return true;
+}
+
+/* Signals the eventfd bound to the channel, if it was bound by the given file.
+ * Returns false if the file has no eventfd bound to the channel. */
+static bool axidma_signal_eventfd(struct axidma_queue *queue,
+                                  struct axidma_context *ctx)
+{
+    bool signaled;
+    unsigned long flags;
+
+    spin_lock_irqsave(&queue->lock, flags);
+    signaled = (queue->eventfd != NULL && queue->eventfd_owner == ctx);
+    if (signaled) {
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6,8,0)
+        eventfd_signal(queue->eventfd, 1);
+#else
+        eventfd_signal(queue->eventfd);
+#endif
+    }
+    spin_unlock_irqrestore(&queue->lock, flags);
+
+    return signaled;
+}
+
+/* Reports a finished transfer to userspace. For synchronous transfers, this
+ * wakes the waiting thread, which returns the record to the pool. For
+ * asynchronous transfers, the completion is posted to the completion ring and
+ * the channel's eventfd, or a signal is sent if neither is setup, and the
+ * record is retired. The file is not touched once its count of transfers yet
+ * to be reported drops, since it may be freed as soon as that reaches 0. */
+static void axidma_notify_transfer(struct axidma_cb_data *cb_data)
+{
+    bool notified;
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4,20,0)
     struct siginfo sig_info;
+#else
+    struct kernel_siginfo sig_info;
+#endif
+    struct axidma_context *ctx;
+    struct axidma_device *dev;
+
+    if (cb_data->wait) {
+        complete(&cb_data->comp);
+        return;
+    }
 
-    /* For synchronous transfers, notify the kernel thread waiting. For
-     * asynchronous transfers, send a signal to userspace if requested. */
-    cb_data = data;
-    if (cb_data->comp != NULL) {
-        complete(cb_data->comp);
-    } else if (VALID_NOTIFY_SIGNAL(cb_data->notify_signal)) {
+    notified = axidma_post_completion(cb_data);
+    notified |= axidma_signal_eventfd(cb_data->queue, cb_data->ctx);
+    if (!notified && VALID_NOTIFY_SIGNAL(cb_data->notify_signal)) {
         memset(&sig_info, 0, sizeof(sig_info));
         sig_info.si_signo = cb_data->notify_signal;
         sig_info.si_code = SI_QUEUE;
         sig_info.si_int = cb_data->channel_id;
         send_sig_info(cb_data->notify_signal, &sig_info, cb_data->process);
     }
+
+    ctx = cb_data->ctx;
+    dev = ctx->dev;
+    axidma_queue_retire(cb_data->queue, cb_data);
+    if (atomic_dec_and_test(&ctx->notifying)) {
+        wake_up_all(&dev->notify_wait);
+    }
+    return;
+}
+
+/* Marks a transfer as finished, and retires all of the finished transfers at
+ * the front of the queue. This guarantees that completions are always reported
+ * in the order that the transfers were submitted. The residue is the number of
+ * bytes the engine did not transfer, so a receive that ends early on TLAST
+ * reports the length actually received. */
+static void axidma_finish_transfer(struct axidma_cb_data *cb_data, int status,
+                                   u32 residue)
+{
+    unsigned long flags;
+    struct axidma_queue *queue;
+    struct axidma_cb_data *next;
+    LIST_HEAD(done_list);
+
+    queue = cb_data->queue;
+    spin_lock_irqsave(&queue->lock, flags);
+    cb_data->done = true;
+    cb_data->status = status;
+    cb_data->length -= min_t(size_t, residue, cb_data->length);
+    cb_data->complete_ns = ktime_get_ns();
+    axidma_stats_finish(queue, cb_data);
+    trace_axidma_callback(cb_data->channel_id, cb_data->cookie,
+                          cb_data->length, cb_data->dma_addr, status);
+    list_for_each_entry_safe(cb_data, next, &queue->active_list, list)
+    {
+        if (!cb_data->done) {
+            break;
+        }
+        list_move_tail(&cb_data->list, &done_list);
+    }
+    spin_unlock_irqrestore(&queue->lock, flags);
+
+    // Notify userspace outside of the lock, since this may take other locks
+    list_for_each_entry_safe(cb_data, next, &done_list, list)
+    {
+        list_del(&cb_data->list);
+        axidma_notify_transfer(cb_data);
+    }
+}
+
+/* Copies the APP words of a received packet out of its descriptor. The
+ * engine's driver only guarantees that the descriptor's metadata is valid
+ * while the completion callback runs, so this must be called from it. */
+static void axidma_read_app_words(struct axidma_cb_data *cb_data)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,6,0)
+    void *metadata;
+    size_t payload_len, max_len;
+
+    if (cb_data->txnd == NULL) {
+        return;
+    }
+
+    metadata = dmaengine_desc_get_metadata_ptr(cb_data->txnd, &payload_len,
+                                               &max_len);
+    if (IS_ERR_OR_NULL(metadata)) {
+        return;
+    }
+    memcpy(cb_data->app, metadata, min(max_len, sizeof(cb_data->app)));
+    cb_data->app_valid = true;
+#endif
+    return;
+}
+
+/* Acknowledges a packet received on a channel with a data-ready interrupt, by
+ * pulsing the register that the fabric's handshake watches, so that it can
+ * raise the interrupt for its next packet. Stopped transfers took no packet,
+ * so they are not acknowledged. */
+static void axidma_ready_ack(struct axidma_queue *queue, int status)
+{
+    if (queue->ready_ack == NULL || status == -ECANCELED) {
+        return;
+    }
+
+    iowrite32(1, queue->ready_ack);
+    iowrite32(0, queue->ready_ack);
+    return;
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,13,0)
+/* The DMA callback function, which also receives the result and residue of
+ * the transfer. Engines that do not compute the residue report it as 0. */
+static void axidma_dma_callback(void *data,
+                                const struct dmaengine_result *result)
+{
+    int status;
+
+    switch (result->result) {
+        case DMA_TRANS_NOERROR:
+            status = 0;
+            break;
+        case DMA_TRANS_ABORTED:
+            status = -ECANCELED;
+            break;
+        default:
+            status = -EIO;
+            break;
+    }
+
+    axidma_read_app_words(data);
+    axidma_ready_ack(((struct axidma_cb_data *)data)->queue, status);
+    axidma_finish_transfer(data, status, result->residue);
+}
+#else
+/* The DMA callback function. Older kernels do not report the residue, so the
+ * transfer is assumed to have filled its whole buffer. */
+static void axidma_dma_callback(void *data)
+{
+    axidma_read_app_words(data);
+    axidma_ready_ack(((struct axidma_cb_data *)data)->queue, 0);
+    axidma_finish_transfer(data, 0, 0);
+}
+#endif
+
+/* Stops all transfers on the channel, and moves every transfer that was in
+ * flight to the given list, retired with the given status. The submit lock
+ * must be held, so that no transfers are submitted in between, or their
+ * records would be taken back while the engine still holds them. */
+static void axidma_queue_terminate(struct axidma_queue *queue, int status,
+                                   struct list_head *done_list)
+{
+    bool finished;
+    unsigned long flags;
+    struct axidma_cb_data *cb_data, *next;
+
+    /* Make sure no callbacks are still running before the records are taken
+     * back, since the engine drops its references to them once stopped.
+     * Transfers that were held back, or held for data-ready, are stopped along
+     * with the rest. */
+    hrtimer_cancel(&queue->issue_timer);
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4,6,0)
+    dmaengine_terminate_all(queue->chan->chan);
+#else
+    dmaengine_terminate_sync(queue->chan->chan);
+#endif
+    trace_axidma_terminate(queue->chan->channel_id, queue->chan->chan->cookie,
+                           status);
+
+    spin_lock_irqsave(&queue->lock, flags);
+    queue->deferred = 0;
+    list_for_each_entry_safe(cb_data, next, &queue->active_list, list)
+    {
+        // Receives still held for data-ready never reached the engine
+        if (cb_data->held) {
+            cb_data->held = false;
+            axidma_free_sg(&cb_data->sg);
+        }
+
+        /* Transfers that finished behind an unfinished one keep their own
+         * status, and are counted already */
+        finished = cb_data->done;
+        if (!finished) {
+            cb_data->done = true;
+            cb_data->status = status;
+            cb_data->complete_ns = ktime_get_ns();
+            axidma_stats_finish(queue, cb_data);
+        }
+        list_move_tail(&cb_data->list, done_list);
+    }
+    spin_unlock_irqrestore(&queue->lock, flags);
+
+    return;
+}
+
+// Reports each of the terminated transfers on the list to its file
+static void axidma_notify_terminated(struct list_head *done_list)
+{
+    struct axidma_cb_data *cb_data, *next;
+
+    list_for_each_entry_safe(cb_data, next, done_list, list)
+    {
+        list_del(&cb_data->list);
+        axidma_notify_transfer(cb_data);
+    }
+
+    return;
+}
+
+/* Stops all transfers on the channel, and retires every transfer that was in
+ * flight with the given status. Any threads waiting on them are woken up. */
+static void axidma_queue_flush(struct axidma_queue *queue, int status)
+{
+    LIST_HEAD(done_list);
+
+    mutex_lock(&queue->submit_lock);
+    axidma_queue_terminate(queue, status, &done_list);
+    mutex_unlock(&queue->submit_lock);
+
+    axidma_notify_terminated(&done_list);
+    return;
 }
 
-// Setup the config structure for VDMA
-static void axidma_setup_vdma_config(struct xilinx_vdma_config *dma_config)
+// Setup the config structure for VDMA, interrupting every `coalesc` frames
+static void axidma_setup_vdma_config(struct xilinx_vdma_config *dma_config,
+                                     u32 coalesc)
 {
     memset(dma_config, 0, sizeof(*dma_config));
     dma_config->frm_dly = 0;            // Number of frames to delay
@@ -169,54 +845,171 @@ static void axidma_setup_vdma_config(struct xilinx_vdma_config *dma_config)
     dma_config->frm_cnt_en = 1;         // Interrupt based on frame count
     dma_config->park = 0;               // Continuously process all frames
     dma_config->park_frm = 0;           // Frame to stop (park) at (N/A)
-    dma_config->coalesc = 1;            // Interrupt after one frame completion
+    dma_config->coalesc = coalesc;      // Interrupt after this many frames
     dma_config->delay = 0;              // Disable the delay counter interrupt
     dma_config->reset = 0;              // Don't reset the channel
     dma_config->ext_fsync = 0;          // VDMA handles synchronizes itself
     return;
 }
 
-static int axidma_prep_transfer(struct axidma_chan *axidma_chan,
+/* Points the descriptor's callback at the record of its transfer. The
+ * descriptor of a receive is kept, to read the APP words of its packet when it
+ * completes. */
+static void axidma_attach_callback(struct axidma_queue *queue,
+                                   struct axidma_cb_data *cb_data,
+                                   struct dma_async_tx_descriptor *dma_txnd)
+{
+    cb_data->txnd = NULL;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,6,0)
+    if (queue->chan->type == AXIDMA_DMA && queue->chan->dir == AXIDMA_READ &&
+            dmaengine_is_metadata_mode_supported(queue->chan->chan,
+                                                 DESC_METADATA_ENGINE)) {
+        cb_data->txnd = dma_txnd;
+    }
+#endif
+    dma_txnd->callback_param = cb_data;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,13,0)
+    dma_txnd->callback_result = axidma_dma_callback;
+#else
+    dma_txnd->callback = axidma_dma_callback;
+#endif
+    return;
+}
+
+static int axidma_prep_transfer(struct axidma_queue *queue,
                                 struct axidma_transfer *dma_tfr)
 {
     struct dma_chan *chan;
     struct dma_device *dma_dev;
     struct dma_async_tx_descriptor *dma_txnd;
-    struct completion *dma_comp;
     struct xilinx_vdma_config vdma_config;
     struct axidma_cb_data *cb_data;
     struct dma_interleaved_template dma_template;
     enum dma_transfer_direction dma_dir;
     enum dma_ctrl_flags dma_flags;
     struct scatterlist *sg_list;
+    unsigned long flags;
     int sg_len;
     dma_cookie_t dma_cookie;
     char *direction, *type;
-    int rc;
+    int rc, i;
 
     // Get the fields from the structures
-    chan = axidma_chan->chan;
-    dma_comp = &dma_tfr->comp;
+    chan = queue->chan->chan;
     dma_dir = axidma_to_dma_dir(dma_tfr->dir);
     dma_dev = chan->device;
     sg_list = dma_tfr->sg_list;
     sg_len = dma_tfr->sg_len;
     direction = axidma_dir_to_string(dma_tfr->dir);
     type = axidma_type_to_string(dma_tfr->type);
-    cb_data = dma_tfr->cb_data;
+
+    // The channel cannot be used while another file has claimed it
+    rc = axidma_check_claim(dma_tfr->ctx, queue);
+    if (rc < 0) {
+        return rc;
+    }
+
+    // Take a callback record for the transfer from the channel's pool
+    cb_data = axidma_queue_get(queue);
+    if (cb_data == NULL) {
+        axidma_err("Channel %d already has %u %s %s transfers in flight.\n",
+                   dma_tfr->channel_id, READ_ONCE(queue->config->queue_depth),
+                   type, direction);
+        return -EBUSY;
+    }
 
     /* For VDMA transfers, we configure the channel, then prepare an interlaved
-     * transfer. For DMA, we simply prepare a slave scatter-gather transfer. */
+     * transfer. For DMA, we simply prepare a slave scatter-gather transfer.
+     * The engine copies out the scatter-gather list, so it need not outlive
+     * the preparation. Only submissions to the same channel are serialized. */
+    mutex_lock(&queue->submit_lock);
+    if (queue->rx_stream != NULL) {
+        axidma_err("Channel %d is running a receive ring.\n",
+                   dma_tfr->channel_id);
+        rc = -EBUSY;
+        goto unlock_submit;
+    } else if (queue->forward != NULL) {
+        axidma_err("Channel %d is forwarding.\n", dma_tfr->channel_id);
+        rc = -EBUSY;
+        goto unlock_submit;
+    }
+
+    /* Setup the callback record. Synchronous transfers are completed for the
+     * waiting thread, while asynchronous ones are reported to userspace. */
+    cb_data->channel_id = dma_tfr->channel_id;
+    cb_data->wait = dma_tfr->wait;
+    cb_data->reap = dma_tfr->reap;
+    cb_data->done = false;
+    cb_data->status = 0;
+    cb_data->user_tag = dma_tfr->user_tag;
+    cb_data->ctx = dma_tfr->ctx;
+    cb_data->length = 0;
+    for (i = 0; i < sg_len; i++)
+    {
+        cb_data->length += sg_dma_len(&sg_list[i]);
+    }
+    cb_data->dma_addr = sg_dma_address(&sg_list[0]);
+    cb_data->buf = dma_tfr->buf;
+    cb_data->buf_len = dma_tfr->buf_len;
+    memset(cb_data->app, 0, sizeof(cb_data->app));
+    cb_data->app_valid = false;
+    cb_data->txnd = NULL;
+    cb_data->cookie = 0;
+    cb_data->held = false;
+    trace_axidma_prep(cb_data->channel_id, cb_data->length, cb_data->dma_addr,
+                      sg_len);
+    if (dma_tfr->wait) {
+        cb_data->notify_signal = -1;
+        cb_data->process = NULL;
+        reinit_completion(&cb_data->comp);
+    } else {
+        cb_data->notify_signal = dma_tfr->notify_signal;
+        cb_data->process = dma_tfr->process;
+    }
+
+    /* A receive on a channel with a data-ready interrupt is kept from the
+     * engine until the fabric raises it, since the Xilinx driver starts every
+     * descriptor submitted to the channel whenever a transfer completes. It
+     * keeps its own copy of the list, which is freed once it is prepared. */
+    if (queue->ready_irq > 0) {
+        rc = axidma_copy_sg(&cb_data->sg, sg_list, sg_len);
+        if (rc < 0) {
+            goto unlock_submit;
+        }
+        cb_data->held = true;
+        spin_lock_irqsave(&queue->lock, flags);
+        cb_data->submit_ns = ktime_get_ns();
+        list_add_tail(&cb_data->list, &queue->active_list);
+        if (!cb_data->wait) {
+            atomic_inc(&cb_data->ctx->notifying);
+        }
+        axidma_stats_submit(queue);
+        spin_unlock_irqrestore(&queue->lock, flags);
+        mutex_unlock(&queue->submit_lock);
+
+        // The cookie is only known once the engine has the transfer
+        dma_tfr->cookie = 0;
+        dma_tfr->cb_data = cb_data;
+        return 0;
+    }
+
+    /* The APP words of a transmit are passed as the context of the transfer,
+     * which the Xilinx driver copies into each of its descriptors. */
     dma_flags = DMA_CTRL_ACK | DMA_PREP_INTERRUPT;
-    if (dma_tfr->type == AXIDMA_DMA) {
+    if (dma_tfr->type == AXIDMA_DMA && dma_tfr->dir == AXIDMA_WRITE &&
+            dma_tfr->app != NULL) {
+        dma_txnd = dma_dev->device_prep_slave_sg(chan, sg_list, sg_len,
+                dma_dir, dma_flags, (void *)dma_tfr->app);
+    } else if (dma_tfr->type == AXIDMA_DMA) {
         dma_txnd = dmaengine_prep_slave_sg(chan, sg_list, sg_len, dma_dir,
                                            dma_flags);
     } else {
-        axidma_setup_vdma_config(&vdma_config);
+        axidma_setup_vdma_config(&vdma_config,
+                                 READ_ONCE(queue->config->irq_threshold));
         rc = xilinx_vdma_channel_set_config(chan, &vdma_config);
         if (rc < 0) {
             axidma_err("Unable to set the config for channel.\n");
-            goto stop_dma;
+            goto unlock_submit;
         }
 
         memset(&dma_template, 0, sizeof(dma_template));
@@ -235,323 +1028,2108 @@ static int axidma_prep_transfer(struct axidma_chan *axidma_chan,
         axidma_err("Unable to prepare the dma engine for the %s %s buffer.\n",
                    type, direction);
         rc = -EBUSY;
-        goto stop_dma;
+        goto unlock_submit;
     }
+    axidma_attach_callback(queue, cb_data, dma_txnd);
+    cb_data->submit_ns = ktime_get_ns();
 
-    /* If we're going to wait for this channel, initialize the completion for
-     * the channel, and setup the callback to complete it. */
-    cb_data->channel_id = dma_tfr->channel_id;
-    if (dma_tfr->wait) {
-        cb_data->comp = dma_comp;
-        cb_data->notify_signal = -1;
-        cb_data->process = NULL;
-        init_completion(cb_data->comp);
-        dma_txnd->callback_param = cb_data;
-        dma_txnd->callback = axidma_dma_callback;
-    } else {
-        cb_data->comp = NULL;
-        cb_data->notify_signal = dma_tfr->notify_signal;
-        cb_data->process = dma_tfr->process;
-        dma_txnd->callback_param = cb_data;
-        dma_txnd->callback = axidma_dma_callback;
-    }
+    /* Queue the record and submit the descriptor together, so that the order
+     * of the active list always matches the order of the cookies. */
+    spin_lock_irqsave(&queue->lock, flags);
     dma_cookie = dmaengine_submit(dma_txnd);
     if (dma_submit_error(dma_cookie)) {
+        spin_unlock_irqrestore(&queue->lock, flags);
         axidma_err("Unable to submit the %s %s transaction to the engine.\n",
                    direction, type);
         rc = -EBUSY;
-        goto stop_dma;
+        goto unlock_submit;
+    }
+    cb_data->cookie = dma_cookie;
+    list_add_tail(&cb_data->list, &queue->active_list);
+    if (!cb_data->wait) {
+        atomic_inc(&cb_data->ctx->notifying);
     }
+    axidma_stats_submit(queue);
+    trace_axidma_submit(cb_data->channel_id, dma_cookie, cb_data->length,
+                        cb_data->dma_addr, 0);
+    spin_unlock_irqrestore(&queue->lock, flags);
+    mutex_unlock(&queue->submit_lock);
 
-    // Return the DMA cookie for the transaction
+    // Return the DMA cookie and callback record for the transaction
     dma_tfr->cookie = dma_cookie;
+    dma_tfr->cb_data = cb_data;
     return 0;
 
-stop_dma:
-    dmaengine_terminate_all(chan);
+unlock_submit:
+    mutex_unlock(&queue->submit_lock);
+    axidma_queue_put(queue, cb_data);
     return rc;
 }
 
-static int axidma_start_transfer(struct axidma_chan *chan,
-                                 struct axidma_transfer *dma_tfr)
+/* Spins on the CPU waiting for a synchronous transfer to finish, for up to the
+ * channel's poll budget, in the style of NAPI busy polling. This saves the
+ * sleep and wakeup for transfers that finish quickly. The spin gives up early
+ * if another task needs the CPU. Returns true if the transfer finished. */
+static bool axidma_busy_poll(struct axidma_queue *queue,
+                             struct axidma_cb_data *cb_data)
+{
+    bool done;
+    u64 budget_ns, start_ns, spin_ns;
+
+    budget_ns = READ_ONCE(queue->poll_budget_ns);
+    if (budget_ns == 0) {
+        return false;
+    }
+
+    start_ns = ktime_get_ns();
+    for (;;)
+    {
+        done = completion_done(&cb_data->comp);
+        spin_ns = ktime_get_ns() - start_ns;
+        if (done || spin_ns >= budget_ns || need_resched()) {
+            break;
+        }
+        cpu_relax();
+    }
+
+    atomic64_add(spin_ns, &queue->poll_spin_ns);
+    atomic64_inc(done ? &queue->poll_hits : &queue->poll_misses);
+    return done;
+}
+
+/* Waits for a synchronous transfer to finish, and returns its callback record
+ * to the pool. If the transfer times out, the channel is stopped. On success,
+ * returns the number of bytes actually transferred. */
+static int axidma_wait_transfer(struct axidma_queue *queue,
+                                struct axidma_transfer *dma_tfr)
 {
-    struct completion *dma_comp;
+    struct axidma_cb_data *cb_data;
     dma_cookie_t dma_cookie;
     enum dma_status status;
     char *direction, *type;
-    unsigned long timeout, time_remain;
+    unsigned long timeout, time_remain, flags;
     int rc;
 
     // Get the fields from the structures
-    dma_comp = &dma_tfr->comp;
-    dma_cookie = dma_tfr->cookie;
+    cb_data = dma_tfr->cb_data;
     direction = axidma_dir_to_string(dma_tfr->dir);
     type = axidma_type_to_string(dma_tfr->type);
 
-    // Flush all pending transaction in the dma engine for this channel
-    dma_async_issue_pending(chan->chan);
-
-    // Wait for the completion timeout or the DMA to complete
-    if (dma_tfr->wait) {
-        timeout = msecs_to_jiffies(AXIDMA_DMA_TIMEOUT);
-        time_remain = wait_for_completion_timeout(dma_comp, timeout);
-        status = dma_async_is_tx_complete(chan->chan, dma_cookie, NULL, NULL);
-
-        if (time_remain == 0) {
-            axidma_err("%s %s transaction timed out.\n", type, direction);
-            rc = -ETIME;
-            goto stop_dma;
-        } else if (status != DMA_COMPLETE) {
-            axidma_err("%s %s transaction did not succceed. Status is %d.\n",
-                       type, direction, status);
-            rc = -EBUSY;
-            goto stop_dma;
-        }
+    /* Spin for the transfer first, if the channel allows it, then wait for the
+     * completion timeout or the DMA to complete. If the spin caught the
+     * transfer, the wait returns immediately. */
+    axidma_busy_poll(queue, cb_data);
+    timeout = msecs_to_jiffies(READ_ONCE(queue->config->timeout_ms));
+    time_remain = wait_for_completion_timeout(&cb_data->comp, timeout);
+
+    /* A receive held for data-ready only gets its cookie once the engine has
+     * it, which may be never, if it timed out. */
+    dma_cookie = READ_ONCE(cb_data->cookie);
+    if (time_remain != 0) {
+        trace_axidma_wake(cb_data->channel_id, dma_cookie, cb_data->length,
+                          cb_data->dma_addr, cb_data->status);
     }
-
+    status = dma_async_is_tx_complete(queue->chan->chan, dma_cookie, NULL,
+                                      NULL);
+
+    rc = 0;
+    if (time_remain == 0) {
+        trace_axidma_timeout(cb_data->channel_id, dma_cookie, cb_data->length,
+                             cb_data->dma_addr, -ETIME);
+        axidma_err("%s %s transaction timed out.\n", type, direction);
+        spin_lock_irqsave(&queue->lock, flags);
+        queue->stats.timeouts += 1;
+        spin_unlock_irqrestore(&queue->lock, flags);
+        axidma_queue_flush(queue, -ETIME);
+        rc = -ETIME;
+    } else if (cb_data->status < 0) {
+        axidma_err("%s %s transaction failed.\n", type, direction);
+        rc = cb_data->status;
+    } else if (status != DMA_COMPLETE) {
+        axidma_err("%s %s transaction did not succceed. Status is %d.\n",
+                   type, direction, status);
+        axidma_queue_flush(queue, -EBUSY);
+        rc = -EBUSY;
+    } else {
+        rc = cb_data->length;
+    }
+
+    // The record is no longer in flight, so it can be reused
+    axidma_queue_put(queue, cb_data);
+    dma_tfr->cb_data = NULL;
+    return rc;
+}
+
+/* Starts the engine on all of the transfers submitted to the channel. The
+ * Xilinx driver sets the channel's interrupt threshold to the number of
+ * descriptors started together, so they raise only one interrupt. */
+static void axidma_issue_pending(struct axidma_queue *queue)
+{
+    int deferred;
+    unsigned long flags;
+
+    spin_lock_irqsave(&queue->lock, flags);
+    deferred = queue->deferred;
+    queue->deferred = 0;
+    hrtimer_try_to_cancel(&queue->issue_timer);
+    spin_unlock_irqrestore(&queue->lock, flags);
+
+    trace_axidma_issue_pending(queue->chan->channel_id,
+                               queue->chan->chan->cookie, deferred);
+    dma_async_issue_pending(queue->chan->chan);
+    return;
+}
+
+// Starts the transfers held back once the channel's interrupt delay is up
+static enum hrtimer_restart axidma_issue_timer(struct hrtimer *timer)
+{
+    struct axidma_queue *queue;
+
+    queue = container_of(timer, struct axidma_queue, issue_timer);
+    axidma_issue_pending(queue);
+    return HRTIMER_NORESTART;
+}
+
+/* Holds back an asynchronous transfer on a DMA channel until the channel's
+ * interrupt threshold is reached, so that the whole group is started together.
+ * The first transfer held back starts the timer, so that none of them waits
+ * longer than the interrupt delay. Returns true if the transfer is held.
+ *
+ * This only works while the engine is idle. The Xilinx driver starts every
+ * descriptor that was submitted whenever a transfer completes, and sets the
+ * hardware threshold to their count. So on a busy channel, the engine groups
+ * the transfers itself, and holding them back would achieve nothing. */
+static bool axidma_defer_issue(struct axidma_queue *queue)
+{
+    bool defer;
+    ktime_t delay;
+    unsigned long flags;
+
+    if (queue->chan->type != AXIDMA_DMA || queue->ready_irq > 0) {
+        return false;
+    }
+
+    spin_lock_irqsave(&queue->lock, flags);
+    defer = queue->deferred + 1 < queue->config->irq_threshold &&
+            queue->stats.in_flight == queue->deferred + 1;
+    if (defer) {
+        queue->deferred += 1;
+        if (queue->deferred == 1) {
+            delay = ns_to_ktime((u64)queue->config->irq_delay_us *
+                                NSEC_PER_USEC);
+            hrtimer_start(&queue->issue_timer, delay, HRTIMER_MODE_REL);
+        }
+    }
+    spin_unlock_irqrestore(&queue->lock, flags);
+
+    return defer;
+}
+
+/* Prepares the oldest receive held for data-ready, and starts the engine on
+ * it. Returns false if no receive is held. A receive that cannot be prepared
+ * is finished with an error. The submit lock must be held. */
+static bool axidma_submit_held(struct axidma_queue *queue)
+{
+    int rc;
+    bool found;
+    unsigned long flags;
+    dma_cookie_t dma_cookie;
+    struct dma_async_tx_descriptor *dma_txnd;
+    struct axidma_cb_data *cb_data;
+
+    // The receives held come after all of those the engine already has
+    found = false;
+    spin_lock_irqsave(&queue->lock, flags);
+    list_for_each_entry(cb_data, &queue->active_list, list)
+    {
+        if (cb_data->held) {
+            found = true;
+            break;
+        }
+    }
+    spin_unlock_irqrestore(&queue->lock, flags);
+    if (!found) {
+        return false;
+    }
+
+    // The engine copies out the list, so the record's copy can go right away
+    dma_txnd = dmaengine_prep_slave_sg(queue->chan->chan, cb_data->sg.sg_list,
+            cb_data->sg.sg_len, DMA_DEV_TO_MEM,
+            DMA_CTRL_ACK | DMA_PREP_INTERRUPT);
+    cb_data->held = false;
+    axidma_free_sg(&cb_data->sg);
+    if (dma_txnd == NULL) {
+        axidma_err("Unable to prepare the dma engine for the receive on "
+                   "channel %d.\n", cb_data->channel_id);
+        rc = -EBUSY;
+        goto finish_transfer;
+    }
+    axidma_attach_callback(queue, cb_data, dma_txnd);
+
+    spin_lock_irqsave(&queue->lock, flags);
+    dma_cookie = dmaengine_submit(dma_txnd);
+    if (dma_submit_error(dma_cookie)) {
+        spin_unlock_irqrestore(&queue->lock, flags);
+        axidma_err("Unable to submit the receive on channel %d to the "
+                   "engine.\n", cb_data->channel_id);
+        rc = -EBUSY;
+        goto finish_transfer;
+    }
+    cb_data->cookie = dma_cookie;
+    trace_axidma_submit(cb_data->channel_id, dma_cookie, cb_data->length,
+                        cb_data->dma_addr, 0);
+    spin_unlock_irqrestore(&queue->lock, flags);
+
+    axidma_issue_pending(queue);
+    return true;
+
+finish_transfer:
+    axidma_finish_transfer(cb_data, rc, 0);
+    return true;
+}
+
+/* Starts the engine on all of the transfers submitted to the channel. On a
+ * channel with a data-ready interrupt, the receives are held instead, and each
+ * interrupt that the fabric raised while none was held starts one of them. */
+static void axidma_start_queue(struct axidma_queue *queue)
+{
+    if (queue->ready_irq <= 0) {
+        axidma_issue_pending(queue);
+        return;
+    }
+
+    mutex_lock(&queue->submit_lock);
+    while (queue->ready_pending > 0 && axidma_submit_held(queue))
+    {
+        queue->ready_pending -= 1;
+    }
+    mutex_unlock(&queue->submit_lock);
+    return;
+}
+
+/* The threaded handler for a channel's data-ready interrupt, which the fabric
+ * raises when it has a packet to send. This prepares and starts the oldest
+ * receive held for it, or saves it for the next receive submitted. It runs in
+ * a thread, since preparing a transfer may sleep. While a receive ring or
+ * forwarding runs, the channel is always armed, so it is not saved. */
+static irqreturn_t axidma_ready_irq(int irq, void *data)
+{
+    bool running;
+    unsigned long flags;
+    struct axidma_queue *queue;
+
+    queue = data;
+    mutex_lock(&queue->submit_lock);
+    spin_lock_irqsave(&queue->lock, flags);
+    queue->stats.ready_irqs += 1;
+    running = queue->rx_stream != NULL || queue->forward != NULL;
+    spin_unlock_irqrestore(&queue->lock, flags);
+
+    if (!running && !axidma_submit_held(queue)) {
+        queue->ready_pending += 1;
+    }
+    mutex_unlock(&queue->submit_lock);
+    return IRQ_HANDLED;
+}
+
+static int axidma_start_transfer(struct axidma_queue *queue,
+                                 struct axidma_transfer *dma_tfr)
+{
+    /* Start the transfer, along with any held back before it, unless it can
+     * be held back to share an interrupt with the transfers after it. */
+    if (dma_tfr->wait || !axidma_defer_issue(queue)) {
+        axidma_start_queue(queue);
+    }
+
+    // Wait for the DMA to complete, if this is a synchronous transfer
+    if (dma_tfr->wait) {
+        return axidma_wait_transfer(queue, dma_tfr);
+    }
+
+    return 0;
+}
+
+/*----------------------------------------------------------------------------
+ * Receive Ring Helper Functions
+ *----------------------------------------------------------------------------*/
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,13,0)
+static void axidma_rx_ring_callback(void *data,
+                                    const struct dmaengine_result *result);
+#else
+static void axidma_rx_ring_callback(void *data);
+#endif
+
+// Arms the next slot of the ring on the channel. The stream lock must be held.
+static int axidma_rx_ring_arm(struct axidma_rx_stream *stream)
+{
+    struct dma_chan *chan;
+    struct axidma_sg *slot;
+    struct dma_async_tx_descriptor *dma_txnd;
+    dma_cookie_t dma_cookie;
+
+    chan = stream->queue->chan->chan;
+    slot = &stream->slots[stream->armed % stream->num_slots];
+    dma_txnd = dmaengine_prep_slave_sg(chan, slot->sg_list, slot->sg_len,
+            DMA_DEV_TO_MEM, DMA_CTRL_ACK | DMA_PREP_INTERRUPT);
+    if (dma_txnd == NULL) {
+        return -EBUSY;
+    }
+
+    dma_txnd->callback_param = stream;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,13,0)
+    dma_txnd->callback_result = axidma_rx_ring_callback;
+#else
+    dma_txnd->callback = axidma_rx_ring_callback;
+#endif
+    dma_cookie = dmaengine_submit(dma_txnd);
+    if (dma_submit_error(dma_cookie)) {
+        return -EBUSY;
+    }
+
+    stream->armed += 1;
+    return 0;
+}
+
+/* Arms every slot that userspace has handed back, up to the size of the ring.
+ * The stream lock must be held. */
+static void axidma_rx_ring_fill(struct axidma_rx_stream *stream)
+{
+    u32 consumer;
+
+    // Userspace cannot hand back slots that have not been filled yet
+    consumer = smp_load_acquire(&stream->ring->consumer);
+    if ((s32)(consumer - stream->producer) > 0) {
+        consumer = stream->producer;
+    }
+
+    while (!stream->stopped && stream->armed - consumer < stream->num_slots)
+    {
+        if (axidma_rx_ring_arm(stream) < 0) {
+            break;
+        }
+    }
+    return;
+}
+
+/* Re-arms the slots that userspace has handed back, and starts the channel on
+ * them. If no slot is left armed, no completion will come to re-arm the ring,
+ * so it is flagged as needing a kick. The consumer index is checked again
+ * after the flag is set, in case userspace handed back slots before it could
+ * see the flag. The stream lock must be held. */
+static void axidma_rx_ring_refill(struct axidma_rx_stream *stream)
+{
+    u32 armed;
+
+    armed = stream->armed;
+    axidma_rx_ring_fill(stream);
+    if (stream->armed == stream->producer) {
+        WRITE_ONCE(stream->ring->flags, AXIDMA_RX_RING_NEED_KICK);
+        smp_mb();
+        axidma_rx_ring_fill(stream);
+        if (stream->armed != stream->producer) {
+            WRITE_ONCE(stream->ring->flags, 0);
+        }
+    }
+
+    if (stream->armed != armed) {
+        dma_async_issue_pending(stream->queue->chan->chan);
+    }
+    return;
+}
+
+/* Publishes the length of the slot that was filled, which hands it over to
+ * userspace, then re-arms the slots that userspace has handed back. An error
+ * leaves the channel halted, so the ring stops, and reports the error. */
+static void axidma_rx_ring_slot_done(struct axidma_rx_stream *stream,
+                                     int status, u32 residue)
+{
+    u32 slot;
+    size_t length;
+    unsigned long flags;
+    struct axidma_rx_ring *ring;
+    struct axidma_queue *queue;
+
+    ring = stream->ring;
+    length = 0;
+    spin_lock_irqsave(&stream->lock, flags);
+    if (stream->stopped) {
+        spin_unlock_irqrestore(&stream->lock, flags);
+        return;
+    }
+
+    axidma_ready_ack(stream->queue, status);
+    if (status < 0) {
+        WRITE_ONCE(ring->status, status);
+        stream->stopped = true;
+    } else {
+        slot = stream->producer % stream->num_slots;
+        length = stream->slot_size - min_t(size_t, residue, stream->slot_size);
+        ring->lengths[slot] = length;
+        stream->producer += 1;
+        smp_store_release(&ring->producer, stream->producer);
+        axidma_rx_ring_refill(stream);
+    }
+    spin_unlock_irqrestore(&stream->lock, flags);
+
+    // Count the slot, which is not part of the channel's in-flight transfers
+    queue = stream->queue;
+    spin_lock_irqsave(&queue->lock, flags);
+    queue->stats.submitted += 1;
+    if (status < 0) {
+        queue->stats.errors += 1;
+    } else {
+        queue->stats.completed += 1;
+        queue->stats.bytes += length;
+    }
+    spin_unlock_irqrestore(&queue->lock, flags);
+
+    axidma_signal_eventfd(queue, stream->ctx);
+    return;
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,13,0)
+// The DMA callback function for a slot of a receive ring
+static void axidma_rx_ring_callback(void *data,
+                                    const struct dmaengine_result *result)
+{
+    int status;
+
+    switch (result->result) {
+        case DMA_TRANS_NOERROR:
+            status = 0;
+            break;
+        case DMA_TRANS_ABORTED:
+            status = -ECANCELED;
+            break;
+        default:
+            status = -EIO;
+            break;
+    }
+
+    axidma_rx_ring_slot_done(data, status, result->residue);
+}
+#else
+/* The DMA callback function for a slot of a receive ring. Older kernels do not
+ * report the residue, so every slot is assumed to be full. */
+static void axidma_rx_ring_callback(void *data)
+{
+    axidma_rx_ring_slot_done(data, 0, 0);
+}
+#endif
+
+static void axidma_free_rx_stream(struct axidma_rx_stream *stream,
+                                  u32 num_slots)
+{
+    u32 i;
+
+    for (i = 0; i < num_slots; i++)
+    {
+        axidma_free_sg(&stream->slots[i]);
+    }
+    kfree(stream->slots);
+    kfree(stream);
+    return;
+}
+
+/* Stops the receive ring running on the channel, if there is one. The queue's
+ * submit lock must be held. */
+static void axidma_rx_ring_stop(struct axidma_queue *queue)
+{
+    unsigned long flags;
+    struct axidma_rx_stream *stream;
+
+    stream = queue->rx_stream;
+    if (stream == NULL) {
+        return;
+    }
+
+    // Keep the callbacks from re-arming slots, then stop the channel
+    spin_lock_irqsave(&stream->lock, flags);
+    stream->stopped = true;
+    spin_unlock_irqrestore(&stream->lock, flags);
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4,6,0)
+    dmaengine_terminate_all(queue->chan->chan);
+#else
+    dmaengine_terminate_sync(queue->chan->chan);
+#endif
+
+    queue->rx_stream = NULL;
+    axidma_free_rx_stream(stream, stream->num_slots);
+    return;
+}
+
+/*----------------------------------------------------------------------------
+ * Forwarding Helper Functions
+ *----------------------------------------------------------------------------*/
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,13,0)
+static void axidma_forward_rx_callback(void *data,
+                                       const struct dmaengine_result *result);
+static void axidma_forward_tx_callback(void *data,
+                                       const struct dmaengine_result *result);
+#else
+static void axidma_forward_rx_callback(void *data);
+static void axidma_forward_tx_callback(void *data);
+#endif
+
+// Stops the channel, waiting for any of its callbacks that are still running
+static void axidma_terminate_sync(struct dma_chan *chan)
+{
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4,6,0)
+    dmaengine_terminate_all(chan);
+#else
+    dmaengine_terminate_sync(chan);
+#endif
+    return;
+}
+
+/* Arms the slot on the receive channel. The caller starts the channel. The
+ * forwarding lock must be held. */
+static int axidma_forward_arm(struct axidma_forward_slot *slot)
+{
+    struct dma_chan *chan;
+    struct dma_async_tx_descriptor *dma_txnd;
+    dma_cookie_t dma_cookie;
+
+    chan = slot->fwd->rx_queue->chan->chan;
+    dma_txnd = dmaengine_prep_slave_sg(chan, slot->rx_sg.sg_list,
+            slot->rx_sg.sg_len, DMA_DEV_TO_MEM,
+            DMA_CTRL_ACK | DMA_PREP_INTERRUPT);
+    if (dma_txnd == NULL) {
+        return -EBUSY;
+    }
+
+    dma_txnd->callback_param = slot;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,13,0)
+    dma_txnd->callback_result = axidma_forward_rx_callback;
+#else
+    dma_txnd->callback = axidma_forward_rx_callback;
+#endif
+    dma_cookie = dmaengine_submit(dma_txnd);
+    if (dma_submit_error(dma_cookie)) {
+        return -EBUSY;
+    }
+
+    return 0;
+}
+
+/* Sends the first `length` bytes of the slot on the transmit channel, and
+ * starts the channel. The list for the send is built from the slot's own
+ * list, trimmed to the length. The forwarding lock must be held. */
+static int axidma_forward_send(struct axidma_forward_slot *slot, size_t length)
+{
+    int i;
+    size_t entry_len;
+    struct dma_chan *chan;
+    struct scatterlist *rx_entry, *tx_entry;
+    struct dma_async_tx_descriptor *dma_txnd;
+    dma_cookie_t dma_cookie;
+
+    for (i = 0; i < slot->rx_sg.sg_len && length > 0; i++)
+    {
+        rx_entry = &slot->rx_sg.sg_list[i];
+        tx_entry = &slot->tx_sg.sg_list[i];
+        entry_len = min_t(size_t, sg_dma_len(rx_entry), length);
+        sg_dma_address(tx_entry) = sg_dma_address(rx_entry);
+        sg_dma_len(tx_entry) = entry_len;
+        length -= entry_len;
+    }
+
+    chan = slot->fwd->tx_queue->chan->chan;
+    dma_txnd = dmaengine_prep_slave_sg(chan, slot->tx_sg.sg_list, i,
+            DMA_MEM_TO_DEV, DMA_CTRL_ACK | DMA_PREP_INTERRUPT);
+    if (dma_txnd == NULL) {
+        return -EBUSY;
+    }
+
+    dma_txnd->callback_param = slot;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,13,0)
+    dma_txnd->callback_result = axidma_forward_tx_callback;
+#else
+    dma_txnd->callback = axidma_forward_tx_callback;
+#endif
+    dma_cookie = dmaengine_submit(dma_txnd);
+    if (dma_submit_error(dma_cookie)) {
+        return -EBUSY;
+    }
+
+    dma_async_issue_pending(chan);
+    return 0;
+}
+
+// Counts a packet that went through one of the channels of a forwarding
+static void axidma_forward_count(struct axidma_queue *queue, int status,
+                                 size_t length)
+{
+    unsigned long flags;
+
+    spin_lock_irqsave(&queue->lock, flags);
+    queue->stats.submitted += 1;
+    if (status < 0) {
+        queue->stats.errors += 1;
+    } else {
+        queue->stats.completed += 1;
+        queue->stats.bytes += length;
+    }
+    spin_unlock_irqrestore(&queue->lock, flags);
+    return;
+}
+
+/* Stops the forwarding from re-arming any slots after an error. The channels
+ * stay attached until the forwarding is stopped by the user. The forwarding
+ * lock must be held. */
+static void axidma_forward_fail(struct axidma_forward *fwd, int status)
+{
+    axidma_err("Forwarding from channel %d to channel %d stopped with error "
+               "%d.\n", fwd->rx_queue->chan->channel_id,
+               fwd->tx_queue->chan->channel_id, status);
+    fwd->stopped = true;
+    return;
+}
+
+/* Sends the packet received into the slot on the transmit channel. Empty
+ * packets are not sent, so their slot is armed again right away. */
+static void axidma_forward_rx_done(struct axidma_forward_slot *slot,
+                                   int status, u32 residue)
+{
+    int rc;
+    size_t length;
+    unsigned long flags;
+    struct axidma_forward *fwd;
+
+    fwd = slot->fwd;
+    spin_lock_irqsave(&fwd->lock, flags);
+    if (fwd->stopped) {
+        spin_unlock_irqrestore(&fwd->lock, flags);
+        return;
+    }
+
+    axidma_ready_ack(fwd->rx_queue, status);
+    length = fwd->slot_size - min_t(size_t, residue, fwd->slot_size);
+    axidma_forward_count(fwd->rx_queue, status, length);
+    if (status < 0) {
+        axidma_forward_fail(fwd, status);
+        spin_unlock_irqrestore(&fwd->lock, flags);
+        return;
+    }
+
+    if (fwd->max_length != 0) {
+        length = min(length, fwd->max_length);
+    }
+    if (length == 0) {
+        rc = axidma_forward_arm(slot);
+        if (rc == 0) {
+            dma_async_issue_pending(fwd->rx_queue->chan->chan);
+        }
+    } else {
+        rc = axidma_forward_send(slot, length);
+    }
+    if (rc < 0) {
+        axidma_forward_fail(fwd, rc);
+    }
+    spin_unlock_irqrestore(&fwd->lock, flags);
+    return;
+}
+
+// Arms the slot on the receive channel again, once its packet has been sent
+static void axidma_forward_tx_done(struct axidma_forward_slot *slot,
+                                   int status, u32 residue)
+{
+    int rc;
+    unsigned long flags;
+    struct axidma_forward *fwd;
+
+    fwd = slot->fwd;
+    spin_lock_irqsave(&fwd->lock, flags);
+    if (fwd->stopped) {
+        spin_unlock_irqrestore(&fwd->lock, flags);
+        return;
+    }
+
+    axidma_forward_count(fwd->tx_queue, status, 0);
+    if (status < 0) {
+        axidma_forward_fail(fwd, status);
+        spin_unlock_irqrestore(&fwd->lock, flags);
+        return;
+    }
+
+    rc = axidma_forward_arm(slot);
+    if (rc < 0) {
+        axidma_forward_fail(fwd, rc);
+    } else {
+        dma_async_issue_pending(fwd->rx_queue->chan->chan);
+    }
+    spin_unlock_irqrestore(&fwd->lock, flags);
+    return;
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,13,0)
+// Converts the result of a descriptor to the status reported for it
+static int axidma_result_status(const struct dmaengine_result *result)
+{
+    switch (result->result) {
+        case DMA_TRANS_NOERROR:
+            return 0;
+        case DMA_TRANS_ABORTED:
+            return -ECANCELED;
+        default:
+            return -EIO;
+    }
+}
+
+// The DMA callback function for a slot received on the receive channel
+static void axidma_forward_rx_callback(void *data,
+                                       const struct dmaengine_result *result)
+{
+    axidma_forward_rx_done(data, axidma_result_status(result),
+                           result->residue);
+}
+
+// The DMA callback function for a slot sent on the transmit channel
+static void axidma_forward_tx_callback(void *data,
+                                       const struct dmaengine_result *result)
+{
+    axidma_forward_tx_done(data, axidma_result_status(result),
+                           result->residue);
+}
+#else
+/* The DMA callback function for a slot received on the receive channel. Older
+ * kernels do not report the residue, so every slot is assumed to be full. */
+static void axidma_forward_rx_callback(void *data)
+{
+    axidma_forward_rx_done(data, 0, 0);
+}
+
+// The DMA callback function for a slot sent on the transmit channel
+static void axidma_forward_tx_callback(void *data)
+{
+    axidma_forward_tx_done(data, 0, 0);
+}
+#endif
+
+static void axidma_free_forward(struct axidma_forward *fwd, u32 num_slots)
+{
+    u32 i;
+
+    for (i = 0; i < num_slots; i++)
+    {
+        axidma_free_sg(&fwd->slots[i].rx_sg);
+        axidma_free_sg(&fwd->slots[i].tx_sg);
+    }
+    kfree(fwd->slots);
+    kfree(fwd);
+    return;
+}
+
+/* Stops the forwarding, detaches it from its channels and frees it. The
+ * device's forward lock, and the submit locks of both queues, must be held. */
+static void axidma_forward_stop(struct axidma_forward *fwd)
+{
+    unsigned long flags;
+
+    // Keep the callbacks from re-arming slots, then stop both channels
+    spin_lock_irqsave(&fwd->lock, flags);
+    fwd->stopped = true;
+    spin_unlock_irqrestore(&fwd->lock, flags);
+    axidma_terminate_sync(fwd->rx_queue->chan->chan);
+    axidma_terminate_sync(fwd->tx_queue->chan->chan);
+
+    fwd->rx_queue->forward = NULL;
+    fwd->tx_queue->forward = NULL;
+    axidma_free_forward(fwd, fwd->num_slots);
+    return;
+}
+
+/* Stops the forwarding that the channel is part of, if there is one. The
+ * receive queue is always locked before the transmit queue. */
+static void axidma_forward_stop_queue(struct axidma_device *dev,
+                                      struct axidma_queue *queue)
+{
+    struct axidma_forward *fwd;
+    struct axidma_queue *rx_queue, *tx_queue;
+
+    mutex_lock(&dev->forward_lock);
+    fwd = queue->forward;
+    if (fwd != NULL) {
+        rx_queue = fwd->rx_queue;
+        tx_queue = fwd->tx_queue;
+        mutex_lock(&rx_queue->submit_lock);
+        mutex_lock_nested(&tx_queue->submit_lock, SINGLE_DEPTH_NESTING);
+        axidma_forward_stop(fwd);
+        mutex_unlock(&tx_queue->submit_lock);
+        mutex_unlock(&rx_queue->submit_lock);
+    }
+    mutex_unlock(&dev->forward_lock);
+
+    return;
+}
+
+/* Checks if nothing runs on the channel, so that a receive ring or forwarding
+ * can take it over. The queue's submit lock must be held. */
+static bool axidma_queue_idle(struct axidma_queue *queue)
+{
+    bool idle;
+    unsigned long flags;
+
+    spin_lock_irqsave(&queue->lock, flags);
+    idle = queue->rx_stream == NULL && queue->forward == NULL &&
+           list_empty(&queue->active_list);
+    spin_unlock_irqrestore(&queue->lock, flags);
+
+    return idle;
+}
+
+/*----------------------------------------------------------------------------
+ * DMA Operations (Public Interface)
+ *----------------------------------------------------------------------------*/
+
+void axidma_get_num_channels(struct axidma_device *dev,
+                             struct axidma_num_channels *num_chans)
+{
+    num_chans->num_channels = dev->num_chans;
+    num_chans->num_dma_tx_channels = dev->num_dma_tx_chans;
+    num_chans->num_dma_rx_channels = dev->num_dma_rx_chans;
+    num_chans->num_vdma_tx_channels = dev->num_vdma_tx_chans;
+    num_chans->num_vdma_rx_channels = dev->num_vdma_rx_chans;
+    return;
+}
+
+void axidma_get_channel_info(struct axidma_device *dev,
+                             struct axidma_channel_info *chan_info)
+{
+    chan_info->channels = dev->channels;
+    return;
+}
+
+int axidma_set_signal(struct axidma_context *ctx, int signal)
+{
+    // Verify the signal is a real-time one
+    if (!VALID_NOTIFY_SIGNAL(signal)) {
+        axidma_err("Invalid signal %d requested for DMA notification.\n",
+                   signal);
+        axidma_err("You must specify one of the POSIX real-time signals.\n");
+        return -EINVAL;
+    }
+
+    ctx->notify_signal = signal;
+    return 0;
+}
+
+int axidma_set_eventfd(struct axidma_context *ctx,
+                       struct axidma_channel_eventfd *chan_eventfd)
+{
+    int rc;
+    unsigned long flags;
+    struct axidma_chan *chan;
+    struct axidma_queue *queue;
+    struct eventfd_ctx *eventfd, *old_eventfd;
+
+    // Get the channel with the given channel id
+    chan = axidma_get_chan(ctx->dev, chan_eventfd->channel_id);
+    if (chan == NULL) {
+        axidma_err("Invalid device id %d for DMA channel.\n",
+                   chan_eventfd->channel_id);
+        return -ENODEV;
+    }
+    queue = axidma_get_queue(ctx->dev, chan);
+    rc = axidma_check_claim(ctx, queue);
+    if (rc < 0) {
+        return rc;
+    }
+
+    // Get the eventfd context for the file descriptor, if one is given
+    eventfd = NULL;
+    if (chan_eventfd->fd >= 0) {
+        eventfd = eventfd_ctx_fdget(chan_eventfd->fd);
+        if (IS_ERR(eventfd)) {
+            axidma_err("File descriptor %d is not an eventfd.\n",
+                       chan_eventfd->fd);
+            return PTR_ERR(eventfd);
+        }
+    }
+
+    /* Swap in the new eventfd, then drop our reference to the old one. The
+     * eventfd is only signaled for the transfers of the file that bound it. */
+    spin_lock_irqsave(&queue->lock, flags);
+    old_eventfd = queue->eventfd;
+    queue->eventfd = eventfd;
+    queue->eventfd_owner = (eventfd != NULL) ? ctx : NULL;
+    spin_unlock_irqrestore(&queue->lock, flags);
+
+    if (old_eventfd != NULL) {
+        eventfd_ctx_put(old_eventfd);
+    }
+    return 0;
+}
+
+/* Unbinds the eventfds that the given file bound to any of the channels, or
+ * all of the eventfds if no file is given. */
+void axidma_clear_eventfds(struct axidma_device *dev,
+                           struct axidma_context *ctx)
+{
+    int i;
+    unsigned long flags;
+    struct axidma_queue *queue;
+    struct eventfd_ctx *eventfd;
+
+    for (i = 0; i < dev->num_chans; i++)
+    {
+        queue = &dev->queues[i];
+        spin_lock_irqsave(&queue->lock, flags);
+        eventfd = NULL;
+        if (ctx == NULL || queue->eventfd_owner == ctx) {
+            eventfd = queue->eventfd;
+            queue->eventfd = NULL;
+            queue->eventfd_owner = NULL;
+        }
+        spin_unlock_irqrestore(&queue->lock, flags);
+
+        if (eventfd != NULL) {
+            eventfd_ctx_put(eventfd);
+        }
+    }
+
+    return;
+}
+
+// Checks if the completion ring holds entries that userspace has not reaped
+bool axidma_completions_pending(struct axidma_context *ctx)
+{
+    bool pending;
+    unsigned long flags;
+
+    spin_lock_irqsave(&ctx->notify_lock, flags);
+    pending = ctx->ring != NULL &&
+              ctx->ring_head != smp_load_acquire(&ctx->ring->tail);
+    spin_unlock_irqrestore(&ctx->notify_lock, flags);
+
+    return pending;
+}
+
+int axidma_read_transfer(struct axidma_context *ctx,
+                         struct axidma_transaction *trans)
+{
+    int rc;
+    struct axidma_device *dev;
+    struct axidma_chan *rx_chan;
+    struct axidma_queue *rx_queue;
+    struct axidma_sg sg;
+    struct axidma_transfer rx_tfr;
+
+    dev = ctx->dev;
+
+    // Get the channel with the given channel id
+    rx_chan = axidma_get_chan(dev, trans->channel_id);
+    if (rx_chan == NULL || rx_chan->dir != AXIDMA_READ) {
+        axidma_err("Invalid device id %d for DMA receive channel.\n",
+                   trans->channel_id);
+        return -ENODEV;
+    }
+    rc = axidma_check_rx_app(rx_chan, trans->flags, trans->wait);
+    if (rc < 0) {
+        return rc;
+    }
+
+    // Setup the scatter-gather list for the transfer
+    down_read(&ctx->buffers_lock);
+    rc = axidma_init_sg(ctx, &sg, trans->buf, trans->buf_len);
+    if (rc < 0) {
+        up_read(&ctx->buffers_lock);
+        return rc;
+    }
+
+    // Setup receive transfer structure for DMA
+    rx_tfr.sg_list = sg.sg_list;
+    rx_tfr.sg_len = sg.sg_len;
+    rx_tfr.dir = rx_chan->dir;
+    rx_tfr.type = rx_chan->type;
+    rx_tfr.wait = trans->wait;
+    rx_tfr.reap = false;
+    rx_tfr.channel_id = trans->channel_id;
+    rx_tfr.notify_signal = ctx->notify_signal;
+    rx_tfr.process = get_current();
+    rx_tfr.ctx = ctx;
+    rx_tfr.user_tag = trans->user_tag;
+    rx_tfr.app = trans->app;
+    rx_tfr.buf = trans->buf;
+    rx_tfr.buf_len = trans->buf_len;
+
+    // Prepare the receive transfer
+    rx_queue = axidma_get_queue(dev, rx_chan);
+    rc = axidma_prep_transfer(rx_queue, &rx_tfr);
+    up_read(&ctx->buffers_lock);
+    axidma_free_sg(&sg);
+    if (rc < 0) {
+        return rc;
+    }
+
+    /* Submit the receive transfer, and wait for it to complete. This returns
+     * the number of bytes received, for synchronous transfers. */
+    return axidma_start_transfer(rx_queue, &rx_tfr);
+}
+
+int axidma_write_transfer(struct axidma_context *ctx,
+                          struct axidma_transaction *trans)
+{
+    int rc;
+    struct axidma_device *dev;
+    struct axidma_chan *tx_chan;
+    struct axidma_queue *tx_queue;
+    struct axidma_sg sg;
+    struct axidma_transfer tx_tfr;
+
+    dev = ctx->dev;
+
+    // Get the channel with the given id
+    tx_chan = axidma_get_chan(dev, trans->channel_id);
+    if (tx_chan == NULL || tx_chan->dir != AXIDMA_WRITE) {
+        axidma_err("Invalid device id %d for DMA transmit channel.\n",
+                   trans->channel_id);
+        return -ENODEV;
+    }
+    rc = axidma_check_rx_app(tx_chan, trans->flags, trans->wait);
+    if (rc < 0) {
+        return rc;
+    }
+
+    // Setup the scatter-gather list for the transfer
+    down_read(&ctx->buffers_lock);
+    rc = axidma_init_sg(ctx, &sg, trans->buf, trans->buf_len);
+    if (rc < 0) {
+        up_read(&ctx->buffers_lock);
+        return rc;
+    }
+
+    // Setup transmit transfer structure for DMA
+    tx_tfr.sg_list = sg.sg_list;
+    tx_tfr.sg_len = sg.sg_len;
+    tx_tfr.dir = tx_chan->dir;
+    tx_tfr.type = tx_chan->type;
+    tx_tfr.wait = trans->wait;
+    tx_tfr.reap = false;
+    tx_tfr.channel_id = trans->channel_id;
+    tx_tfr.notify_signal = ctx->notify_signal;
+    tx_tfr.process = get_current();
+    tx_tfr.ctx = ctx;
+    tx_tfr.user_tag = trans->user_tag;
+    tx_tfr.app = trans->app;
+    tx_tfr.buf = trans->buf;
+    tx_tfr.buf_len = trans->buf_len;
+
+    // Prepare the transmit transfer
+    tx_queue = axidma_get_queue(dev, tx_chan);
+    rc = axidma_prep_transfer(tx_queue, &tx_tfr);
+    up_read(&ctx->buffers_lock);
+    axidma_free_sg(&sg);
+    if (rc < 0) {
+        return rc;
+    }
+
+    /* Submit the transmit transfer, and wait for it to complete. This returns
+     * the number of bytes sent, for synchronous transfers. */
+    return axidma_start_transfer(tx_queue, &tx_tfr);
+}
+
+/* Transfers data from the given source buffer out to the AXI DMA device, and
+ * places the data received into the receive buffer. */
+int axidma_rw_transfer(struct axidma_context *ctx,
+                       struct axidma_inout_transaction *trans)
+{
+    int rc;
+    struct axidma_device *dev;
+    struct axidma_chan *tx_chan, *rx_chan;
+    struct axidma_queue *tx_queue, *rx_queue;
+    struct axidma_sg tx_sg, rx_sg;
+    struct axidma_transfer tx_tfr, rx_tfr;
+
+    dev = ctx->dev;
+
+    // Get the transmit and receive channels with the given ids.
+    tx_chan = axidma_get_chan(dev, trans->tx_channel_id);
+    if (tx_chan == NULL || tx_chan->dir != AXIDMA_WRITE) {
+        axidma_err("Invalid device id %d for DMA transmit channel.\n",
+                   trans->tx_channel_id);
+        return -ENODEV;
+    }
+
+    rx_chan = axidma_get_chan(dev, trans->rx_channel_id);
+    if (rx_chan == NULL || rx_chan->dir != AXIDMA_READ) {
+        axidma_err("Invalid device id %d for DMA receive channel.\n",
+                   trans->rx_channel_id);
+        return -ENODEV;
+    }
+
+    // Setup the scatter-gather lists for the transfers
+    down_read(&ctx->buffers_lock);
+    rc = axidma_init_sg(ctx, &tx_sg, trans->tx_buf, trans->tx_buf_len);
+    if (rc < 0) {
+        up_read(&ctx->buffers_lock);
+        return rc;
+    }
+    rc = axidma_init_sg(ctx, &rx_sg, trans->rx_buf, trans->rx_buf_len);
+    if (rc < 0) {
+        up_read(&ctx->buffers_lock);
+        axidma_free_sg(&tx_sg);
+        return rc;
+    }
+
+    // VDMA frames are addressed by their start, so they must be contiguous
+    if ((tx_chan->type == AXIDMA_VDMA && tx_sg.sg_len != 1) ||
+        (rx_chan->type == AXIDMA_VDMA && rx_sg.sg_len != 1)) {
+        axidma_err("VDMA transfers require a physically contiguous buffer.\n");
+        rc = -EINVAL;
+        goto free_sg;
+    }
+
+    // Setup receive and trasmit transfer structures for DMA
+    tx_tfr.sg_list = tx_sg.sg_list,
+    tx_tfr.sg_len = tx_sg.sg_len,
+    tx_tfr.dir = tx_chan->dir,
+    tx_tfr.type = tx_chan->type,
+    tx_tfr.wait = false,
+    tx_tfr.reap = false,
+    tx_tfr.channel_id = trans->tx_channel_id,
+    tx_tfr.notify_signal = ctx->notify_signal,
+    tx_tfr.process = get_current(),
+    tx_tfr.ctx = ctx,
+    tx_tfr.user_tag = 0;
+    tx_tfr.app = NULL;
+    tx_tfr.buf = trans->tx_buf;
+    tx_tfr.buf_len = trans->tx_buf_len;
+
+    // Add in the frame information for VDMA transfers
+    if (tx_chan->type == AXIDMA_VDMA) {
+        memcpy(&tx_tfr.frame, &trans->tx_frame, sizeof(tx_tfr.frame));
+    }
+
+    rx_tfr.sg_list = rx_sg.sg_list,
+    rx_tfr.sg_len = rx_sg.sg_len,
+    rx_tfr.dir = rx_chan->dir,
+    rx_tfr.type = rx_chan->type,
+    rx_tfr.wait = trans->wait,
+    rx_tfr.reap = false,
+    rx_tfr.channel_id = trans->rx_channel_id,
+    rx_tfr.notify_signal = ctx->notify_signal,
+    rx_tfr.process = get_current(),
+    rx_tfr.ctx = ctx,
+    rx_tfr.user_tag = 0;
+    rx_tfr.app = NULL;
+    rx_tfr.buf = trans->rx_buf;
+    rx_tfr.buf_len = trans->rx_buf_len;
+
+    // Add in the frame information for VDMA transfers
+    if (tx_chan->type == AXIDMA_VDMA) {
+        memcpy(&rx_tfr.frame, &trans->rx_frame, sizeof(rx_tfr.frame));
+    }
+
+    // Prep both the receive and transmit transfers
+    tx_queue = axidma_get_queue(dev, tx_chan);
+    rx_queue = axidma_get_queue(dev, rx_chan);
+    rc = axidma_prep_transfer(tx_queue, &tx_tfr);
+    if (rc < 0) {
+        goto free_sg;
+    }
+    rc = axidma_prep_transfer(rx_queue, &rx_tfr);
+    if (rc < 0) {
+        goto flush_tx;
+    }
+    up_read(&ctx->buffers_lock);
+    axidma_free_sg(&tx_sg);
+    axidma_free_sg(&rx_sg);
+
+    // Submit both transfers to the DMA engine, and wait on the receive transfer
+    rc = axidma_start_transfer(tx_queue, &tx_tfr);
+    if (rc < 0) {
+        return rc;
+    }
+    return axidma_start_transfer(rx_queue, &rx_tfr);
+
+/* The transmit is already submitted to the engine, and cannot be taken back
+ * on its own, so stop the channel to retire its record. */
+flush_tx:
+    axidma_queue_flush(tx_queue, rc);
+free_sg:
+    up_read(&ctx->buffers_lock);
+    axidma_free_sg(&tx_sg);
+    axidma_free_sg(&rx_sg);
+    return rc;
+}
+
+/* Prepares and submits all of the given transfers, only then starting each of
+ * the channels touched by the batch, so that the engine is kicked once per
+ * channel rather than once per transfer. */
+int axidma_batch_transfer(struct axidma_context *ctx,
+                          struct axidma_transaction *trans, int num_trans)
+{
+    int rc, wait_rc, i, j;
+    int num_submitted;
+    struct axidma_device *dev;
+    struct axidma_chan *chan;
+    struct axidma_batch_entry *entries, *entry;
+
+    dev = ctx->dev;
+
+    // Allocate the transfer state for each transaction in the batch
+    entries = kcalloc(num_trans, sizeof(*entries), GFP_KERNEL);
+    if (entries == NULL) {
+        axidma_err("Unable to allocate memory for the batch transfers.\n");
+        return -ENOMEM;
+    }
+
+    // Validate each transaction, and setup its transfer structure
+    down_read(&ctx->buffers_lock);
+    for (i = 0; i < num_trans; i++)
+    {
+        entry = &entries[i];
+        chan = axidma_get_chan(dev, trans[i].channel_id);
+        if (chan == NULL || chan->type != AXIDMA_DMA) {
+            axidma_err("Invalid device id %d for DMA channel in batch entry "
+                       "%d.\n", trans[i].channel_id, i);
+            rc = -ENODEV;
+            up_read(&ctx->buffers_lock);
+            goto free_entries;
+        }
+        rc = axidma_check_rx_app(chan, trans[i].flags, trans[i].wait);
+        if (rc < 0) {
+            up_read(&ctx->buffers_lock);
+            goto free_entries;
+        }
+        entry->chan = chan;
+        entry->queue = axidma_get_queue(dev, chan);
+
+        // Setup the scatter-gather list for the transfer
+        rc = axidma_init_sg(ctx, &entry->sg, trans[i].buf, trans[i].buf_len);
+        if (rc < 0) {
+            up_read(&ctx->buffers_lock);
+            goto free_entries;
+        }
+
+        entry->tfr.sg_list = entry->sg.sg_list;
+        entry->tfr.sg_len = entry->sg.sg_len;
+        entry->tfr.dir = chan->dir;
+        entry->tfr.type = chan->type;
+        entry->tfr.wait = trans[i].wait;
+        entry->tfr.reap = false;
+        entry->tfr.channel_id = trans[i].channel_id;
+        entry->tfr.notify_signal = ctx->notify_signal;
+        entry->tfr.process = get_current();
+        entry->tfr.ctx = ctx;
+        entry->tfr.user_tag = trans[i].user_tag;
+        entry->tfr.app = trans[i].app;
+        entry->tfr.buf = trans[i].buf;
+        entry->tfr.buf_len = trans[i].buf_len;
+    }
+
+    // Prepare and submit the transfers in order, without starting the engines
+    for (num_submitted = 0; num_submitted < num_trans; num_submitted++)
+    {
+        entry = &entries[num_submitted];
+        rc = axidma_prep_transfer(entry->queue, &entry->tfr);
+        if (rc < 0) {
+            break;
+        }
+    }
+    up_read(&ctx->buffers_lock);
+
+    /* The transfers submitted before one that failed cannot be taken back
+     * without stopping their channels, which would also cancel the transfers
+     * of other files. They are run as usual, and their number is returned. */
+    if (num_submitted == 0) {
+        goto free_entries;
+    } else if (num_submitted < num_trans) {
+        axidma_err("Only %d of the %d batch entries were submitted.\n",
+                   num_submitted, num_trans);
+        rc = num_submitted;
+    } else {
+        rc = 0;
+    }
+
+    // Start each channel touched by the batch exactly once
+    for (i = 0; i < num_submitted; i++)
+    {
+        for (j = 0; j < i && entries[j].chan != entries[i].chan; j++);
+        if (j == i) {
+            axidma_start_queue(entries[i].queue);
+        }
+    }
+
+    /* Wait for all of the synchronous transfers to complete. One that times
+     * out stops only its own channel, as a single transfer would, and the
+     * rest are still waited on, so that each of their records is returned. */
+    for (i = 0; i < num_submitted; i++)
+    {
+        if (!entries[i].tfr.wait) {
+            continue;
+        }
+
+        wait_rc = axidma_wait_transfer(entries[i].queue, &entries[i].tfr);
+        if (wait_rc < 0 && rc == 0) {
+            rc = wait_rc;
+        }
+    }
+
+free_entries:
+    for (i = 0; i < num_trans; i++)
+    {
+        axidma_free_sg(&entries[i].sg);
+    }
+    kfree(entries);
+    return rc;
+}
+
+int axidma_submit_transfer(struct axidma_context *ctx,
+                           struct axidma_submit *submit)
+{
+    int rc;
+    struct axidma_device *dev;
+    struct axidma_chan *chan;
+    struct axidma_queue *queue;
+    struct axidma_sg sg;
+    struct axidma_transfer tfr;
+    struct axidma_transaction *trans;
+
+    dev = ctx->dev;
+
+    // Get the channel with the given id, the direction is taken from it
+    trans = &submit->trans;
+    chan = axidma_get_chan(dev, trans->channel_id);
+    if (chan == NULL || chan->type != AXIDMA_DMA) {
+        axidma_err("Invalid device id %d for DMA channel.\n",
+                   trans->channel_id);
+        return -ENODEV;
+    }
+    rc = axidma_check_rx_app(chan, trans->flags, false);
+    if (rc < 0) {
+        return rc;
+    }
+
+    /* The handle is the transfer's cookie, which a receive held for data-ready
+     * does not have until the fabric raises it. */
+    queue = axidma_get_queue(dev, chan);
+    if (queue->ready_irq > 0) {
+        axidma_err("Channel %d starts its receives on data-ready, so they "
+                   "cannot be reaped by handle.\n", trans->channel_id);
+        return -EOPNOTSUPP;
+    }
+
+    // Setup the scatter-gather list for the transfer
+    down_read(&ctx->buffers_lock);
+    rc = axidma_init_sg(ctx, &sg, trans->buf, trans->buf_len);
+    if (rc < 0) {
+        up_read(&ctx->buffers_lock);
+        return rc;
+    }
+
+    // Setup the transfer structure, keeping the record until it is reaped
+    tfr.sg_list = sg.sg_list;
+    tfr.sg_len = sg.sg_len;
+    tfr.dir = chan->dir;
+    tfr.type = chan->type;
+    tfr.wait = false;
+    tfr.reap = true;
+    tfr.channel_id = trans->channel_id;
+    tfr.notify_signal = ctx->notify_signal;
+    tfr.process = get_current();
+    tfr.ctx = ctx;
+    tfr.user_tag = trans->user_tag;
+    tfr.app = trans->app;
+    tfr.buf = trans->buf;
+    tfr.buf_len = trans->buf_len;
+
+    // Prepare and submit the transfer, and return immediately
+    rc = axidma_prep_transfer(queue, &tfr);
+    up_read(&ctx->buffers_lock);
+    axidma_free_sg(&sg);
+    if (rc < 0) {
+        return rc;
+    }
+    rc = axidma_start_transfer(queue, &tfr);
+    if (rc < 0) {
+        return rc;
+    }
+
+    // Return the handle for the transfer to the user
+    submit->handle.channel_id = trans->channel_id;
+    submit->handle.cookie = tfr.cookie;
     return 0;
+}
+
+// Gets the transfer queue for the channel that the handle refers to
+static struct axidma_queue *axidma_get_handle_queue(struct axidma_device *dev,
+        struct axidma_handle *handle)
+{
+    struct axidma_chan *chan;
+
+    chan = axidma_get_chan(dev, handle->channel_id);
+    if (chan == NULL) {
+        axidma_err("Invalid device id %d for transfer handle.\n",
+                   handle->channel_id);
+        return NULL;
+    }
+
+    return axidma_get_queue(dev, chan);
+}
+
+// Checks if the transfer for the cookie has finished, or is no longer known
+static bool axidma_handle_finished(struct axidma_queue *queue,
+        struct axidma_context *ctx, dma_cookie_t cookie)
+{
+    bool finished;
+    unsigned long flags;
+    struct axidma_cb_data *cb_data;
+
+    spin_lock_irqsave(&queue->lock, flags);
+    cb_data = axidma_queue_find(queue, ctx, cookie);
+    finished = (cb_data == NULL || cb_data->done);
+    spin_unlock_irqrestore(&queue->lock, flags);
+
+    return finished;
+}
+
+/* Collects the final status of a finished transfer, and returns its record to
+ * the pool. Returns the number of bytes transferred on success, or -EAGAIN if
+ * the transfer is still in flight. */
+static int axidma_reap_handle(struct axidma_queue *queue,
+        struct axidma_context *ctx, dma_cookie_t cookie)
+{
+    int rc;
+    size_t length;
+    unsigned long flags;
+    enum dma_status status;
+    struct axidma_cb_data *cb_data;
+
+    length = 0;
+    spin_lock_irqsave(&queue->lock, flags);
+    cb_data = axidma_queue_find(queue, ctx, cookie);
+    if (cb_data == NULL) {
+        rc = -ENOENT;
+    } else if (!cb_data->done) {
+        rc = -EAGAIN;
+    } else {
+        rc = cb_data->status;
+        length = cb_data->length;
+        list_move(&cb_data->list, &queue->free_list);
+        queue->in_use -= 1;
+    }
+    spin_unlock_irqrestore(&queue->lock, flags);
+
+    if (rc == -ENOENT) {
+        axidma_err("No transfer with cookie %d on channel %d.\n", cookie,
+                   queue->chan->channel_id);
+        return rc;
+    } else if (rc != 0) {
+        return rc;
+    }
 
-stop_dma:
-    dmaengine_terminate_all(chan->chan);
-    return rc;
-}
+    // Confirm with the engine that the transfer really completed
+    status = dma_async_is_tx_complete(queue->chan->chan, cookie, NULL, NULL);
+    if (status != DMA_COMPLETE) {
+        axidma_err("Transfer with cookie %d did not succeed. Status is %d.\n",
+                   cookie, status);
+        return -EIO;
+    }
 
-/*----------------------------------------------------------------------------
- * DMA Operations (Public Interface)
- *----------------------------------------------------------------------------*/
+    return length;
+}
 
-void axidma_get_num_channels(struct axidma_device *dev,
-                             struct axidma_num_channels *num_chans)
+int axidma_wait_handle(struct axidma_context *ctx, struct axidma_wait *wait)
 {
-    num_chans->num_channels = dev->num_chans;
-    num_chans->num_dma_tx_channels = dev->num_dma_tx_chans;
-    num_chans->num_dma_rx_channels = dev->num_dma_rx_chans;
-    num_chans->num_vdma_tx_channels = dev->num_vdma_tx_chans;
-    num_chans->num_vdma_rx_channels = dev->num_vdma_rx_chans;
-    return;
+    long rc;
+    unsigned long timeout;
+    dma_cookie_t cookie;
+    struct axidma_queue *queue;
+
+    queue = axidma_get_handle_queue(ctx->dev, &wait->handle);
+    if (queue == NULL) {
+        return -ENODEV;
+    }
+
+    // Wait for the transfer to finish, or for the timeout to expire
+    cookie = wait->handle.cookie;
+    if (wait->timeout_ns == AXIDMA_WAIT_FOREVER) {
+        rc = wait_event_interruptible(queue->wait,
+                axidma_handle_finished(queue, ctx, cookie));
+    } else if (wait->timeout_ns > 0) {
+        timeout = max(nsecs_to_jiffies(wait->timeout_ns), 1UL);
+        rc = wait_event_interruptible_timeout(queue->wait,
+                axidma_handle_finished(queue, ctx, cookie), timeout);
+    } else {
+        rc = 0;
+    }
+    if (rc < 0) {
+        return rc;
+    }
+
+    // A transfer still in flight at this point has timed out
+    rc = axidma_reap_handle(queue, ctx, cookie);
+    return (rc == -EAGAIN) ? -ETIMEDOUT : rc;
 }
 
-void axidma_get_channel_info(struct axidma_device *dev,
-                             struct axidma_channel_info *chan_info)
+int axidma_poll_handle(struct axidma_context *ctx,
+                       struct axidma_handle *handle)
 {
-    chan_info->channels = dev->channels;
-    return;
+    struct axidma_queue *queue;
+
+    queue = axidma_get_handle_queue(ctx->dev, handle);
+    if (queue == NULL) {
+        return -ENODEV;
+    }
+
+    return axidma_reap_handle(queue, ctx, handle->cookie);
 }
 
-int axidma_set_signal(struct axidma_device *dev, int signal)
+/* Checks whether the file alone is using the channel, which it is if it has
+ * claimed the channel, or if no other file has a transfer in flight on it and
+ * no receive ring or forwarding runs on it. The queue lock must be held. */
+static bool axidma_queue_sole_user(struct axidma_queue *queue,
+                                   struct axidma_context *ctx)
 {
-    // Verify the signal is a real-time one
-    if (!VALID_NOTIFY_SIGNAL(signal)) {
-        axidma_err("Invalid signal %d requested for DMA notification.\n",
-                   signal);
-        axidma_err("You must specify one of the POSIX real-time signals.\n");
-        return -EINVAL;
+    struct axidma_cb_data *cb_data;
+
+    if (queue->owner == ctx) {
+        return true;
+    } else if (queue->rx_stream != NULL || queue->forward != NULL) {
+        return false;
     }
 
-    dev->notify_signal = signal;
-    return 0;
+    list_for_each_entry(cb_data, &queue->active_list, list)
+    {
+        if (cb_data->ctx != ctx) {
+            return false;
+        }
+    }
+    return true;
 }
 
-int axidma_read_transfer(struct axidma_device *dev,
-                         struct axidma_transaction *trans)
+int axidma_cancel_handle(struct axidma_context *ctx,
+                         struct axidma_handle *handle)
 {
     int rc;
-    struct axidma_chan *rx_chan;
-    struct scatterlist sg_list;
-    struct axidma_transfer rx_tfr;
+    unsigned long flags;
+    struct axidma_queue *queue;
+    struct axidma_cb_data *cb_data;
+    LIST_HEAD(done_list);
 
-    // Get the channel with the given channel id
-    rx_chan = axidma_get_chan(dev, trans->channel_id);
-    if (rx_chan == NULL || rx_chan->dir != AXIDMA_READ) {
-        axidma_err("Invalid device id %d for DMA receive channel.\n",
-                   trans->channel_id);
+    queue = axidma_get_handle_queue(ctx->dev, handle);
+    if (queue == NULL) {
         return -ENODEV;
     }
 
-    // Setup the scatter-gather list for the transfer (only one entry)
-    sg_init_table(&sg_list, 1);
-    rc = axidma_init_sg_entry(dev, &sg_list, 0, trans->buf,
-                              trans->buf_len);
-    if (rc < 0) {
-        return rc;
+    /* The engine cannot abort a single descriptor, so the whole channel is
+     * stopped. That is only done when it stops none of another file's
+     * transfers, and nothing can be submitted until it has been. The handle
+     * is left to be reaped with its cancelled status. */
+    mutex_lock(&queue->submit_lock);
+    spin_lock_irqsave(&queue->lock, flags);
+    cb_data = axidma_queue_find(queue, ctx, handle->cookie);
+    if (cb_data == NULL) {
+        rc = -ENOENT;
+    } else if (cb_data->done) {
+        rc = 0;
+    } else {
+        rc = axidma_queue_sole_user(queue, ctx) ? 1 : -EBUSY;
     }
+    spin_unlock_irqrestore(&queue->lock, flags);
 
-    // Setup receive transfer structure for DMA
-    rx_tfr.sg_list = &sg_list;
-    rx_tfr.sg_len = 1;
-    rx_tfr.dir = rx_chan->dir;
-    rx_tfr.type = rx_chan->type;
-    rx_tfr.wait = trans->wait;
-    rx_tfr.channel_id = trans->channel_id;
-    rx_tfr.notify_signal = dev->notify_signal;
-    rx_tfr.process = get_current();
-    rx_tfr.cb_data = &dev->cb_data[trans->channel_id];
+    if (rc > 0) {
+        axidma_queue_terminate(queue, -ECANCELED, &done_list);
+        rc = 0;
+    }
+    mutex_unlock(&queue->submit_lock);
+    axidma_notify_terminated(&done_list);
+
+    if (rc == -ENOENT) {
+        axidma_err("No transfer with cookie %d on channel %d.\n",
+                   handle->cookie, handle->channel_id);
+    } else if (rc == -EBUSY) {
+        axidma_err("Channel %d is shared with another file, so it must be "
+                   "claimed to cancel a transfer.\n", handle->channel_id);
+    }
+    return rc;
+}
 
-    // Prepare the receive transfer
-    rc = axidma_prep_transfer(rx_chan, &rx_tfr);
-    if (rc < 0) {
-        return rc;
+/* Frees the records of all of the file's transfers that were never reaped.
+ * Transfers still in flight are returned to the pool as soon as they finish. */
+void axidma_release_handles(struct axidma_context *ctx)
+{
+    int i;
+    unsigned long flags;
+    struct axidma_device *dev;
+    struct axidma_queue *queue;
+    struct axidma_cb_data *cb_data, *next;
+
+    dev = ctx->dev;
+    for (i = 0; i < dev->num_chans; i++)
+    {
+        queue = &dev->queues[i];
+        spin_lock_irqsave(&queue->lock, flags);
+        list_for_each_entry(cb_data, &queue->active_list, list)
+        {
+            if (cb_data->ctx == ctx) {
+                cb_data->reap = false;
+            }
+        }
+        list_for_each_entry_safe(cb_data, next, &queue->reap_list, list)
+        {
+            if (cb_data->ctx == ctx) {
+                list_move(&cb_data->list, &queue->free_list);
+                queue->in_use -= 1;
+            }
+        }
+        spin_unlock_irqrestore(&queue->lock, flags);
     }
 
-    // Submit the receive transfer, and wait for it to complete
-    rc = axidma_start_transfer(rx_chan, &rx_tfr);
-    if (rc < 0) {
-        return rc;
+    return;
+}
+
+/* Stops every channel that has a transfer of the file in flight, since the
+ * file's buffers and notifications are about to go away. Transfers of other
+ * files on the same channels are cancelled along with them. A transfer that
+ * finished may still be reported by a callback or by another thread's flush
+ * after it has left the active list, so this also waits for every report to
+ * the file to be done before the file can be freed. */
+void axidma_release_transfers(struct axidma_context *ctx)
+{
+    int i;
+    bool in_flight;
+    unsigned long flags;
+    struct axidma_device *dev;
+    struct axidma_queue *queue;
+    struct axidma_cb_data *cb_data;
+
+    dev = ctx->dev;
+    for (i = 0; i < dev->num_chans; i++)
+    {
+        queue = &dev->queues[i];
+        in_flight = false;
+        spin_lock_irqsave(&queue->lock, flags);
+        list_for_each_entry(cb_data, &queue->active_list, list)
+        {
+            if (cb_data->ctx == ctx) {
+                in_flight = true;
+                break;
+            }
+        }
+        spin_unlock_irqrestore(&queue->lock, flags);
+
+        if (in_flight) {
+            axidma_queue_flush(queue, -ECANCELED);
+        }
     }
 
-    return 0;
+    wait_event(dev->notify_wait, atomic_read(&ctx->notifying) == 0);
+    return;
 }
 
-int axidma_write_transfer(struct axidma_device *dev,
-                          struct axidma_transaction *trans)
+static void axidma_free_prepared(struct kref *ref)
+{
+    struct axidma_prepared *prepared;
+
+    prepared = container_of(ref, struct axidma_prepared, ref);
+    axidma_free_sg(&prepared->sg);
+    kfree(prepared);
+    return;
+}
+
+/* Claims the channel for the file, so that no other file can use it until the
+ * file releases it or is closed. */
+int axidma_claim_channel(struct axidma_context *ctx, int channel_id)
 {
     int rc;
-    struct axidma_chan *tx_chan;
-    struct scatterlist sg_list;
-    struct axidma_transfer tx_tfr;
+    unsigned long flags;
+    struct axidma_chan *chan;
+    struct axidma_queue *queue;
 
-    // Get the channel with the given id
-    tx_chan = axidma_get_chan(dev, trans->channel_id);
-    if (tx_chan == NULL || tx_chan->dir != AXIDMA_WRITE) {
-        axidma_err("Invalid device id %d for DMA transmit channel.\n",
-                   trans->channel_id);
+    chan = axidma_get_chan(ctx->dev, channel_id);
+    if (chan == NULL) {
+        axidma_err("Invalid device id %d for DMA channel.\n", channel_id);
         return -ENODEV;
     }
 
-    // Setup the scatter-gather list for the transfer (only one entry)
-    sg_init_table(&sg_list, 1);
-    rc = axidma_init_sg_entry(dev, &sg_list, 0, trans->buf,
-                              trans->buf_len);
+    queue = axidma_get_queue(ctx->dev, chan);
+    spin_lock_irqsave(&queue->lock, flags);
+    rc = (queue->owner == NULL || queue->owner == ctx) ? 0 : -EBUSY;
+    if (rc == 0) {
+        queue->owner = ctx;
+    }
+    spin_unlock_irqrestore(&queue->lock, flags);
+
     if (rc < 0) {
-        return rc;
+        axidma_err("Channel %d is already claimed by another file.\n",
+                   channel_id);
     }
+    return rc;
+}
 
-    // Setup transmit transfer structure for DMA
-    tx_tfr.sg_list = &sg_list;
-    tx_tfr.sg_len = 1;
-    tx_tfr.dir = tx_chan->dir;
-    tx_tfr.type = tx_chan->type;
-    tx_tfr.wait = trans->wait;
-    tx_tfr.channel_id = trans->channel_id;
-    tx_tfr.notify_signal = dev->notify_signal;
-    tx_tfr.process = get_current();
-    tx_tfr.cb_data = &dev->cb_data[trans->channel_id];
+int axidma_release_channel(struct axidma_context *ctx, int channel_id)
+{
+    int rc;
+    unsigned long flags;
+    struct axidma_chan *chan;
+    struct axidma_queue *queue;
 
-    // Prepare the transmit transfer
-    rc = axidma_prep_transfer(tx_chan, &tx_tfr);
-    if (rc < 0) {
-        return rc;
+    chan = axidma_get_chan(ctx->dev, channel_id);
+    if (chan == NULL) {
+        axidma_err("Invalid device id %d for DMA channel.\n", channel_id);
+        return -ENODEV;
+    }
+
+    queue = axidma_get_queue(ctx->dev, chan);
+    spin_lock_irqsave(&queue->lock, flags);
+    rc = (queue->owner == ctx) ? 0 : -EINVAL;
+    if (rc == 0) {
+        queue->owner = NULL;
     }
+    spin_unlock_irqrestore(&queue->lock, flags);
 
-    // Submit the transmit transfer, and wait for it to complete
-    rc = axidma_start_transfer(tx_chan, &tx_tfr);
     if (rc < 0) {
-        return rc;
+        axidma_err("Channel %d is not claimed by this file.\n", channel_id);
     }
+    return rc;
+}
 
-    return 0;
+// Releases all of the channels that the file has claimed
+void axidma_release_claims(struct axidma_context *ctx)
+{
+    int i;
+    unsigned long flags;
+    struct axidma_device *dev;
+    struct axidma_queue *queue;
+
+    dev = ctx->dev;
+    for (i = 0; i < dev->num_chans; i++)
+    {
+        queue = &dev->queues[i];
+        spin_lock_irqsave(&queue->lock, flags);
+        if (queue->owner == ctx) {
+            queue->owner = NULL;
+        }
+        spin_unlock_irqrestore(&queue->lock, flags);
+    }
+
+    return;
 }
 
-/* Transfers data from the given source buffer out to the AXI DMA device, and
- * places the data received into the receive buffer. */
-int axidma_rw_transfer(struct axidma_device *dev,
-                       struct axidma_inout_transaction *trans)
+/* Changes the tunables of the channel. The context is NULL for changes made
+ * through sysfs, which are not subject to the claims of files. */
+int axidma_set_channel_config(struct axidma_device *dev,
+                              struct axidma_context *ctx,
+                              struct axidma_channel_config *config)
 {
     int rc;
-    struct axidma_chan *tx_chan, *rx_chan;
-    struct scatterlist tx_sg_list, rx_sg_list;
-    struct axidma_transfer tx_tfr, rx_tfr;
+    unsigned long flags;
+    struct axidma_chan *chan;
+    struct axidma_queue *queue;
 
-    // Get the transmit and receive channels with the given ids.
-    tx_chan = axidma_get_chan(dev, trans->tx_channel_id);
-    if (tx_chan == NULL || tx_chan->dir != AXIDMA_WRITE) {
-        axidma_err("Invalid device id %d for DMA transmit channel.\n",
-                   trans->tx_channel_id);
+    chan = axidma_get_chan(dev, config->channel_id);
+    if (chan == NULL) {
+        axidma_err("Invalid device id %d for DMA channel.\n",
+                   config->channel_id);
         return -ENODEV;
     }
+    queue = axidma_get_queue(dev, chan);
+    if (ctx != NULL) {
+        rc = axidma_check_claim(ctx, queue);
+        if (rc < 0) {
+            return rc;
+        }
+    }
 
-    rx_chan = axidma_get_chan(dev, trans->rx_channel_id);
-    if (rx_chan == NULL || rx_chan->dir != AXIDMA_READ) {
-        axidma_err("Invalid device id %d for DMA receive channel.\n",
-                   trans->rx_channel_id);
+    // The record pool cannot grow, so the depth is limited to its size
+    if (config->queue_depth == 0 || config->queue_depth > queue->depth) {
+        axidma_err("Queue depth %u is not between 1 and %d.\n",
+                   config->queue_depth, queue->depth);
+        return -EINVAL;
+    } else if (config->irq_threshold == 0 ||
+               config->irq_threshold > AXIDMA_MAX_IRQ_THRESHOLD ||
+               config->irq_threshold > config->queue_depth) {
+        axidma_err("Interrupt threshold %u is not between 1 and the smaller "
+                   "of %d and the queue depth.\n", config->irq_threshold,
+                   AXIDMA_MAX_IRQ_THRESHOLD);
+        return -EINVAL;
+    } else if (config->timeout_ms == 0) {
+        axidma_err("The timeout for transfers cannot be 0.\n");
+        return -EINVAL;
+    }
+
+    spin_lock_irqsave(&queue->lock, flags);
+    *queue->config = *config;
+    spin_unlock_irqrestore(&queue->lock, flags);
+
+    return 0;
+}
+
+int axidma_get_channel_config(struct axidma_device *dev,
+                              struct axidma_channel_config *config)
+{
+    unsigned long flags;
+    struct axidma_chan *chan;
+    struct axidma_queue *queue;
+
+    chan = axidma_get_chan(dev, config->channel_id);
+    if (chan == NULL) {
+        axidma_err("Invalid device id %d for DMA channel.\n",
+                   config->channel_id);
         return -ENODEV;
     }
+    queue = axidma_get_queue(dev, chan);
 
-    // Setup the scatter-gather list for the transfers (only one entry)
-    sg_init_table(&tx_sg_list, 1);
-    rc = axidma_init_sg_entry(dev, &tx_sg_list, 0, trans->tx_buf,
-                              trans->tx_buf_len);
-    if (rc < 0) {
-        return rc;
+    spin_lock_irqsave(&queue->lock, flags);
+    *config = *queue->config;
+    spin_unlock_irqrestore(&queue->lock, flags);
+
+    return 0;
+}
+
+int axidma_get_stats(struct axidma_device *dev,
+                     struct axidma_channel_stats *stats)
+{
+    int channel_id;
+    unsigned long flags;
+    struct axidma_chan *chan;
+    struct axidma_queue *queue;
+
+    channel_id = stats->channel_id;
+    chan = axidma_get_chan(dev, channel_id);
+    if (chan == NULL) {
+        axidma_err("Invalid device id %d for DMA channel.\n", channel_id);
+        return -ENODEV;
+    }
+
+    // Take a consistent snapshot of the counters
+    queue = axidma_get_queue(dev, chan);
+    spin_lock_irqsave(&queue->lock, flags);
+    *stats = queue->stats;
+    spin_unlock_irqrestore(&queue->lock, flags);
+    stats->channel_id = channel_id;
+
+    return 0;
+}
+
+int axidma_set_poll_budget(struct axidma_context *ctx,
+                           struct axidma_busy_poll *poll)
+{
+    int rc;
+    struct axidma_chan *chan;
+    struct axidma_queue *queue;
+
+    chan = axidma_get_chan(ctx->dev, poll->channel_id);
+    if (chan == NULL) {
+        axidma_err("Invalid device id %d for DMA channel.\n",
+                   poll->channel_id);
+        return -ENODEV;
     }
-    sg_init_table(&rx_sg_list, 1);
-    rc = axidma_init_sg_entry(dev, &rx_sg_list, 0, trans->rx_buf,
-                              trans->rx_buf_len);
+
+    queue = axidma_get_queue(ctx->dev, chan);
+    rc = axidma_check_claim(ctx, queue);
     if (rc < 0) {
         return rc;
     }
+    WRITE_ONCE(queue->poll_budget_ns, poll->budget_ns);
+    return 0;
+}
 
-    // Setup receive and trasmit transfer structures for DMA
-    tx_tfr.sg_list = &tx_sg_list,
-    tx_tfr.sg_len = 1,
-    tx_tfr.dir = tx_chan->dir,
-    tx_tfr.type = tx_chan->type,
-    tx_tfr.wait = false,
-    tx_tfr.channel_id = trans->tx_channel_id,
-    tx_tfr.notify_signal = dev->notify_signal,
-    tx_tfr.process = get_current(),
-    tx_tfr.cb_data = &dev->cb_data[trans->tx_channel_id];
+int axidma_get_poll_stats(struct axidma_device *dev,
+                          struct axidma_busy_poll *poll)
+{
+    struct axidma_chan *chan;
+    struct axidma_queue *queue;
 
-    // Add in the frame information for VDMA transfers
-    if (tx_chan->type == AXIDMA_VDMA) {
-        memcpy(&tx_tfr.frame, &trans->tx_frame, sizeof(tx_tfr.frame));
+    chan = axidma_get_chan(dev, poll->channel_id);
+    if (chan == NULL) {
+        axidma_err("Invalid device id %d for DMA channel.\n",
+                   poll->channel_id);
+        return -ENODEV;
     }
 
-    rx_tfr.sg_list = &rx_sg_list,
-    rx_tfr.sg_len = 1,
-    rx_tfr.dir = rx_chan->dir,
-    rx_tfr.type = rx_chan->type,
-    rx_tfr.wait = trans->wait,
-    rx_tfr.channel_id = trans->rx_channel_id,
-    rx_tfr.notify_signal = dev->notify_signal,
-    rx_tfr.process = get_current(),
-    rx_tfr.cb_data = &dev->cb_data[trans->rx_channel_id];
+    queue = axidma_get_queue(dev, chan);
+    poll->budget_ns = READ_ONCE(queue->poll_budget_ns);
+    poll->hits = atomic64_read(&queue->poll_hits);
+    poll->misses = atomic64_read(&queue->poll_misses);
+    poll->spin_ns = atomic64_read(&queue->poll_spin_ns);
+    return 0;
+}
 
-    // Add in the frame information for VDMA transfers
-    if (tx_chan->type == AXIDMA_VDMA) {
-        memcpy(&rx_tfr.frame, &trans->rx_frame, sizeof(rx_tfr.frame));
-    }
+int axidma_prepare_transfer(struct axidma_context *ctx,
+                            struct axidma_prepare *prepare)
+{
+    int rc;
+    struct axidma_prepared *prepared;
+    struct axidma_transaction *trans;
 
-    // Prep both the receive and transmit transfers
-    rc = axidma_prep_transfer(tx_chan, &tx_tfr);
+    // Allocate the prepared transfer, taking the table's reference
+    prepared = kmalloc(sizeof(*prepared), GFP_KERNEL);
+    if (prepared == NULL) {
+        axidma_err("Unable to allocate the prepared transfer.\n");
+        return -ENOMEM;
+    }
+    kref_init(&prepared->ref);
+    mutex_init(&prepared->lock);
+    prepared->trans = prepare->trans;
+    trans = &prepared->trans;
+
+    // Get the channel with the given id, the direction is taken from it
+    prepared->chan = axidma_get_chan(ctx->dev, trans->channel_id);
+    if (prepared->chan == NULL || prepared->chan->type != AXIDMA_DMA) {
+        axidma_err("Invalid device id %d for DMA channel.\n",
+                   trans->channel_id);
+        rc = -ENODEV;
+        goto free_prepared;
+    }
+    rc = axidma_check_rx_app(prepared->chan, trans->flags, trans->wait);
     if (rc < 0) {
-        return rc;
+        goto free_prepared;
     }
-    rc = axidma_prep_transfer(rx_chan, &rx_tfr);
+    prepared->queue = axidma_get_queue(ctx->dev, prepared->chan);
+
+    /* Build the scatter-gather list, noting the generation of the buffers
+     * beforehand, so that a buffer removed meanwhile is caught on start. */
+    down_read(&ctx->buffers_lock);
+    prepared->buffers_gen = READ_ONCE(ctx->buffers_gen);
+    rc = axidma_init_sg(ctx, &prepared->sg, trans->buf, trans->buf_len);
+    up_read(&ctx->buffers_lock);
     if (rc < 0) {
-        return rc;
+        goto free_prepared;
     }
 
-    // Submit both transfers to the DMA engine, and wait on the receive transfer
-    rc = axidma_start_transfer(tx_chan, &tx_tfr);
+    // Add the transfer to the table, and return its id to the user
+    idr_preload(GFP_KERNEL);
+    spin_lock(&ctx->prepared_lock);
+    rc = idr_alloc(&ctx->prepared, prepared, 0, 0, GFP_NOWAIT);
+    spin_unlock(&ctx->prepared_lock);
+    idr_preload_end();
     if (rc < 0) {
-        return rc;
+        axidma_err("Unable to allocate an id for the prepared transfer.\n");
+        goto free_sg;
     }
-    rc = axidma_start_transfer(rx_chan, &rx_tfr);
-    if (rc < 0) {
-        return rc;
+    prepare->id = rc;
+    return 0;
+
+free_sg:
+    axidma_free_sg(&prepared->sg);
+free_prepared:
+    kfree(prepared);
+    return rc;
+}
+
+int axidma_start_prepared(struct axidma_context *ctx, int id)
+{
+    int rc;
+    unsigned long buffers_gen;
+    struct axidma_prepared *prepared;
+    struct axidma_transaction *trans;
+    struct axidma_transfer tfr;
+
+    // Find the prepared transfer, and hold it while it is started
+    spin_lock(&ctx->prepared_lock);
+    prepared = idr_find(&ctx->prepared, id);
+    if (prepared != NULL) {
+        kref_get(&prepared->ref);
+    }
+    spin_unlock(&ctx->prepared_lock);
+    if (prepared == NULL) {
+        axidma_err("Invalid prepared transfer id %d.\n", id);
+        return -EINVAL;
+    }
+    trans = &prepared->trans;
+
+    /* If a buffer was removed since the list was built, build it again. The
+     * buffer lock is held until the transfer is submitted, so that none can
+     * be removed in between. */
+    mutex_lock(&prepared->lock);
+    down_read(&ctx->buffers_lock);
+    buffers_gen = READ_ONCE(ctx->buffers_gen);
+    if (buffers_gen != prepared->buffers_gen) {
+        axidma_free_sg(&prepared->sg);
+        rc = axidma_init_sg(ctx, &prepared->sg, trans->buf, trans->buf_len);
+        if (rc < 0) {
+            // Leave an empty list, and try again on the next start
+            prepared->sg.sg_list = prepared->sg.inline_sg;
+            prepared->sg.sg_len = 0;
+            goto unlock;
+        }
+        prepared->buffers_gen = buffers_gen;
+    }
+
+    // Setup the transfer structure from the prepared list
+    tfr.sg_list = prepared->sg.sg_list;
+    tfr.sg_len = prepared->sg.sg_len;
+    tfr.dir = prepared->chan->dir;
+    tfr.type = prepared->chan->type;
+    tfr.wait = trans->wait;
+    tfr.reap = false;
+    tfr.channel_id = trans->channel_id;
+    tfr.notify_signal = ctx->notify_signal;
+    tfr.process = get_current();
+    tfr.ctx = ctx;
+    tfr.user_tag = trans->user_tag;
+    tfr.app = trans->app;
+    tfr.buf = trans->buf;
+    tfr.buf_len = trans->buf_len;
+
+    /* Prepare the transfer, the list is free to be rebuilt once the engine has
+     * copied it. This returns the number of bytes transferred, for synchronous
+     * transfers. */
+    rc = axidma_prep_transfer(prepared->queue, &tfr);
+    up_read(&ctx->buffers_lock);
+    mutex_unlock(&prepared->lock);
+    if (rc == 0) {
+        rc = axidma_start_transfer(prepared->queue, &tfr);
+    }
+    kref_put(&prepared->ref, axidma_free_prepared);
+    return rc;
+
+unlock:
+    up_read(&ctx->buffers_lock);
+    mutex_unlock(&prepared->lock);
+    kref_put(&prepared->ref, axidma_free_prepared);
+    return rc;
+}
+
+int axidma_unprepare_transfer(struct axidma_context *ctx, int id)
+{
+    struct axidma_prepared *prepared;
+
+    // Remove the transfer from the table, it is freed after its last start
+    spin_lock(&ctx->prepared_lock);
+    prepared = idr_remove(&ctx->prepared, id);
+    spin_unlock(&ctx->prepared_lock);
+    if (prepared == NULL) {
+        axidma_err("Invalid prepared transfer id %d.\n", id);
+        return -EINVAL;
+    }
+
+    kref_put(&prepared->ref, axidma_free_prepared);
+    return 0;
+}
+
+// Frees all of the prepared transfers that were never unprepared
+void axidma_release_prepared(struct axidma_context *ctx)
+{
+    int id;
+    struct axidma_prepared *prepared;
+
+    spin_lock(&ctx->prepared_lock);
+    idr_for_each_entry(&ctx->prepared, prepared, id)
+    {
+        idr_remove(&ctx->prepared, id);
+        kref_put(&prepared->ref, axidma_free_prepared);
     }
+    spin_unlock(&ctx->prepared_lock);
 
-    return 0;
+    return;
 }
 
-int axidma_video_transfer(struct axidma_device *dev,
+int axidma_video_transfer(struct axidma_context *ctx,
                           struct axidma_video_transaction *trans,
                           enum axidma_dir dir)
 {
     int rc, i;
     size_t image_size;
+    struct axidma_device *dev;
     struct axidma_chan *chan;
+    struct axidma_queue *queue;
     struct scatterlist *sg_list;
 
     // Setup transmit transfer structure for DMA
@@ -560,11 +3138,15 @@ int axidma_video_transfer(struct axidma_device *dev,
         .dir = dir,
         .type = AXIDMA_VDMA,
         .wait = false,
+        .reap = false,
         .channel_id = trans->channel_id,
-        .notify_signal = dev->notify_signal,
+        .notify_signal = ctx->notify_signal,
         .process = get_current(),
+        .ctx = ctx,
+        .buf = NULL,
         .frame = trans->frame,
     };
+    dev = ctx->dev;
 
     // Allocate an array to store the scatter list structures for the buffers
     transfer.sg_list = kmalloc(transfer.sg_len * sizeof(*sg_list), GFP_KERNEL);
@@ -574,51 +3156,56 @@ int axidma_video_transfer(struct axidma_device *dev,
         goto ret;
     }
 
-    // For each frame, setup a scatter-gather entry
+    // Get the channel with the given id
+    chan = axidma_get_chan(dev, trans->channel_id);
+    if (chan == NULL || chan->dir != dir || chan->type != AXIDMA_VDMA) {
+        axidma_err("Invalid device id %d for VDMA %s channel.\n",
+                   trans->channel_id, axidma_dir_to_string(dir));
+        rc = -ENODEV;
+        goto free_sg_list;
+    }
+    queue = axidma_get_queue(dev, chan);
+
+    /* For each frame, setup a scatter-gather entry, then prepare the transfer.
+     * The buffer lock is held until it is submitted, so that none of the
+     * frame buffers can be removed in between. */
+    down_read(&ctx->buffers_lock);
     image_size = trans->frame.width * trans->frame.height * trans->frame.depth;
     for (i = 0; i < transfer.sg_len; i++)
     {
-        rc = axidma_init_sg_entry(dev, transfer.sg_list, i,
+        rc = axidma_init_sg_entry(ctx, transfer.sg_list, i,
                                   trans->frame_buffers[i], image_size);
         if (rc < 0) {
-            goto free_sg_list;
+            goto unlock_buffers;
         }
     }
+    rc = axidma_prep_transfer(queue, &transfer);
 
-    // Get the channel with the given id
-    chan = axidma_get_chan(dev, trans->channel_id);
-    if (chan == NULL && chan->dir != dir &&
-            chan->type != AXIDMA_VDMA) {
-        axidma_err("Invalid device id %d for VDMA %s channel.\n",
-                   trans->channel_id, axidma_dir_to_string(chan->dir));
-        rc = -ENODEV;
-        goto free_sg_list;
-    }
-    transfer.cb_data = &dev->cb_data[trans->channel_id];
-
-    // Prepare the transmit transfer
-    rc = axidma_prep_transfer(chan, &transfer);
+unlock_buffers:
+    up_read(&ctx->buffers_lock);
     if (rc < 0) {
         goto free_sg_list;
     }
 
     // Submit the transfer, and immediately return
-    rc = axidma_start_transfer(chan, &transfer);
+    rc = axidma_start_transfer(queue, &transfer);
 
 free_sg_list:
     kfree(transfer.sg_list);
 ret:
-    return 0;
+    return rc;
 }
 
-int axidma_stop_channel(struct axidma_device *dev,
+int axidma_stop_channel(struct axidma_context *ctx,
                         struct axidma_chan *chan_info)
 {
+    int rc;
     struct axidma_chan *chan;
+    struct axidma_queue *queue;
 
     // Get the transmit and receive channels with the given ids.
-    chan = axidma_get_chan(dev, chan_info->channel_id);
-    if (chan == NULL && chan->type != chan_info->type &&
+    chan = axidma_get_chan(ctx->dev, chan_info->channel_id);
+    if (chan == NULL || chan->type != chan_info->type ||
             chan->dir != chan_info->dir) {
         axidma_err("Invalid channel id %d for %s %s channel.\n",
             chan_info->channel_id, axidma_type_to_string(chan_info->type),
@@ -626,8 +3213,441 @@ int axidma_stop_channel(struct axidma_device *dev,
         return -ENODEV;
     }
 
-    // Terminate all DMA transactions on the given channel
-    return dmaengine_terminate_all(chan->chan);
+    /* Stop the forwarding or receive ring, if one is running, and terminate
+     * all DMA transactions on the given channel, reporting any that were
+     * still in flight as cancelled. */
+    queue = axidma_get_queue(ctx->dev, chan);
+    rc = axidma_check_claim(ctx, queue);
+    if (rc < 0) {
+        return rc;
+    }
+    axidma_forward_stop_queue(ctx->dev, queue);
+    mutex_lock(&queue->submit_lock);
+    axidma_rx_ring_stop(queue);
+    mutex_unlock(&queue->submit_lock);
+    axidma_queue_flush(queue, -ECANCELED);
+    return 0;
+}
+
+/* Starts a receive ring on the channel, with every slot armed at once. The
+ * ring's indices are given by their kernel address, which must stay valid
+ * until the ring is stopped. */
+int axidma_start_rx_ring(struct axidma_context *ctx,
+                         struct axidma_rx_ring_config *config,
+                         struct axidma_rx_ring *ring, u32 num_slots)
+{
+    int rc;
+    u32 i;
+    unsigned long flags;
+    char *slot_addr;
+    struct axidma_chan *chan;
+    struct axidma_queue *queue;
+    struct axidma_rx_stream *stream;
+
+    // Get the channel with the given id, which must receive plain DMA
+    chan = axidma_get_chan(ctx->dev, config->channel_id);
+    if (chan == NULL || chan->dir != AXIDMA_READ || chan->type != AXIDMA_DMA) {
+        axidma_err("Invalid device id %d for DMA receive channel.\n",
+                   config->channel_id);
+        return -ENODEV;
+    }
+    queue = axidma_get_queue(ctx->dev, chan);
+    rc = axidma_check_claim(ctx, queue);
+    if (rc < 0) {
+        return rc;
+    }
+
+    if (config->slot_size == 0 || config->slot_size > SIZE_MAX / num_slots) {
+        axidma_err("Invalid slot size %zu for a receive ring of %u slots.\n",
+                   config->slot_size, num_slots);
+        return -EINVAL;
+    }
+
+    // Allocate the state for the ring
+    stream = kzalloc(sizeof(*stream), GFP_KERNEL);
+    if (stream == NULL) {
+        axidma_err("Unable to allocate the receive ring state.\n");
+        return -ENOMEM;
+    }
+    stream->slots = kcalloc(num_slots, sizeof(stream->slots[0]), GFP_KERNEL);
+    if (stream->slots == NULL) {
+        axidma_err("Unable to allocate the receive ring slots.\n");
+        kfree(stream);
+        return -ENOMEM;
+    }
+    stream->queue = queue;
+    stream->ctx = ctx;
+    spin_lock_init(&stream->lock);
+    stream->ring = ring;
+    stream->buf = config->buf;
+    stream->num_slots = num_slots;
+    stream->slot_size = config->slot_size;
+
+    /* Build the scatter-gather list for every slot now, so re-arming is cheap.
+     * The buffer lock is held until the ring is running, so that its slots
+     * cannot be removed before then. */
+    down_read(&ctx->buffers_lock);
+    for (i = 0; i < num_slots; i++)
+    {
+        slot_addr = (char *)config->buf + (size_t)i * config->slot_size;
+        rc = axidma_init_sg(ctx, &stream->slots[i], slot_addr,
+                            config->slot_size);
+        if (rc < 0) {
+            goto free_stream;
+        }
+    }
+
+    // The channel must be idle, since the ring takes it over entirely
+    mutex_lock(&queue->submit_lock);
+    if (!axidma_queue_idle(queue)) {
+        axidma_err("Channel %d has transfers in flight.\n", config->channel_id);
+        rc = -EBUSY;
+        goto unlock_submit;
+    }
+
+    // Reset the shared indices, then arm every slot and start the channel
+    ring->producer = 0;
+    ring->consumer = 0;
+    ring->num_slots = num_slots;
+    ring->flags = 0;
+    ring->status = 0;
+    spin_lock_irqsave(&stream->lock, flags);
+    axidma_rx_ring_refill(stream);
+    spin_unlock_irqrestore(&stream->lock, flags);
+    if (stream->armed == 0) {
+        axidma_err("Unable to arm any slots of the receive ring.\n");
+        rc = -EBUSY;
+        goto unlock_submit;
+    }
+
+    queue->rx_stream = stream;
+    mutex_unlock(&queue->submit_lock);
+    up_read(&ctx->buffers_lock);
+    return 0;
+
+unlock_submit:
+    mutex_unlock(&queue->submit_lock);
+free_stream:
+    up_read(&ctx->buffers_lock);
+    axidma_free_rx_stream(stream, i);
+    return rc;
+}
+
+// Re-arms the slots of a receive ring that has stalled
+int axidma_kick_rx_ring(struct axidma_context *ctx, int channel_id)
+{
+    int rc;
+    unsigned long flags;
+    struct axidma_chan *chan;
+    struct axidma_queue *queue;
+    struct axidma_rx_stream *stream;
+
+    chan = axidma_get_chan(ctx->dev, channel_id);
+    if (chan == NULL) {
+        axidma_err("Invalid device id %d for DMA channel.\n", channel_id);
+        return -ENODEV;
+    }
+
+    // Only the file that started the ring can kick it
+    rc = 0;
+    queue = axidma_get_queue(ctx->dev, chan);
+    mutex_lock(&queue->submit_lock);
+    stream = queue->rx_stream;
+    if (stream != NULL && stream->ctx == ctx) {
+        spin_lock_irqsave(&stream->lock, flags);
+        WRITE_ONCE(stream->ring->flags, 0);
+        axidma_rx_ring_refill(stream);
+        spin_unlock_irqrestore(&stream->lock, flags);
+    } else {
+        axidma_err("Channel %d is not running a receive ring.\n", channel_id);
+        rc = -ENOENT;
+    }
+    mutex_unlock(&queue->submit_lock);
+
+    return rc;
+}
+
+/* Stops the receive rings that use the given indices, or all of the receive
+ * rings if none are given. */
+void axidma_stop_rx_rings(struct axidma_device *dev,
+                          struct axidma_rx_ring *ring)
+{
+    int i;
+    struct axidma_queue *queue;
+
+    for (i = 0; i < dev->num_chans; i++)
+    {
+        queue = &dev->queues[i];
+        mutex_lock(&queue->submit_lock);
+        if (queue->rx_stream != NULL &&
+                (ring == NULL || queue->rx_stream->ring == ring)) {
+            axidma_rx_ring_stop(queue);
+        }
+        mutex_unlock(&queue->submit_lock);
+    }
+
+    return;
+}
+
+/* Stops the receive rings started by the file whose slots overlap the given
+ * user range, before the memory behind the slots is released. */
+void axidma_stop_rx_ring_slots(struct axidma_context *ctx, void *user_addr,
+                               size_t size)
+{
+    int i;
+    char *ring_start, *ring_end;
+    struct axidma_device *dev;
+    struct axidma_queue *queue;
+    struct axidma_rx_stream *stream;
+
+    dev = ctx->dev;
+    for (i = 0; i < dev->num_chans; i++)
+    {
+        queue = &dev->queues[i];
+        mutex_lock(&queue->submit_lock);
+        stream = queue->rx_stream;
+        if (stream != NULL && stream->ctx == ctx) {
+            ring_start = stream->buf;
+            ring_end = ring_start + (size_t)stream->num_slots *
+                       stream->slot_size;
+            if (ring_start < (char *)user_addr + size &&
+                    (char *)user_addr < ring_end) {
+                axidma_rx_ring_stop(queue);
+            }
+        }
+        mutex_unlock(&queue->submit_lock);
+    }
+
+    return;
+}
+
+/* Forwards every packet received on one channel out on another, with the
+ * slots circulating between the channels from their completion callbacks. */
+int axidma_start_forward(struct axidma_context *ctx,
+                         struct axidma_forward_config *config)
+{
+    int rc;
+    u32 i, num_slots;
+    unsigned long flags;
+    char *slot_addr;
+    struct axidma_device *dev;
+    struct axidma_chan *rx_chan, *tx_chan;
+    struct axidma_queue *rx_queue, *tx_queue;
+    struct axidma_forward *fwd;
+    struct axidma_forward_slot *slot;
+
+    dev = ctx->dev;
+
+    // Get the channels with the given ids, which must both be plain DMA
+    rx_chan = axidma_get_chan(dev, config->rx_channel_id);
+    if (rx_chan == NULL || rx_chan->dir != AXIDMA_READ ||
+            rx_chan->type != AXIDMA_DMA) {
+        axidma_err("Invalid device id %d for DMA receive channel.\n",
+                   config->rx_channel_id);
+        return -ENODEV;
+    }
+    tx_chan = axidma_get_chan(dev, config->tx_channel_id);
+    if (tx_chan == NULL || tx_chan->dir != AXIDMA_WRITE ||
+            tx_chan->type != AXIDMA_DMA) {
+        axidma_err("Invalid device id %d for DMA transmit channel.\n",
+                   config->tx_channel_id);
+        return -ENODEV;
+    }
+    rx_queue = axidma_get_queue(dev, rx_chan);
+    tx_queue = axidma_get_queue(dev, tx_chan);
+    rc = axidma_check_claim(ctx, rx_queue);
+    if (rc < 0) {
+        return rc;
+    }
+    rc = axidma_check_claim(ctx, tx_queue);
+    if (rc < 0) {
+        return rc;
+    }
+
+    if (config->num_slots <= 0 ||
+            config->num_slots > AXIDMA_MAX_FORWARD_SLOTS) {
+        axidma_err("Invalid number of forwarding slots %d.\n",
+                   config->num_slots);
+        return -EINVAL;
+    }
+    num_slots = config->num_slots;
+    if (config->slot_size == 0 || config->slot_size > SIZE_MAX / num_slots) {
+        axidma_err("Invalid slot size %zu for forwarding with %u slots.\n",
+                   config->slot_size, num_slots);
+        return -EINVAL;
+    }
+
+    // Allocate the state for the forwarding
+    fwd = kzalloc(sizeof(*fwd), GFP_KERNEL);
+    if (fwd == NULL) {
+        axidma_err("Unable to allocate the forwarding state.\n");
+        return -ENOMEM;
+    }
+    fwd->slots = kcalloc(num_slots, sizeof(fwd->slots[0]), GFP_KERNEL);
+    if (fwd->slots == NULL) {
+        axidma_err("Unable to allocate the forwarding slots.\n");
+        kfree(fwd);
+        return -ENOMEM;
+    }
+    fwd->rx_queue = rx_queue;
+    fwd->tx_queue = tx_queue;
+    fwd->ctx = ctx;
+    spin_lock_init(&fwd->lock);
+    fwd->buf = config->buf;
+    fwd->num_slots = num_slots;
+    fwd->slot_size = config->slot_size;
+    fwd->max_length = config->max_length;
+
+    /* Build the scatter-gather lists for every slot now, so that the callbacks
+     * only have to hand them to the engines. The buffer lock is held until
+     * the forwarding is running, so that its slots cannot be removed before
+     * then. */
+    down_read(&ctx->buffers_lock);
+    for (i = 0; i < num_slots; i++)
+    {
+        slot = &fwd->slots[i];
+        slot->fwd = fwd;
+        slot_addr = (char *)config->buf + (size_t)i * config->slot_size;
+        rc = axidma_init_sg(ctx, &slot->rx_sg, slot_addr, config->slot_size);
+        if (rc < 0) {
+            goto free_forward;
+        }
+        rc = axidma_init_sg(ctx, &slot->tx_sg, slot_addr, config->slot_size);
+        if (rc < 0) {
+            axidma_free_sg(&slot->rx_sg);
+            goto free_forward;
+        }
+    }
+
+    // Both channels must be idle, since the forwarding takes them over
+    mutex_lock(&dev->forward_lock);
+    mutex_lock(&rx_queue->submit_lock);
+    mutex_lock_nested(&tx_queue->submit_lock, SINGLE_DEPTH_NESTING);
+    if (!axidma_queue_idle(rx_queue) || !axidma_queue_idle(tx_queue)) {
+        axidma_err("Channel %d or %d has transfers in flight.\n",
+                   config->rx_channel_id, config->tx_channel_id);
+        rc = -EBUSY;
+        goto unlock_submit;
+    }
+
+    // Arm every slot, then start the receive channel on all of them at once
+    spin_lock_irqsave(&fwd->lock, flags);
+    for (i = 0; i < num_slots; i++)
+    {
+        rc = axidma_forward_arm(&fwd->slots[i]);
+        if (rc < 0) {
+            break;
+        }
+    }
+    spin_unlock_irqrestore(&fwd->lock, flags);
+    if (rc < 0) {
+        axidma_err("Unable to arm all %u slots for forwarding.\n", num_slots);
+        axidma_terminate_sync(rx_chan->chan);
+        i = num_slots;
+        goto unlock_submit;
+    }
+
+    rx_queue->forward = fwd;
+    tx_queue->forward = fwd;
+    dma_async_issue_pending(rx_chan->chan);
+    mutex_unlock(&tx_queue->submit_lock);
+    mutex_unlock(&rx_queue->submit_lock);
+    mutex_unlock(&dev->forward_lock);
+    up_read(&ctx->buffers_lock);
+    return 0;
+
+unlock_submit:
+    mutex_unlock(&tx_queue->submit_lock);
+    mutex_unlock(&rx_queue->submit_lock);
+    mutex_unlock(&dev->forward_lock);
+free_forward:
+    up_read(&ctx->buffers_lock);
+    axidma_free_forward(fwd, i);
+    return rc;
+}
+
+/* Stops the forwarding started by the file whose slots overlap the given user
+ * range, or all of the file's forwarding if no range is given. */
+void axidma_stop_forwards(struct axidma_context *ctx, void *user_addr,
+                          size_t size)
+{
+    int i;
+    char *fwd_start, *fwd_end;
+    struct axidma_device *dev;
+    struct axidma_forward *fwd;
+    struct axidma_queue *queue, *tx_queue;
+
+    dev = ctx->dev;
+    mutex_lock(&dev->forward_lock);
+    for (i = 0; i < dev->num_chans; i++)
+    {
+        // Each forwarding is found through its receive queue only
+        queue = &dev->queues[i];
+        fwd = queue->forward;
+        if (fwd == NULL || fwd->rx_queue != queue || fwd->ctx != ctx) {
+            continue;
+        }
+
+        fwd_start = fwd->buf;
+        fwd_end = fwd_start + (size_t)fwd->num_slots * fwd->slot_size;
+        if (user_addr != NULL && (fwd_end <= (char *)user_addr ||
+                (char *)user_addr + size <= fwd_start)) {
+            continue;
+        }
+
+        tx_queue = fwd->tx_queue;
+        mutex_lock(&queue->submit_lock);
+        mutex_lock_nested(&tx_queue->submit_lock, SINGLE_DEPTH_NESTING);
+        axidma_forward_stop(fwd);
+        mutex_unlock(&tx_queue->submit_lock);
+        mutex_unlock(&queue->submit_lock);
+    }
+    mutex_unlock(&dev->forward_lock);
+
+    return;
+}
+
+/* Stops the channels that have transfers of the file in flight on the given
+ * user range, before the memory behind it is released. Transfers that span
+ * several buffers are stopped for any of them. The buffer lock must be held
+ * for writing, so that no more transfers can be submitted on the range. */
+void axidma_stop_transfers(struct axidma_context *ctx, void *user_addr,
+                           size_t size)
+{
+    int i;
+    bool busy;
+    unsigned long flags;
+    struct axidma_device *dev;
+    struct axidma_queue *queue;
+    struct axidma_cb_data *cb_data;
+
+    dev = ctx->dev;
+    for (i = 0; i < dev->num_chans; i++)
+    {
+        busy = false;
+        queue = &dev->queues[i];
+        spin_lock_irqsave(&queue->lock, flags);
+        list_for_each_entry(cb_data, &queue->active_list, list)
+        {
+            if (cb_data->ctx != ctx || cb_data->done) {
+                continue;
+            }
+            if (cb_data->buf == NULL ||
+                    ((char *)cb_data->buf < (char *)user_addr + size &&
+                     (char *)user_addr < (char *)cb_data->buf +
+                                         cb_data->buf_len)) {
+                busy = true;
+                break;
+            }
+        }
+        spin_unlock_irqrestore(&queue->lock, flags);
+
+        if (busy) {
+            axidma_queue_flush(queue, -ECANCELED);
+        }
+    }
+
+    return;
 }
 
 /*----------------------------------------------------------------------------
@@ -666,10 +3686,176 @@ release_channels:
     return rc;
 }
 
+// Frees the data-ready interrupts of the first `num_chans` channels
+static void axidma_free_ready_irqs(struct axidma_device *dev, int num_chans)
+{
+    int i;
+    struct axidma_queue *queue;
+
+    for (i = 0; i < num_chans; i++)
+    {
+        queue = &dev->queues[i];
+        if (queue->ready_irq > 0) {
+            free_irq(queue->ready_irq, queue);
+            queue->ready_irq = 0;
+            queue->chan->ready_flags = 0;
+        }
+    }
+
+    return;
+}
+
+/* Requests the data-ready interrupt of each receive channel that has one in
+ * the device tree, and maps the register that acknowledges it, if it has one.
+ * The mappings are released along with the device. */
+static int axidma_request_ready_irqs(struct platform_device *pdev,
+                                     struct axidma_device *dev)
+{
+    int rc, i;
+    struct resource res;
+    struct axidma_queue *queue;
+
+    for (i = 0; i < dev->num_chans; i++)
+    {
+        queue = &dev->queues[i];
+        rc = axidma_of_parse_ready_irq(pdev, queue->chan);
+        if (rc < 0) {
+            goto free_irqs;
+        } else if (rc == 0) {
+            continue;
+        }
+        queue->ready_irq = rc;
+
+        /* The register usually sits in a BRAM that userspace also maps, so the
+         * region is not claimed, which would keep /dev/mem from mapping it. */
+        rc = axidma_of_parse_ready_ack(pdev, queue->chan, &res);
+        if (rc < 0) {
+            queue->ready_irq = 0;
+            goto free_irqs;
+        } else if (rc > 0) {
+            queue->ready_ack = devm_ioremap(&pdev->dev, res.start,
+                                            resource_size(&res));
+            if (queue->ready_ack == NULL) {
+                axidma_err("Unable to map the data-ready acknowledge register "
+                           "for channel %d.\n", queue->chan->channel_id);
+                queue->ready_irq = 0;
+                rc = -ENOMEM;
+                goto free_irqs;
+            }
+        }
+
+        /* The handler prepares the receive, which may sleep, so it always
+         * runs in a thread, with the interrupt masked until it is done. */
+        rc = request_threaded_irq(queue->ready_irq, NULL, axidma_ready_irq,
+                                  IRQF_ONESHOT, queue->chan->name, queue);
+        if (rc < 0) {
+            axidma_err("Unable to request the data-ready interrupt %d for "
+                       "channel %d.\n", queue->ready_irq,
+                       queue->chan->channel_id);
+            queue->ready_irq = 0;
+            goto free_irqs;
+        }
+
+        // Tell userspace to leave the interrupt, and any acknowledge, alone
+        queue->chan->ready_flags = AXIDMA_CHAN_READY_IRQ;
+        if (queue->ready_ack != NULL) {
+            queue->chan->ready_flags |= AXIDMA_CHAN_READY_ACK;
+        }
+    }
+
+    return 0;
+
+free_irqs:
+    axidma_free_ready_irqs(dev, i);
+    return rc;
+}
+
+// Allocates the transfer queue for each channel, and fills its record pool
+static int axidma_init_queues(struct axidma_device *dev)
+{
+    int i, j;
+    struct axidma_queue *queue;
+    struct axidma_cb_data *cb_data;
+
+    dev->queues = kcalloc(dev->num_chans, sizeof(dev->queues[0]), GFP_KERNEL);
+    if (dev->queues == NULL) {
+        axidma_err("Unable to allocate memory for the transfer queues.\n");
+        return -ENOMEM;
+    }
+
+    for (i = 0; i < dev->num_chans; i++)
+    {
+        queue = &dev->queues[i];
+        queue->dev = dev;
+        queue->chan = &dev->channels[i];
+        queue->config = &dev->chan_configs[i];
+        queue->depth = queue->config->queue_depth;
+        queue->in_use = 0;
+        queue->deferred = 0;
+        memset(&queue->stats, 0, sizeof(queue->stats));
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,13,0)
+        hrtimer_setup(&queue->issue_timer, axidma_issue_timer,
+                      CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+#else
+        hrtimer_init(&queue->issue_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+        queue->issue_timer.function = axidma_issue_timer;
+#endif
+        mutex_init(&queue->submit_lock);
+        queue->poll_budget_ns = dev->poll_budget_ns;
+        atomic64_set(&queue->poll_hits, 0);
+        atomic64_set(&queue->poll_misses, 0);
+        atomic64_set(&queue->poll_spin_ns, 0);
+        spin_lock_init(&queue->lock);
+        INIT_LIST_HEAD(&queue->free_list);
+        INIT_LIST_HEAD(&queue->active_list);
+        INIT_LIST_HEAD(&queue->reap_list);
+        init_waitqueue_head(&queue->wait);
+
+        queue->pool = kcalloc(queue->depth, sizeof(queue->pool[0]),
+                              GFP_KERNEL);
+        if (queue->pool == NULL) {
+            axidma_err("Unable to allocate memory for the callback records.\n");
+            goto free_queues;
+        }
+
+        for (j = 0; j < queue->depth; j++)
+        {
+            cb_data = &queue->pool[j];
+            cb_data->queue = queue;
+            init_completion(&cb_data->comp);
+            list_add_tail(&cb_data->list, &queue->free_list);
+        }
+    }
+
+    return 0;
+
+free_queues:
+    for (i = 0; i < dev->num_chans; i++)
+    {
+        kfree(dev->queues[i].pool);
+    }
+    kfree(dev->queues);
+    return -ENOMEM;
+}
+
+static void axidma_free_queues(struct axidma_device *dev)
+{
+    int i;
+
+    for (i = 0; i < dev->num_chans; i++)
+    {
+        kfree(dev->queues[i].pool);
+    }
+    kfree(dev->queues);
+
+    return;
+}
+
 int axidma_dma_init(struct platform_device *pdev, struct axidma_device *dev)
 {
-    int rc;
+    int rc, i;
     size_t elem_size;
+    struct axidma_channel_config *config;
     u64 dma_mask;
 
     dma_mask = DMA_BIT_MASK(8 * sizeof(dma_addr_t));
@@ -693,25 +3879,53 @@ int axidma_dma_init(struct platform_device *pdev, struct axidma_device *dev)
         return -ENOMEM;
     }
 
-    // Allocate an array to store all callback structures, for async
-    elem_size = sizeof(dev->cb_data[0]);
-    dev->cb_data = kmalloc(dev->num_chans * elem_size, GFP_KERNEL);
-    if (dev->cb_data == NULL) {
-        axidma_err("Unable to allocate memory for callback structures.\n");
+    // Allocate the tunables for each channel, and fill in their defaults
+    if (dev->queue_depth <= 0) {
+        axidma_err("Invalid transfer queue depth %d.\n", dev->queue_depth);
+        rc = -EINVAL;
+        goto free_channels;
+    }
+    elem_size = sizeof(dev->chan_configs[0]);
+    dev->chan_configs = kcalloc(dev->num_chans, elem_size, GFP_KERNEL);
+    if (dev->chan_configs == NULL) {
+        axidma_err("Unable to allocate memory for channel tunables.\n");
         rc = -ENOMEM;
         goto free_channels;
     }
+    for (i = 0; i < dev->num_chans; i++)
+    {
+        config = &dev->chan_configs[i];
+        config->irq_threshold = AXIDMA_DEFAULT_IRQ_THRESHOLD;
+        config->irq_delay_us = AXIDMA_DEFAULT_IRQ_DELAY_US;
+        config->timeout_ms = AXIDMA_DEFAULT_TIMEOUT_MS;
+        config->queue_depth = dev->queue_depth;
+    }
 
-    // Parse the type and direction of each DMA channel from the device tree
+    /* Parse the type and direction of each DMA channel from the device tree,
+     * along with any tunables that override the defaults */
     rc = axidma_of_parse_dma_nodes(pdev, dev);
     if (rc < 0) {
-        return rc;
+        goto free_configs;
+    }
+
+    // Allocate a transfer queue for each channel, with its pool of records
+    mutex_init(&dev->forward_lock);
+    init_waitqueue_head(&dev->notify_wait);
+    rc = axidma_init_queues(dev);
+    if (rc < 0) {
+        goto free_configs;
     }
 
     // Exclusively request all of the channels in the device tree entry
     rc = axidma_request_channels(pdev, dev);
     if (rc < 0) {
-        goto free_callback_data;
+        goto free_queues;
+    }
+
+    // Take the data-ready interrupts, now that the channels can be started
+    rc = axidma_request_ready_irqs(pdev, dev);
+    if (rc < 0) {
+        goto release_channels;
     }
 
     axidma_info("DMA: Found %d transmit channels and %d receive channels.\n",
@@ -720,8 +3934,15 @@ int axidma_dma_init(struct platform_device *pdev, struct axidma_device *dev)
                 dev->num_vdma_tx_chans, dev->num_vdma_rx_chans);
     return 0;
 
-free_callback_data:
-    kfree(dev->cb_data);
+release_channels:
+    for (i = 0; i < dev->num_chans; i++)
+    {
+        dma_release_channel(dev->channels[i].chan);
+    }
+free_queues:
+    axidma_free_queues(dev);
+free_configs:
+    kfree(dev->chan_configs);
 free_channels:
     kfree(dev->channels);
     return rc;
@@ -732,17 +3953,22 @@ void axidma_dma_exit(struct axidma_device *dev)
     int i;
     struct dma_chan *chan;
 
+    // Stop the fabric from starting any more transfers
+    axidma_free_ready_irqs(dev, dev->num_chans);
+
     // Stop all running DMA transactions on all channels, and release
     for (i = 0; i < dev->num_chans; i++)
     {
         chan = dev->channels[i].chan;
-        dmaengine_terminate_all(chan);
+        axidma_queue_flush(&dev->queues[i], -ECANCELED);
         dma_release_channel(chan);
     }
+    axidma_clear_eventfds(dev, NULL);
 
-    // Free the channel and callback data arrays
+    // Free the channel, tunable and transfer queue arrays
+    axidma_free_queues(dev);
+    kfree(dev->chan_configs);
     kfree(dev->channels);
-    kfree(dev->cb_data);
 
     return;
 }
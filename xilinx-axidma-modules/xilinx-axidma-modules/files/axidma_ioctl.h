@@ -13,6 +13,7 @@
 #define AXIDMA_IOCTL_H_
 
 #include <asm/ioctl.h>              // IOCTL macros
+#include <linux/types.h>            // Fixed-width types for shared structures
 
 /*----------------------------------------------------------------------------
  * IOCTL Defintions
@@ -21,8 +22,45 @@
 // The standard name for the AXI DMA device
 #define AXIDMA_DEV_NAME     "axidma"
 
-// The standard path to the AXI DMA device
-#define AXIDMA_DEV_PATH     ("/dev/" AXIDMA_DEV_NAME)
+/* Each AXI DMA device in the device tree gets its own numbered device file,
+ * with its own channels and buffers. This is the path to the first one. The
+ * file can be opened by several processes at once. The buffers, transfers and
+ * completions of each open file are its own, and its channels are shared with
+ * the other files unless claimed with AXIDMA_CLAIM_CHANNEL. */
+#define AXIDMA_DEV_PATH     ("/dev/" AXIDMA_DEV_NAME "0")
+
+// The format of the path to the AXI DMA device with a given index
+#define AXIDMA_DEV_PATH_FMT ("/dev/" AXIDMA_DEV_NAME "%d")
+
+/* The page offsets passed to mmap() on the AXI DMA device, which select what
+ * kind of region is mapped into the process. DMA buffers are uncached unless a
+ * cached or write-combined buffer is requested. */
+#define AXIDMA_MMAP_DMA_BUFFER          0   // Allocate a new DMA buffer
+#define AXIDMA_MMAP_COMPLETION_RING     1   // Map the completion ring
+#define AXIDMA_MMAP_CACHED_BUFFER       2   // Allocate a cacheable DMA buffer
+#define AXIDMA_MMAP_WRITECOMBINE_BUFFER 3   // Allocate a write-combined buffer
+#define AXIDMA_MMAP_RX_RING             4   // Map a receive ring's indices
+
+/* The number of buckets in a channel's latency histogram. Bucket i counts the
+ * transfers that took between 2^i and 2^(i+1) nanoseconds, except that the
+ * first bucket also counts 0, and the last counts everything longer. */
+#define AXIDMA_LATENCY_BUCKETS          40
+
+/* The number of user application (APP) words in an AXI DMA scatter-gather
+ * descriptor, which carry out-of-band metadata alongside each packet. */
+#define AXIDMA_NUM_APP_WORDS            5
+
+/* Set in a transaction's flags to have the APP words of the received packet
+ * reported in the completion ring. The transfer fails with EOPNOTSUPP if the
+ * kernel's DMA driver cannot provide them. */
+#define AXIDMA_TRANS_RX_APP             (1 << 0)
+
+/* Set in a channel's ready_flags when the driver waits for the fabric's
+ * data-ready interrupt before starting each receive, and when it pulses the
+ * fabric's acknowledge register after each packet. Userspace then does
+ * neither. */
+#define AXIDMA_CHAN_READY_IRQ           (1 << 0)
+#define AXIDMA_CHAN_READY_ACK           (1 << 1)
 
 /*----------------------------------------------------------------------------
  * IOCTL Argument Definitions
@@ -72,6 +110,8 @@ struct axidma_chan {
     enum axidma_dir dir;            // The DMA direction of the channel
     enum axidma_type type;          // The DMA type of the channel
     int channel_id;                 // The identifier for the device
+    int stream_id;                  // The TDEST of the channel's stream
+    int ready_flags;                // How the fabric signals data is ready
     const char *name;               // Name of the channel (ignore)
     struct dma_chan *chan;          // The DMA channel (ignore)
 };
@@ -94,11 +134,19 @@ struct axidma_register_buffer {
     void *user_addr;                // User virtual address of the buffer
 };
 
+struct axidma_pin_buffer {
+    void *user_addr;                // User virtual address of the memory
+    size_t size;                    // The number of bytes to pin
+};
+
 struct axidma_transaction {
     bool wait;                      // Indicates if the call is blocking
     int channel_id;                 // The id of the DMA channel to use
     void *buf;                      // The buffer used for the transaction
     size_t buf_len;                 // The length of the buffer
+    __u64 user_tag;                 // Tag reported back in the completion
+    __u32 app[AXIDMA_NUM_APP_WORDS];    // APP words to send with the packet
+    __u32 flags;                    // AXIDMA_TRANS_* flags
 
     // Kept as a union for extend ability.
     union {
@@ -118,6 +166,92 @@ struct axidma_inout_transaction {
     struct axidma_video_frame rx_frame; // Frame information for receive.
 };
 
+struct axidma_channel_eventfd {
+    int channel_id;                 // The id of the DMA channel
+    int fd;                         // The eventfd to signal, or -1 to unbind
+};
+
+struct axidma_batch_transaction {
+    int num_transactions;           // The number of transactions in the array
+    struct axidma_transaction *transactions;    // The transactions to submit
+};
+
+struct axidma_sync_range {
+    void *user_addr;                // The start of the range to synchronize
+    size_t size;                    // The number of bytes in the range
+};
+
+struct axidma_handle {
+    int channel_id;                 // The id of the channel the transfer is on
+    __s32 cookie;                   // The DMA engine cookie for the transfer
+};
+
+struct axidma_submit {
+    struct axidma_transaction trans;    // The transfer to submit
+    struct axidma_handle handle;        // The handle for the transfer (output)
+};
+
+struct axidma_wait {
+    struct axidma_handle handle;    // The handle of the transfer to wait on
+    __u64 timeout_ns;               // How long to wait, in nanoseconds
+};
+
+struct axidma_prepare {
+    struct axidma_transaction trans;    // The transfer to prepare
+    int id;                             // The id of the transfer (output)
+};
+
+struct axidma_busy_poll {
+    int channel_id;                 // The id of the channel
+    __u64 budget_ns;                // How long to spin before sleeping
+    __u64 hits;                     // Transfers that finished while spinning
+    __u64 misses;                   // Transfers that slept after spinning
+    __u64 spin_ns;                  // The total time spent spinning
+};
+
+struct axidma_channel_config {
+    int channel_id;                 // The id of the channel
+    __u32 irq_threshold;            // The transfers to complete per interrupt
+    __u32 irq_delay_us;             // The longest a transfer is held back
+    __u32 timeout_ms;               // The timeout for synchronous transfers
+    __u32 queue_depth;              // The transfers in flight at once
+};
+
+struct axidma_channel_stats {
+    int channel_id;                 // The id of the channel
+    __u32 in_flight;                // Transfers currently on the engine
+    __u32 max_in_flight;            // The most transfers ever on the engine
+    __u64 submitted;                // Transfers handed to the engine
+    __u64 completed;                // Transfers that completed successfully
+    __u64 bytes;                    // Bytes moved by completed transfers
+    __u64 timeouts;                 // Synchronous transfers that timed out
+    __u64 errors;                   // Transfers that failed or were stopped
+    __u64 ready_irqs;               // Data-ready interrupts from the fabric
+    __u64 latency_hist[AXIDMA_LATENCY_BUCKETS];     // Submit to complete
+};
+
+struct axidma_export_buffer {
+    void *user_addr;                // User virtual address of the buffer
+    int fd;                         // The dma-buf for the buffer (output)
+};
+
+struct axidma_rx_ring_config {
+    int channel_id;                 // The id of the receive channel
+    void *ring;                     // The ring's indices, mapped with mmap
+    void *buf;                      // The buffer that holds all of the slots
+    size_t slot_size;               // The number of bytes in each slot
+    int num_slots;                  // The number of slots in the ring
+};
+
+struct axidma_forward_config {
+    int rx_channel_id;              // The id of the receive channel
+    int tx_channel_id;              // The id of the transmit channel
+    void *buf;                      // The buffer that holds all of the slots
+    size_t slot_size;               // The number of bytes in each slot
+    int num_slots;                  // The number of slots to circulate
+    size_t max_length;              // The most bytes to forward, or 0 for all
+};
+
 struct axidma_video_transaction {
     int channel_id;                 // The id of the DMA channel to transmit video
     int num_frame_buffers;          // The number of frame buffers to use.
@@ -125,6 +259,68 @@ struct axidma_video_transaction {
     struct axidma_video_frame frame;        // Information about the frame
 };
 
+// Set in a completion's flags when its APP words hold the received metadata
+#define AXIDMA_COMPLETION_APP_VALID     (1 << 0)
+
+/**
+ * Structure representing a completed asynchronous DMA transfer.
+ *
+ * These are written by the driver into the completion ring, one for each
+ * asynchronous transfer that finishes, in the order that they finish. For a
+ * receive on an AXI DMA channel that asked for them with AXIDMA_TRANS_RX_APP,
+ * the APP words are those the engine wrote into the packet's descriptor.
+ **/
+struct axidma_completion {
+    __u64 user_tag;                 ///< Tag given when the transfer was issued.
+    __u64 submit_ns;                ///< Time of submission, in nanoseconds.
+    __u64 complete_ns;              ///< Time of completion, in nanoseconds.
+    __u32 length;                   ///< The number of bytes transferred.
+    __s32 status;                   ///< 0 on success, a negative error code.
+    __s32 channel_id;               ///< The id of the channel used.
+    __u32 app[AXIDMA_NUM_APP_WORDS];    ///< APP words of a received packet.
+    __u32 flags;                    ///< AXIDMA_COMPLETION_* flags.
+    __u32 reserved;                 ///< Padding, always zero.
+};
+
+/**
+ * Structure at the start of the completion ring shared with userspace.
+ *
+ * The driver is the only producer, and advances `head` after it writes an
+ * entry. Userspace is the only consumer, and advances `tail` after it has read
+ * the entries. Both indices are free-running, and the entry for an index is
+ * found by taking it modulo `num_entries`.
+ **/
+struct axidma_completion_ring {
+    __u32 head;                     ///< Producer index, written by the driver.
+    __u32 tail;                     ///< Consumer index, written by userspace.
+    __u32 num_entries;              ///< The number of entries in the ring.
+    __u32 dropped;                  ///< Completions lost to a full ring.
+    struct axidma_completion entries[0];    ///< The completion entries.
+};
+
+// Set in a receive ring's flags when it needs AXIDMA_KICK_RX_RING to restart
+#define AXIDMA_RX_RING_NEED_KICK        (1 << 0)
+
+/**
+ * Structure at the start of a receive ring's indices shared with userspace.
+ *
+ * The driver keeps every slot of the ring that userspace does not own armed
+ * on the channel. When a slot is filled, the driver writes its length, then
+ * advances `producer`. Userspace advances `consumer` when it is done with a
+ * slot, which hands the slot back to be armed again. Both indices are
+ * free-running, and the slot for an index is found by taking it modulo
+ * `num_slots`.
+ **/
+struct axidma_rx_ring {
+    __u32 producer;                 ///< Slots filled, written by the driver.
+    __u32 consumer;                 ///< Slots handed back, set by userspace.
+    __u32 num_slots;                ///< The number of slots in the ring.
+    __u32 flags;                    ///< Ring state flags, set by the driver.
+    __s32 status;                   ///< The error that stopped the ring, or 0.
+    __u32 reserved;                 ///< Padding, always zero.
+    __u32 lengths[0];               ///< The number of bytes in each slot.
+};
+
 /*----------------------------------------------------------------------------
  * IOCTL Interface
  *----------------------------------------------------------------------------*/
@@ -133,7 +329,19 @@ struct axidma_video_transaction {
 #define AXIDMA_IOCTL_MAGIC              'W'
 
 // The number of IOCTL's implemented, used for verification
-#define AXIDMA_NUM_IOCTLS               10
+#define AXIDMA_NUM_IOCTLS               35
+
+// The maximum number of transactions that can be submitted in one batch
+#define AXIDMA_MAX_BATCH_TRANSACTIONS   256
+
+// The maximum number of slots that can circulate between forwarded channels
+#define AXIDMA_MAX_FORWARD_SLOTS        1024
+
+// The largest interrupt threshold that a channel can be configured with
+#define AXIDMA_MAX_IRQ_THRESHOLD        255
+
+// The timeout to use to wait on a transfer handle until it completes
+#define AXIDMA_WAIT_FOREVER             ((__u64)-1)
 
 /**
  * Returns the number of available DMA channels in the system.
@@ -163,6 +371,12 @@ struct axidma_video_transaction {
  * This, along with the direction and type, uniquely identifies a DMA channel
  * in the system, and this is how you refer to a channel in later calls.
  *
+ * Each stream of a multi-channel engine, such as AXI MCDMA, is its own channel.
+ * Its id is the 'xlnx,device-id' of its channel node plus its channel in the
+ * engine's 'dmas' specifier. That is its TDEST for a transmit stream, and 16
+ * plus its TDEST for a receive stream, so the two directions never overlap
+ * when their nodes have consecutive device ids.
+ *
  * Inputs:
  *  - channels - A pointer to a region of memory that can hold at least
  *               num_channels * sizeof(struct axidma_chan) bytes.
@@ -173,6 +387,11 @@ struct axidma_video_transaction {
  *       - dir - The direction of the channel (either read or write).
  *       - type - The type of the channel (either normal DMA or video DMA).
  *       - channel_id - The integer id for the channel.
+ *       - stream_id - The TDEST of the channel on a multi-channel engine, or 0.
+ *       - ready_flags - AXIDMA_CHAN_READY_IRQ if receives on the channel are
+ *                       held until the fabric raises its data-ready interrupt,
+ *                       and AXIDMA_CHAN_READY_ACK if the driver also
+ *                       acknowledges each packet (see AXIDMA_DMA_READ).
  *       - chan - This field has no meaning and can be safely ignored.
  **/
 #define AXIDMA_GET_DMA_CHANNELS         _IOR(AXIDMA_IOCTL_MAGIC, 1, \
@@ -184,7 +403,9 @@ struct axidma_video_transaction {
  * This function sets up an asynchronous signal to be delivered to the invoking
  * process any DMA subsystem completes a transaction. If the user dispatches
  * an asynchronous transaction, and wants to know when it completes, they must
- * register a signal to be delivered.
+ * either register a signal to be delivered, or map the completion ring. When
+ * the completion ring is mapped, completions are posted to it instead, and no
+ * signal is sent.
  *
  * The signal must be one of the POSIX real time signals. So, it must be
  * between the signals SIGRTMIN and SIGRTMAX. The kernel will deliver the
@@ -216,6 +437,11 @@ struct axidma_video_transaction {
  * an IOCTL. This will return a file descriptor, which the user must pass into
  * this function, along with the virtual address in userspace.
  *
+ * The buffer does not need to be physically contiguous. It is mapped for the
+ * device the first time it is used in a transfer, and transfers on it are
+ * split into one descriptor per contiguous chunk, as for pinned memory. Video
+ * transfers need each frame buffer to fall within a single chunk.
+ *
  * Inputs:
  *  - fd - File descriptor corresponding to the DMA buffer share.
  *  - size - The size of the DMA buffer in bytes.
@@ -236,11 +462,39 @@ struct axidma_video_transaction {
  * call to mmap with the AXI DMA device. Also, the buffer must be able to hold
  * at least `buf_len` bytes.
  *
+ * Each channel can have a fixed number of transfers outstanding at once, set by
+ * the driver's queue_depth parameter. If the channel's queue is full, the call
+ * fails with EBUSY. Asynchronous transfers complete in submission order.
+ *
+ * If the call is blocking, it returns the number of bytes actually received,
+ * which is less than `buf_len` when the sender ends the packet early (TLAST).
+ * Asynchronous transfers report this length in the completion ring instead.
+ *
+ * The APP words of the received packet are only reported in the completion
+ * ring, and only if the transfer sets AXIDMA_TRANS_RX_APP. They are read from
+ * the descriptor's metadata, which the kernel's DMA driver only exposes from
+ * Linux 5.6. If the words cannot be read, or the transfer is synchronous, the
+ * call fails with EOPNOTSUPP rather than report zeros.
+ *
+ * If the channel has a data-ready interrupt in the device tree, the transfer is
+ * held in the driver, and only handed to the engine when the fabric raises it,
+ * so there is no need to poll for the event in userspace. Each interrupt
+ * starts the oldest receive held, and one raised while none is held starts the
+ * next one submitted. The completion is reported as for any other transfer,
+ * and the timeout of a blocking call includes the wait for the fabric. If the
+ * device tree also names an acknowledge register for the channel, the driver
+ * pulses it when each packet has been received, so userspace must not write
+ * it. Receive rings and forwarding on the channel are not held, but their
+ * packets are acknowledged as well.
+ *
  * Inputs:
  *  - wait - Indicates if the call should be blocking or non-blocking
  *  - channel_id - The id for the channel you want receive data over.
  *  - buf - The address of the buffer you want to receive the data in.
  *  - buf_len - The number of bytes to receive.
+ *  - user_tag - A value reported back in the completion ring when an
+ *               asynchronous transfer completes.
+ *  - flags - AXIDMA_TRANS_RX_APP to have the packet's APP words reported.
  **/
 #define AXIDMA_DMA_READ                 _IOR(AXIDMA_IOCTL_MAGIC, 4, \
                                              struct axidma_transaction)
@@ -257,11 +511,21 @@ struct axidma_video_transaction {
  * call to mmap with the AXI DMA device. Also, the buffer must be able to hold
  * at least `buf_len` bytes.
  *
+ * Each channel can have a fixed number of transfers outstanding at once, set by
+ * the driver's queue_depth parameter. If the channel's queue is full, the call
+ * fails with EBUSY. Asynchronous transfers complete in submission order.
+ *
+ * If the call is blocking, it returns the number of bytes sent.
+ *
  * Inputs:
  *  - wait - Indicates if the call should be blocking or non-blocking
  *  - channel_id - The id for the channel you want to send data over.
  *  - buf - The address of the data you want to send.
  *  - buf_len - The number of bytes to send.
+ *  - user_tag - A value reported back in the completion ring when an
+ *               asynchronous transfer completes.
+ *  - app - The APP words to place in the packet's descriptors, which the
+ *          engine presents on its control stream. Leave them zero if unused.
  **/
 #define AXIDMA_DMA_WRITE                _IOR(AXIDMA_IOCTL_MAGIC, 5, \
                                              struct axidma_transaction)
@@ -274,7 +538,7 @@ struct axidma_video_transaction {
  * (e.g. converting an image to grayscale on the PL fabric). The device id's for
  * both channels should be ones that are returned by the get dma ioctl. The user
  * can specify if the call should block. If it blocks, it will wait until the
- * receive transaction completes.
+ * receive transaction completes, and return the number of bytes received.
  *
  * The specified buffers must be within an address range that was allocated by a
  * call to mmap with the AXI DMA device. Also, each buffer must be able to hold
@@ -377,4 +641,487 @@ struct axidma_video_transaction {
  **/
 #define AXIDMA_UNREGISTER_BUFFER        _IO(AXIDMA_IOCTL_MAGIC, 10)
 
+/**
+ * Submits a batch of one-way DMA transfers with a single system call.
+ *
+ * This function prepares and submits every transaction in the array, which
+ * may refer to any mix of DMA transmit and receive channels, and only then
+ * starts the DMA engine once for each channel touched by the batch. This
+ * amortizes the cost of the system call and of starting the engine over all
+ * of the transfers in the batch.
+ *
+ * Each transaction follows the same rules as for the read and write ioctls.
+ * If a transaction has `wait` set, the call blocks until that transfer
+ * completes, and fails with the error of the first one that does not.
+ *
+ * The transactions are submitted in order. If one cannot be, the ones before
+ * it are still started, and waited on, and the call returns how many of them
+ * there are. The rest are not submitted. If not even the first can be, the
+ * call fails with its error. The channels are never stopped for another
+ * transfer's failure, but a waited transfer that times out stops its own
+ * channel, as for AXIDMA_DMA_READ and AXIDMA_DMA_WRITE.
+ *
+ * Inputs:
+ *  - num_transactions - The number of transactions in the array. This must be
+ *                       between 1 and AXIDMA_MAX_BATCH_TRANSACTIONS.
+ *  - transactions - An array of transactions, in the same format as for the
+ *                   AXIDMA_DMA_READ and AXIDMA_DMA_WRITE ioctls.
+ **/
+#define AXIDMA_DMA_SUBMIT_BATCH         _IOR(AXIDMA_IOCTL_MAGIC, 11, \
+                                             struct axidma_batch_transaction)
+
+/**
+ * Binds an eventfd to a DMA channel, to be signaled on transfer completion.
+ *
+ * Whenever an asynchronous transfer on the channel completes, the driver adds
+ * one to the eventfd's counter. This allows DMA completions to be waited on
+ * with poll() or epoll alongside other file descriptors, such as GPIO values.
+ * Binding an eventfd replaces any previous binding for the channel, and a
+ * channel with an eventfd bound no longer sends a completion signal. Only the
+ * transfers started through the file that bound the eventfd signal it. All
+ * bindings are dropped when the file is closed.
+ *
+ * The device file descriptor itself can also be polled. It is readable
+ * whenever the completion ring holds entries that have not been reaped.
+ *
+ * Inputs:
+ *  - channel_id - The id of the DMA channel to bind the eventfd to.
+ *  - fd - The eventfd to signal, or -1 to remove the current binding.
+ **/
+#define AXIDMA_SET_CHANNEL_EVENTFD      _IOR(AXIDMA_IOCTL_MAGIC, 12, \
+                                             struct axidma_channel_eventfd)
+
+/**
+ * Submits a transfer on a DMA channel, and returns a handle to it.
+ *
+ * The direction of the transfer is that of the channel, and the call never
+ * waits for the transfer to finish; the `wait` field is ignored. The returned
+ * handle holds the DMA engine cookie for the transfer, and is used with the
+ * AXIDMA_DMA_WAIT, AXIDMA_DMA_POLL, and AXIDMA_DMA_CANCEL ioctls. The transfer
+ * is also reported through the completion ring, eventfd, or signal, like any
+ * other asynchronous transfer.
+ *
+ * The transfer's slot in the channel's queue is held until its final status is
+ * collected with AXIDMA_DMA_WAIT or AXIDMA_DMA_POLL, so every handle must be
+ * reaped this way. Handles that are not reaped are freed when the file is
+ * closed.
+ *
+ * A receive on a channel with a data-ready interrupt has no cookie until the
+ * fabric raises it, so submitting one fails with EOPNOTSUPP. Such receives can
+ * only be started with AXIDMA_DMA_READ, a batch or a prepared transfer.
+ *
+ * Inputs:
+ *  - trans - The transfer to submit, as for AXIDMA_DMA_READ/AXIDMA_DMA_WRITE.
+ *
+ * Outputs:
+ *  - handle - The channel id and DMA engine cookie for the transfer.
+ **/
+#define AXIDMA_DMA_SUBMIT               _IOWR(AXIDMA_IOCTL_MAGIC, 13, \
+                                              struct axidma_submit)
+
+/**
+ * Waits for a submitted transfer to finish, and reaps its handle.
+ *
+ * The call blocks until the transfer finishes or the timeout expires. On
+ * success, the call returns the number of bytes actually transferred. On
+ * success, or if the transfer failed, the handle is reaped and can no longer
+ * be used. If the timeout expires, the call fails with ETIMEDOUT and the
+ * transfer is left in flight, so that it can be waited on again or cancelled.
+ * The call fails with ENOENT if the handle is unknown or already reaped, and
+ * with the transfer's error code (e.g. ECANCELED) if it did not complete.
+ *
+ * Inputs:
+ *  - handle - The handle returned by AXIDMA_DMA_SUBMIT.
+ *  - timeout_ns - The maximum time to wait, in nanoseconds. A timeout of 0
+ *                 does not block, and AXIDMA_WAIT_FOREVER never times out.
+ **/
+#define AXIDMA_DMA_WAIT                 _IOR(AXIDMA_IOCTL_MAGIC, 14, \
+                                             struct axidma_wait)
+
+/**
+ * Checks if a submitted transfer has finished, without blocking.
+ *
+ * If the transfer is still in flight, the call fails with EAGAIN. Otherwise,
+ * the handle is reaped, and the call returns as for AXIDMA_DMA_WAIT.
+ *
+ * Inputs:
+ *  - channel_id - The id of the channel the transfer was submitted on.
+ *  - cookie - The DMA engine cookie for the transfer.
+ **/
+#define AXIDMA_DMA_POLL                 _IOR(AXIDMA_IOCTL_MAGIC, 15, \
+                                             struct axidma_handle)
+
+/**
+ * Cancels a submitted transfer that is still in flight.
+ *
+ * The DMA engine cannot abort a single descriptor, so this stops the channel,
+ * and every transfer still in flight on it finishes with ECANCELED. So that
+ * it never cancels another file's transfers, the call fails with EBUSY unless
+ * the file has claimed the channel with AXIDMA_CLAIM_CHANNEL, or no other file
+ * has anything in flight on it. Callers that share a channel should claim it
+ * before cancelling. If the transfer has already finished, this has no
+ * effect. In either case, the handle must still be reaped with
+ * AXIDMA_DMA_WAIT or AXIDMA_DMA_POLL.
+ *
+ * Inputs:
+ *  - channel_id - The id of the channel the transfer was submitted on.
+ *  - cookie - The DMA engine cookie for the transfer.
+ **/
+#define AXIDMA_DMA_CANCEL               _IOR(AXIDMA_IOCTL_MAGIC, 16, \
+                                             struct axidma_handle)
+
+/**
+ * Makes the data written by the device into a DMA buffer visible to the CPU.
+ *
+ * Buffers mapped with the AXIDMA_MMAP_CACHED_BUFFER page offset are cached by
+ * the CPU, and are not kept coherent with the device. After a receive transfer
+ * into such a buffer completes, this must be called on the received range
+ * before the CPU reads it. The call has no effect on uncached and
+ * write-combined buffers.
+ *
+ * Cacheable buffers must be physically contiguous pages from the page
+ * allocator, so their size is limited to the largest page block the kernel
+ * can allocate (typically 4 MiB).
+ *
+ * Inputs:
+ *  - user_addr - The start of the range, inside a buffer allocated by mmap.
+ *  - size - The number of bytes in the range.
+ **/
+#define AXIDMA_SYNC_FOR_CPU             _IOR(AXIDMA_IOCTL_MAGIC, 17, \
+                                             struct axidma_sync_range)
+
+/**
+ * Makes the data written by the CPU into a DMA buffer visible to the device.
+ *
+ * For cacheable buffers, this must be called on a range after the CPU writes
+ * it, and before a transmit transfer from it is started. It should also be
+ * called on a receive buffer that the CPU has written to, before the receive
+ * is started. For write-combined buffers, this only drains the CPU's write
+ * buffers, and uncached buffers need no synchronization.
+ *
+ * Inputs:
+ *  - user_addr - The start of the range, inside a buffer allocated by mmap.
+ *  - size - The number of bytes in the range.
+ **/
+#define AXIDMA_SYNC_FOR_DEVICE          _IOR(AXIDMA_IOCTL_MAGIC, 18, \
+                                             struct axidma_sync_range)
+
+/**
+ * Pins ordinary user memory, so that it can be used directly for transfers.
+ *
+ * This allows memory that was not allocated through the driver, such as a
+ * malloc() or stack buffer, to be used as the source or destination of a DMA
+ * transfer without copying it into a DMA buffer first. The pages backing the
+ * range are pinned and mapped for DMA until the memory is unpinned, or the
+ * file is closed. The memory does not need to be physically contiguous, so
+ * transfers on it are split into one descriptor per contiguous chunk.
+ *
+ * Pinned memory is cached by the CPU, so it must be synchronized with the
+ * AXIDMA_SYNC_FOR_DEVICE and AXIDMA_SYNC_FOR_CPU ioctls, the same as a
+ * cacheable DMA buffer. Only DMA channels can use pinned memory, not VDMA.
+ *
+ * Inputs:
+ *  - user_addr - The user virtual address of the memory.
+ *  - size - The number of bytes to pin.
+ **/
+#define AXIDMA_PIN_BUFFER               _IOR(AXIDMA_IOCTL_MAGIC, 19, \
+                                             struct axidma_pin_buffer)
+
+/**
+ * Unpins user memory previously pinned through an AXIDMA_PIN_BUFFER IOCTL.
+ *
+ * No transfers on the memory may be in flight when it is unpinned.
+ *
+ * Inputs:
+ *  - user_addr - The user virtual address the memory was pinned with.
+ **/
+#define AXIDMA_UNPIN_BUFFER             _IO(AXIDMA_IOCTL_MAGIC, 20)
+
+/**
+ * Starts continuously receiving into a ring of slots on a DMA receive channel.
+ *
+ * The ring's indices are first mapped with mmap, at the AXIDMA_MMAP_RX_RING
+ * page offset, and the mapping must have room for the length of every slot
+ * after the header. The slots are laid out back to back in `buf`, which must
+ * be a buffer allocated or pinned through the driver that holds
+ * `num_slots * slot_size` bytes.
+ *
+ * Every slot is armed on the channel at once, so data arriving between
+ * packets always has somewhere to go. When a slot is filled, the driver
+ * publishes its length and advances the producer index, and the channel's
+ * eventfd is signaled, if one is bound. Userspace reads the slots in order,
+ * and advances the consumer index to hand them back, which re-arms them
+ * without a system call.
+ *
+ * If userspace falls so far behind that no slot is left armed, the channel
+ * stalls and the driver sets AXIDMA_RX_RING_NEED_KICK in the ring's flags.
+ * After it next advances the consumer index, userspace must then call
+ * AXIDMA_KICK_RX_RING to re-arm the slots. Any other transfer on the channel
+ * fails with EBUSY while the ring runs. The ring is stopped with the
+ * AXIDMA_STOP_DMA_CHANNEL ioctl, or when its indices are unmapped, which also
+ * happens when the process exits. If a slot fails, the ring stops, and the
+ * error is left in the ring's status.
+ *
+ * Inputs:
+ *  - channel_id - The id of the DMA receive channel to run the ring on.
+ *  - ring - The user virtual address of the ring's mapped indices.
+ *  - buf - The user virtual address of the first slot.
+ *  - slot_size - The number of bytes in each slot.
+ *  - num_slots - The number of slots in the ring.
+ **/
+#define AXIDMA_START_RX_RING            _IOR(AXIDMA_IOCTL_MAGIC, 21, \
+                                             struct axidma_rx_ring_config)
+
+/**
+ * Re-arms the slots of a receive ring after it has stalled.
+ *
+ * This only needs to be called when the driver has set
+ * AXIDMA_RX_RING_NEED_KICK in the ring's flags. Otherwise, it has no effect.
+ *
+ * Inputs:
+ *  - channel_id - The id of the channel the ring runs on.
+ **/
+#define AXIDMA_KICK_RX_RING             _IO(AXIDMA_IOCTL_MAGIC, 22)
+
+/**
+ * Prepares a transfer that is started repeatedly on the same buffer.
+ *
+ * The channel and buffer are looked up, and the scatter-gather list for the
+ * buffer is built, only once, here. Each AXIDMA_START_PREPARED then only has
+ * to hand the transfer to the DMA engine. The direction of the transfer is
+ * that of the channel, which must be a DMA channel, not VDMA. If any buffer is
+ * unmapped, unpinned or unregistered after this call, the buffer is looked up
+ * again on the next start, and the start fails with EFAULT if it is gone.
+ *
+ * Inputs:
+ *  - trans - The transfer to prepare, as for AXIDMA_DMA_READ/AXIDMA_DMA_WRITE.
+ *            If `wait` is set, every start of the transfer blocks until it
+ *            completes.
+ *
+ * Outputs:
+ *  - id - The id of the prepared transfer.
+ **/
+#define AXIDMA_PREPARE                  _IOWR(AXIDMA_IOCTL_MAGIC, 23, \
+                                              struct axidma_prepare)
+
+/**
+ * Starts a transfer prepared through an AXIDMA_PREPARE IOCTL.
+ *
+ * The transfer is queued and completes the same as one started with
+ * AXIDMA_DMA_READ or AXIDMA_DMA_WRITE. A prepared transfer can be started
+ * again before the previous start has completed. If the transfer was prepared
+ * with `wait` set, the call returns the number of bytes transferred.
+ *
+ * Inputs:
+ *  - id - The id of the prepared transfer.
+ **/
+#define AXIDMA_START_PREPARED           _IO(AXIDMA_IOCTL_MAGIC, 24)
+
+/**
+ * Frees a transfer prepared through an AXIDMA_PREPARE IOCTL.
+ *
+ * Starts of the transfer that are still in flight are not affected. Prepared
+ * transfers that are not freed are freed when the file is closed.
+ *
+ * Inputs:
+ *  - id - The id of the prepared transfer.
+ **/
+#define AXIDMA_UNPREPARE                _IO(AXIDMA_IOCTL_MAGIC, 25)
+
+/**
+ * Sets how long synchronous transfers on a channel spin before sleeping.
+ *
+ * A thread waiting on a synchronous transfer normally sleeps until the
+ * transfer's interrupt wakes it up, which for small transfers can take longer
+ * than the transfer itself. With a budget set, the thread first spins on the
+ * CPU for up to that long, and only sleeps if the transfer has not finished
+ * by then. The spin also ends early if the scheduler needs the CPU. The
+ * initial budget is the driver's poll_budget_ns parameter, which is 0 (never
+ * spin) by default.
+ *
+ * Inputs:
+ *  - channel_id - The id of the channel.
+ *  - budget_ns - The maximum time to spin, in nanoseconds, or 0 to never spin.
+ **/
+#define AXIDMA_SET_POLL_BUDGET          _IOR(AXIDMA_IOCTL_MAGIC, 26, \
+                                             struct axidma_busy_poll)
+
+/**
+ * Gets the spin budget of a channel, and how well spinning has worked on it.
+ *
+ * Inputs:
+ *  - channel_id - The id of the channel.
+ *
+ * Outputs:
+ *  - budget_ns - The maximum time to spin, in nanoseconds.
+ *  - hits - The number of transfers that finished while their thread spun.
+ *  - misses - The number of transfers that were waited on by sleeping after
+ *             the budget ran out.
+ *  - spin_ns - The total time spent spinning, in nanoseconds.
+ **/
+#define AXIDMA_GET_POLL_STATS           _IOWR(AXIDMA_IOCTL_MAGIC, 27, \
+                                              struct axidma_busy_poll)
+
+/**
+ * Sets the tunables of a channel.
+ *
+ * By default, every transfer on a DMA channel raises its own interrupt. With
+ * an interrupt threshold of N, asynchronous transfers are held back until N
+ * of them are queued, and are then started together, so the engine raises one
+ * interrupt for the whole group. A transfer is never held back for longer than
+ * the interrupt delay, and a synchronous transfer starts everything held back
+ * along with itself. On VDMA channels, the threshold is instead the number of
+ * frames per interrupt, and takes effect on the next video transfer.
+ *
+ * Transfers are only held back while the channel is idle. Each time a transfer
+ * completes, the Xilinx DMA driver starts every transfer already submitted,
+ * and the group raises one interrupt. So on a busy channel, the groups are
+ * formed by the engine, and their size does not follow the threshold or the
+ * delay.
+ *
+ * The queue depth can be set to at most the depth the channel was created
+ * with. Lowering it does not affect transfers already in flight. The defaults
+ * for all of the tunables come from the channel's device tree node, and are
+ * also available under /sys/class/axidma/axidma<N>/channel<id>/.
+ *
+ * Inputs:
+ *  - channel_id - The id of the channel.
+ *  - irq_threshold - The number of transfers to complete per interrupt,
+ *                    between 1 and AXIDMA_MAX_IRQ_THRESHOLD. This can be at
+ *                    most the queue depth.
+ *  - irq_delay_us - The longest a transfer is held back, in microseconds.
+ *  - timeout_ms - How long to wait for a synchronous transfer before it is
+ *                 cancelled, in milliseconds. This must not be 0.
+ *  - queue_depth - The number of transfers that can be in flight at once.
+ **/
+#define AXIDMA_SET_CHANNEL_CONFIG       _IOR(AXIDMA_IOCTL_MAGIC, 28, \
+                                             struct axidma_channel_config)
+
+/**
+ * Gets the tunables of a channel.
+ *
+ * Inputs:
+ *  - channel_id - The id of the channel.
+ *
+ * Outputs:
+ *  - irq_threshold, irq_delay_us, timeout_ms, queue_depth - The tunables, as
+ *    for AXIDMA_SET_CHANNEL_CONFIG.
+ **/
+#define AXIDMA_GET_CHANNEL_CONFIG       _IOWR(AXIDMA_IOCTL_MAGIC, 29, \
+                                              struct axidma_channel_config)
+
+/**
+ * Gets the statistics of a channel.
+ *
+ * The counters start at zero when the driver is loaded, and are never reset,
+ * so rates can be found by sampling them twice. Slots filled by a receive ring
+ * are counted as they are filled, and are not in the latency histogram. The
+ * same statistics are shown for every channel in the debugfs file
+ * axidma<N>/stats.
+ *
+ * Inputs:
+ *  - channel_id - The id of the channel.
+ *
+ * Outputs:
+ *  - in_flight - The number of transfers currently on the engine.
+ *  - max_in_flight - The most transfers that were ever on the engine at once.
+ *  - submitted - The number of transfers handed to the engine.
+ *  - completed - The number of transfers that completed successfully.
+ *  - bytes - The number of bytes moved by the completed transfers.
+ *  - timeouts - The number of synchronous transfers that timed out.
+ *  - errors - The number of transfers that failed or were stopped, including
+ *             those that timed out.
+ *  - ready_irqs - The number of data-ready interrupts the fabric raised, on a
+ *                 channel that has one.
+ *  - latency_hist - A log2 histogram of the time from submitting each
+ *                   completed transfer to its completion, as described for
+ *                   AXIDMA_LATENCY_BUCKETS.
+ **/
+#define AXIDMA_GET_STATS                _IOWR(AXIDMA_IOCTL_MAGIC, 30, \
+                                              struct axidma_channel_stats)
+
+/**
+ * Claims a channel for the exclusive use of this file.
+ *
+ * Channels are shared by every file that has the device open, so transfers
+ * from several processes can be interleaved on the same channel. Once a file
+ * claims a channel, any other file that tries to start a transfer on it, or to
+ * change its eventfd or tunables, fails with EBUSY. This allows, for example,
+ * a receiving process and a transmitting process to each own one channel of
+ * the device. Claiming a channel that the file already holds has no effect.
+ * Transfers that other files already have on the channel are not affected.
+ *
+ * Inputs:
+ *  - channel_id - The id of the channel to claim.
+ **/
+#define AXIDMA_CLAIM_CHANNEL            _IO(AXIDMA_IOCTL_MAGIC, 31)
+
+/**
+ * Releases a channel claimed through an AXIDMA_CLAIM_CHANNEL IOCTL.
+ *
+ * The channel is shared with the other files again. Claims that are not
+ * released are released when the file is closed.
+ *
+ * Inputs:
+ *  - channel_id - The id of the channel to release.
+ **/
+#define AXIDMA_RELEASE_CHANNEL          _IO(AXIDMA_IOCTL_MAGIC, 32)
+
+/**
+ * Exports a DMA buffer allocated by the driver as a dma-buf.
+ *
+ * This is the reverse of AXIDMA_REGISTER_BUFFER. The returned file descriptor
+ * can be passed to another process over a Unix domain socket, and mapped there
+ * with mmap(), or imported by another driver, so that received data reaches
+ * its consumer without being copied. The memory of the buffer stays allocated
+ * until it is unmapped by this process, and the dma-buf is closed everywhere.
+ *
+ * The dma-buf is mapped with the same caching as the buffer. For a cacheable
+ * buffer, processes that map the dma-buf must bracket their accesses with the
+ * DMA_BUF_IOCTL_SYNC ioctl on it, which synchronizes the CPU caches.
+ *
+ * Inputs:
+ *  - user_addr - The start of a buffer allocated by calling mmap() on the
+ *                device. The whole buffer is exported.
+ *
+ * Outputs:
+ *  - fd - A file descriptor for the dma-buf, with close-on-exec set.
+ **/
+#define AXIDMA_EXPORT_BUFFER            _IOWR(AXIDMA_IOCTL_MAGIC, 33, \
+                                              struct axidma_export_buffer)
+
+/**
+ * Forwards every packet received on a channel out on a transmit channel,
+ * without the data passing through userspace.
+ *
+ * The slots are laid out back to back in `buf`, which must be a buffer
+ * allocated, pinned or registered through the driver that holds
+ * `num_slots * slot_size` bytes. Every slot starts armed on the receive
+ * channel. When a packet fills a slot, the driver queues the same slot on
+ * the transmit channel from the completion path, for the number of bytes
+ * received, and arms the slot for receiving again once it has been sent.
+ * Neither the CPU nor userspace touches the data. The channels may belong to
+ * different engines of the device, such as a stream of an MCDMA engine and a
+ * plain AXI DMA engine, which bridges one link to another.
+ *
+ * Any other transfer on either channel fails with EBUSY while forwarding
+ * runs. Forwarding is stopped with the AXIDMA_STOP_DMA_CHANNEL ioctl on
+ * either channel, when the buffer is freed, or when the file is closed. If
+ * a transfer fails, or a slot cannot be re-armed, forwarding stops, and the
+ * error is logged. The packets forwarded are counted in the statistics of
+ * both channels.
+ *
+ * Inputs:
+ *  - rx_channel_id - The id of the DMA receive channel to forward from.
+ *  - tx_channel_id - The id of the DMA transmit channel to forward to.
+ *  - buf - The user virtual address of the first slot.
+ *  - slot_size - The number of bytes in each slot, which is the largest
+ *                packet that can be received.
+ *  - num_slots - The number of slots, between 1 and AXIDMA_MAX_FORWARD_SLOTS.
+ *  - max_length - The most bytes of each packet to forward, or 0 to forward
+ *                 every packet whole. Empty packets are never forwarded.
+ **/
+#define AXIDMA_START_FORWARD            _IOR(AXIDMA_IOCTL_MAGIC, 34, \
+                                             struct axidma_forward_config)
+
 #endif /* AXIDMA_IOCTL_H_ */
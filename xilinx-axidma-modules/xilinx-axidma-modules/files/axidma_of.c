@@ -12,6 +12,8 @@
 
 // Kernel Dependencies
 #include <linux/of.h>               // Device tree parsing functions
+#include <linux/of_address.h>       // Device tree address parsing functions
+#include <linux/of_irq.h>           // Device tree interrupt parsing functions
 #include <linux/platform_device.h>  // Platform device definitions
 
 // Local Dependencies
@@ -77,54 +79,153 @@ static int axidma_of_parse_dma_name(struct device_node *driver_node, int index,
     return 0;
 }
 
+/* Reads the optional tunables for a channel, each of which keeps its default
+ * if the channel node does not have the property. */
+static int axidma_of_parse_tunables(struct device_node *dma_chan_node,
+        struct axidma_channel_config *config)
+{
+    struct device_node *np;
+
+    // Shorten the name for the dma_chan_node
+    np = dma_chan_node;
+
+    of_property_read_u32(np, "axidma,irq-threshold", &config->irq_threshold);
+    of_property_read_u32(np, "axidma,irq-delay-us", &config->irq_delay_us);
+    of_property_read_u32(np, "axidma,timeout-ms", &config->timeout_ms);
+    of_property_read_u32(np, "axidma,queue-depth", &config->queue_depth);
+
+    // Check that the tunables are in range, the same as the ioctl does
+    if (config->queue_depth == 0) {
+        axidma_node_err(np, "'axidma,queue-depth' property cannot be 0.\n");
+        return -EINVAL;
+    } else if (config->irq_threshold == 0 ||
+               config->irq_threshold > AXIDMA_MAX_IRQ_THRESHOLD ||
+               config->irq_threshold > config->queue_depth) {
+        axidma_node_err(np, "'axidma,irq-threshold' property is not between 1 "
+                        "and the smaller of %d and the queue depth.\n",
+                        AXIDMA_MAX_IRQ_THRESHOLD);
+        return -EINVAL;
+    } else if (config->timeout_ms == 0) {
+        axidma_node_err(np, "'axidma,timeout-ms' property cannot be 0.\n");
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+/* Finds the child node of the DMA engine that describes the given channel of
+ * the engine, and the stream (TDEST) of the channel within that node. */
+static struct device_node *axidma_of_find_chan_node(
+        struct device_node *dma_node, int channel, int *stream_id)
+{
+    int i;
+    u32 num_streams;
+    const char *compatible;
+    struct device_node *dma_chan_node;
+
+    // The channels of a single stream engine are its child nodes, in order
+    if (of_device_is_compatible(dma_node, "xlnx,axi-mcdma-1.00.a") <= 0) {
+        *stream_id = 0;
+        if (channel < 0 || channel >= of_get_child_count(dma_node)) {
+            return NULL;
+        }
+
+        dma_chan_node = of_get_next_child(dma_node, NULL);
+        for (i = 0; i < channel; i++)
+        {
+            dma_chan_node = of_get_next_child(dma_node, dma_chan_node);
+        }
+        return dma_chan_node;
+    }
+
+    /* The first half of the channels of an MCDMA engine are its transmit
+     * streams, and the second half are its receive streams. The streams of each
+     * direction share one child node, and are numbered by their TDEST. */
+    if (channel < 0 || channel >= AXIDMA_MCDMA_MAX_CHANS) {
+        return NULL;
+    }
+    compatible = (channel < AXIDMA_MCDMA_MAX_CHANS / 2) ?
+            "xlnx,axi-dma-mm2s-channel" : "xlnx,axi-dma-s2mm-channel";
+    *stream_id = channel % (AXIDMA_MCDMA_MAX_CHANS / 2);
+    for_each_child_of_node(dma_node, dma_chan_node)
+    {
+        if (of_device_is_compatible(dma_chan_node, compatible) <= 0) {
+            continue;
+        }
+
+        // The node only has as many streams as the engine was built with
+        num_streams = 1;
+        of_property_read_u32(dma_chan_node, "dma-channels", &num_streams);
+        if (*stream_id < num_streams) {
+            return dma_chan_node;
+        }
+        of_node_put(dma_chan_node);
+        break;
+    }
+
+    return NULL;
+}
+
 static int axidma_of_parse_channel(struct device_node *dma_node, int channel,
-        struct axidma_chan *chan, struct axidma_device *dev)
+        struct axidma_chan *chan, struct axidma_channel_config *config,
+        struct axidma_device *dev)
 {
-    int rc;
+    int rc, stream_id, id_offset;
     struct device_node *dma_chan_node;
     u32 channel_id;
 
-    // Verify that the DMA node has two channel (child) nodes, one for TX and RX
+    // Verify that the DMA node has channel (child) nodes
     if (of_get_child_count(dma_node) < 1) {
         axidma_node_err(dma_node, "DMA does not have any channel nodes.\n");
         return -EINVAL;
-    } else if (of_get_child_count(dma_node) > 4) {
-        axidma_node_err(dma_node, "DMA has more than 4 channel nodes.\n");
-        return -EINVAL;
-    }
-
-    // Go to the child node that we're parsing
-    dma_chan_node = of_get_next_child(dma_node, NULL);
-    if (channel == 1) {
-        dma_chan_node = of_get_next_child(dma_node, dma_chan_node);
     }
 
-    // Check if the specified node exists
+    // Go to the child node that we're parsing, and check that it exists
+    dma_chan_node = axidma_of_find_chan_node(dma_node, channel, &stream_id);
     if (dma_chan_node == NULL) {
-        axidma_node_err(dma_chan_node, "Unable to find child node number %d.\n",
-                channel);
+        axidma_node_err(dma_node, "DMA does not have a channel number %d.\n",
+                        channel);
+        return -EINVAL;
     }
 
-    // Read out the channel's unique device id, and put it in the structure
+    /* Read out the channel's unique device id, and put it in the structure.
+     * The streams of a multi-channel engine are offset from the id of their
+     * node by their channel in the engine. The receive streams come after all
+     * of the transmit streams, so the ids of the two directions cannot
+     * overlap when their nodes have consecutive device ids. */
     if (of_find_property(dma_chan_node, "xlnx,device-id", NULL) == NULL) {
         axidma_node_err(dma_chan_node, "DMA channel is missing the "
                         "'xlnx,device-id' property.\n");
-        return -EINVAL;
+        rc = -EINVAL;
+        goto put_node;
     }
     rc = of_property_read_u32(dma_chan_node, "xlnx,device-id", &channel_id);
     if (rc < 0) {
         axidma_err("Unable to read the 'xlnx,device-id' property.\n");
-        return -EINVAL;
+        rc = -EINVAL;
+        goto put_node;
+    }
+    id_offset = 0;
+    if (of_device_is_compatible(dma_node, "xlnx,axi-mcdma-1.00.a") > 0) {
+        id_offset = channel;
     }
-    chan->channel_id = channel_id;
+    chan->channel_id = channel_id + id_offset;
+    chan->stream_id = stream_id;
+    chan->ready_flags = 0;
+    config->channel_id = chan->channel_id;
 
     // Use the compatible string to determine the channel's information
     rc = axidma_parse_compatible_property(dma_chan_node, chan, dev);
     if (rc < 0) {
-        return rc;
+        goto put_node;
     }
 
-    return 0;
+    // Read any tunables that override the defaults for the channel
+    rc = axidma_of_parse_tunables(dma_chan_node, config);
+
+put_node:
+    of_node_put(dma_chan_node);
+    return rc;
 }
 
 static int axidma_check_unique_ids(struct axidma_device *dev)
@@ -231,21 +332,19 @@ int axidma_of_parse_dma_nodes(struct platform_device *pdev,
             return rc;
         }
 
-        // Check that the phandle has the expected arguments
+        /* Check that the phandle has the expected arguments. The channel is
+         * checked against the engine's channels when it is parsed. */
         dma_node = phandle_args.np;
         channel = phandle_args.args[0];
         if (phandle_args.args_count < 1) {
             axidma_node_err(driver_node, "Phandle %d in the 'dmas' property is "
                             "is missing the channel direciton argument.\n", i);
             return -EINVAL;
-        } else if (channel != 0 && channel != 1) {
-            axidma_node_err(driver_node, "Phandle %d in the 'dmas' property "
-                            "has an invalid channel (argument 0).\n", i);
-            return -EINVAL;
         }
 
         // Parse out the information about the channel
-        rc = axidma_of_parse_channel(dma_node, channel, &dev->channels[i], dev);
+        rc = axidma_of_parse_channel(dma_node, channel, &dev->channels[i],
+                                     &dev->chan_configs[i], dev);
         if (rc < 0) {
             return rc;
         }
@@ -260,3 +359,100 @@ int axidma_of_parse_dma_nodes(struct platform_device *pdev,
     // Check that all channels have unique channel ID's
     return axidma_check_unique_ids(dev);
 }
+
+/* Finds the reserved memory region that the device's 'memory-region' property
+ * refers to, if any. Returns -ENOENT if the device has no region. */
+int axidma_of_parse_memory_region(struct platform_device *pdev,
+                                  struct resource *res)
+{
+    int rc;
+    struct device_node *driver_node, *mem_node;
+
+    // The property is optional, buffers come from the DMA allocator without it
+    driver_node = pdev->dev.of_node;
+    mem_node = of_parse_phandle(driver_node, "memory-region", 0);
+    if (mem_node == NULL) {
+        return -ENOENT;
+    }
+
+    /* The region is mapped uncached for the buffers, so it cannot also be in
+     * the kernel's cached linear mapping */
+    if (!of_property_read_bool(mem_node, "no-map")) {
+        axidma_node_err(mem_node, "The reserved memory region must have the "
+                        "'no-map' property.\n");
+        rc = -EINVAL;
+        goto put_node;
+    }
+
+    rc = of_address_to_resource(mem_node, 0, res);
+    if (rc < 0) {
+        axidma_node_err(mem_node, "Unable to get the address of the reserved "
+                        "memory region.\n");
+    }
+
+put_node:
+    of_node_put(mem_node);
+    return rc;
+}
+
+/* Finds the data-ready interrupt of a channel, which is the entry of the
+ * device's 'interrupts' whose 'interrupt-names' entry matches the channel's
+ * 'dma-names' entry. Returns the interrupt number, or 0 if it has none. */
+int axidma_of_parse_ready_irq(struct platform_device *pdev,
+                              struct axidma_chan *chan)
+{
+    int index, irq;
+    struct device_node *driver_node;
+
+    // The property is optional, receives start as soon as they are submitted
+    driver_node = pdev->dev.of_node;
+    index = of_property_match_string(driver_node, "interrupt-names",
+                                     chan->name);
+    if (index < 0) {
+        return 0;
+    }
+
+    // Only a receive has to wait for the fabric to have data ready for it
+    if (chan->type != AXIDMA_DMA || chan->dir != AXIDMA_READ) {
+        axidma_node_err(driver_node, "The data-ready interrupt '%s' is only "
+                        "supported on DMA receive channels.\n", chan->name);
+        return -EINVAL;
+    }
+
+    // The GPIO controller may not have probed yet, so pass on a deferral
+    irq = of_irq_get(driver_node, index);
+    if (irq == 0) {
+        irq = -EINVAL;
+    }
+    if (irq < 0 && irq != -EPROBE_DEFER) {
+        axidma_node_err(driver_node, "Unable to map the data-ready interrupt "
+                        "'%s'.\n", chan->name);
+    }
+    return irq;
+}
+
+/* Finds the register that acknowledges a channel's data-ready interrupt, which
+ * is the entry of the device's 'reg' whose 'reg-names' entry matches the
+ * channel's 'dma-names' entry. Returns 1 if it has one, or 0 if not. */
+int axidma_of_parse_ready_ack(struct platform_device *pdev,
+                              struct axidma_chan *chan, struct resource *res)
+{
+    int index, rc;
+    struct device_node *driver_node;
+
+    // The property is optional, userspace may acknowledge the fabric itself
+    driver_node = pdev->dev.of_node;
+    index = of_property_match_string(driver_node, "reg-names", chan->name);
+    if (index < 0) {
+        return 0;
+    }
+
+    rc = of_address_to_resource(driver_node, index, res);
+    if (rc < 0) {
+        axidma_node_err(driver_node, "Unable to parse the data-ready "
+                        "acknowledge register '%s'.\n", chan->name);
+        return rc;
+    }
+
+    return 1;
+}
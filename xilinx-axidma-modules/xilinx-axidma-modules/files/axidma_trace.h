@@ -0,0 +1,164 @@
+/**
+ * @file axidma_trace.h
+ * @date Friday, October 16, 2026
+ *
+ * This file contains the tracepoints for the lifecycle of a transfer in the
+ * AXI DMA module. They can be enabled through ftrace or perf under the
+ * "axidma" system, and cost nothing while they are disabled.
+ *
+ * @bug No known bugs.
+ **/
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM axidma
+
+#if !defined(AXIDMA_TRACE_H_) || defined(TRACE_HEADER_MULTI_READ)
+#define AXIDMA_TRACE_H_
+
+// Kernel dependencies
+#include <linux/tracepoint.h>       // Tracepoint definition macros
+#include <linux/types.h>            // DMA address and cookie types
+
+/*----------------------------------------------------------------------------
+ * Transfer Events
+ *----------------------------------------------------------------------------*/
+
+/* A descriptor was prepared for a transfer on the engine. The transfer has no
+ * cookie until it is submitted. */
+TRACE_EVENT(axidma_prep,
+    TP_PROTO(int channel_id, size_t length, dma_addr_t dma_addr, int sg_len),
+    TP_ARGS(channel_id, length, dma_addr, sg_len),
+
+    TP_STRUCT__entry(
+        __field(int, channel_id)
+        __field(size_t, length)
+        __field(dma_addr_t, dma_addr)
+        __field(int, sg_len)
+    ),
+
+    TP_fast_assign(
+        __entry->channel_id = channel_id;
+        __entry->length = length;
+        __entry->dma_addr = dma_addr;
+        __entry->sg_len = sg_len;
+    ),
+
+    TP_printk("channel=%d length=%zu dma_addr=%#llx sg_len=%d",
+              __entry->channel_id, __entry->length,
+              (unsigned long long)__entry->dma_addr, __entry->sg_len)
+);
+
+// The events that follow a single transfer, once it has a cookie
+DECLARE_EVENT_CLASS(axidma_transfer,
+    TP_PROTO(int channel_id, dma_cookie_t cookie, size_t length,
+             dma_addr_t dma_addr, int status),
+    TP_ARGS(channel_id, cookie, length, dma_addr, status),
+
+    TP_STRUCT__entry(
+        __field(int, channel_id)
+        __field(dma_cookie_t, cookie)
+        __field(size_t, length)
+        __field(dma_addr_t, dma_addr)
+        __field(int, status)
+    ),
+
+    TP_fast_assign(
+        __entry->channel_id = channel_id;
+        __entry->cookie = cookie;
+        __entry->length = length;
+        __entry->dma_addr = dma_addr;
+        __entry->status = status;
+    ),
+
+    TP_printk("channel=%d cookie=%d length=%zu dma_addr=%#llx status=%d",
+              __entry->channel_id, __entry->cookie, __entry->length,
+              (unsigned long long)__entry->dma_addr, __entry->status)
+);
+
+// The transfer was submitted to the engine's queue
+DEFINE_EVENT(axidma_transfer, axidma_submit,
+    TP_PROTO(int channel_id, dma_cookie_t cookie, size_t length,
+             dma_addr_t dma_addr, int status),
+    TP_ARGS(channel_id, cookie, length, dma_addr, status)
+);
+
+/* The engine's completion callback ran for the transfer. The length is the
+ * number of bytes actually transferred. */
+DEFINE_EVENT(axidma_transfer, axidma_callback,
+    TP_PROTO(int channel_id, dma_cookie_t cookie, size_t length,
+             dma_addr_t dma_addr, int status),
+    TP_ARGS(channel_id, cookie, length, dma_addr, status)
+);
+
+// The thread waiting on a synchronous transfer woke up
+DEFINE_EVENT(axidma_transfer, axidma_wake,
+    TP_PROTO(int channel_id, dma_cookie_t cookie, size_t length,
+             dma_addr_t dma_addr, int status),
+    TP_ARGS(channel_id, cookie, length, dma_addr, status)
+);
+
+// A synchronous transfer timed out, and the channel is about to be stopped
+DEFINE_EVENT(axidma_transfer, axidma_timeout,
+    TP_PROTO(int channel_id, dma_cookie_t cookie, size_t length,
+             dma_addr_t dma_addr, int status),
+    TP_ARGS(channel_id, cookie, length, dma_addr, status)
+);
+
+/*----------------------------------------------------------------------------
+ * Channel Events
+ *----------------------------------------------------------------------------*/
+
+/* The engine was started on all of the transfers submitted to the channel, up
+ * to the last cookie. The count is the number that were held back to share an
+ * interrupt, not counting the one that started them, if any. */
+TRACE_EVENT(axidma_issue_pending,
+    TP_PROTO(int channel_id, dma_cookie_t last_cookie, int deferred),
+    TP_ARGS(channel_id, last_cookie, deferred),
+
+    TP_STRUCT__entry(
+        __field(int, channel_id)
+        __field(dma_cookie_t, last_cookie)
+        __field(int, deferred)
+    ),
+
+    TP_fast_assign(
+        __entry->channel_id = channel_id;
+        __entry->last_cookie = last_cookie;
+        __entry->deferred = deferred;
+    ),
+
+    TP_printk("channel=%d last_cookie=%d deferred=%d", __entry->channel_id,
+              __entry->last_cookie, __entry->deferred)
+);
+
+/* The channel was stopped, and every transfer on it up to the last cookie
+ * finished with the given status. */
+TRACE_EVENT(axidma_terminate,
+    TP_PROTO(int channel_id, dma_cookie_t last_cookie, int status),
+    TP_ARGS(channel_id, last_cookie, status),
+
+    TP_STRUCT__entry(
+        __field(int, channel_id)
+        __field(dma_cookie_t, last_cookie)
+        __field(int, status)
+    ),
+
+    TP_fast_assign(
+        __entry->channel_id = channel_id;
+        __entry->last_cookie = last_cookie;
+        __entry->status = status;
+    ),
+
+    TP_printk("channel=%d last_cookie=%d status=%d", __entry->channel_id,
+              __entry->last_cookie, __entry->status)
+);
+
+#endif /* AXIDMA_TRACE_H_ */
+
+/* The trace header is included again by define_trace.h, from the directory of
+ * this module, which the Makefile adds to the include path. */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE axidma_trace
+#include <trace/define_trace.h>